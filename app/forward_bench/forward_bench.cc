@@ -0,0 +1,211 @@
+// EPOS IP Forwarding Benchmark
+//
+// Three nodes on the same segment: a source (address % 3 == 1), a gateway (the source's successor) and a sink (the
+// gateway's successor). The source reaches the sink through a host route via the gateway, which forwards each datagram
+// back onto the segment. Each round, the gateway grows its routing table with random prefixes (/8 to /32, none of them
+// covering the segment) and times longest-prefix-match lookups, then the source sends COUNT datagrams to the sink.
+// The gateway and the sink print a single machine-readable line per round, respectively:
+//
+//     BENCH,route_lookup_<routes>,<lookups>,<us>,<ns per lookup>
+//     BENCH,ip_forward_<routes>,<datagrams>,<us>,<datagrams/s>
+//
+// Each round, the gateway also checks that a few nested prefixes (set apart from the random ones, under 10/8) resolve to
+// their longest match, reporting any mismatch as "FAIL,route_lookup_<routes>". The sink reports rounds in which no
+// datagram arrived as "FAIL,ip_forward_<routes>".
+
+#include <utility/ostream.h>
+#include <utility/random.h>
+#include <architecture.h>
+#include <machine.h>
+#include <communicator.h>
+#include <process.h>
+
+using namespace EPOS;
+
+typedef TSC::Time_Stamp Time_Stamp;
+
+const unsigned int ROUTES[] = { 16, 256, 4096 }; // in the gateway's table during each round, cumulative
+const unsigned int LOOKUPS = 100000; // per round
+const unsigned int COUNT = 1000; // datagrams per round
+const unsigned int SIZE = 64; // bytes per datagram
+const unsigned int ROUND = 4000000; // us, rounds are kept in step by time alone
+const unsigned int SETTLE = 1000000; // us into each round before the source sends
+const unsigned short PORT = 8000;
+const unsigned int WARM_UP = 0xffff; // round of the datagrams that get ARP resolved along the path
+
+OStream cout;
+
+struct Message {
+    unsigned int round;
+    unsigned int sequence;
+    unsigned char padding[SIZE - 2 * sizeof(unsigned int)];
+};
+
+volatile unsigned int received[sizeof(ROUTES) / sizeof(ROUTES[0])];
+Time_Stamp first[sizeof(ROUTES) / sizeof(ROUTES[0])];
+Time_Stamp last[sizeof(ROUTES) / sizeof(ROUTES[0])];
+
+
+unsigned long long us(const Time_Stamp & ts) { return Convert::count2us<Hertz, Time_Stamp, unsigned long long>(TSC::frequency(), ts); }
+
+IP::Address neighbor(const IP::Address & a, int distance) { IP::Address n = a; n[3] += distance; return n; }
+
+// Nested prefixes, each through a gateway of its own (never used to forward anything), and where addresses must go
+struct Prefix { unsigned long destination; unsigned long mask; unsigned long gateway; };
+const Prefix NESTED[] = {
+    { 0x0a800000, 0xff800000, 0x0a0001c9 }, // 10.128.0.0/9 via 10.0.1.201
+    { 0x0ac00000, 0xffc00000, 0x0a0001ca }, // 10.192.0.0/10 via 10.0.1.202
+    { 0x0ac80000, 0xffff0000, 0x0a0001cb }, // 10.200.0.0/16 via 10.0.1.203
+    { 0x0ac80709, 0xffffffff, 0x0a0001cc }  // 10.200.7.9/32 via 10.0.1.204
+};
+struct Lookup { unsigned long address; int prefix; }; // index in NESTED, -1 for no route
+const Lookup LOOKUP[] = {
+    { 0x0a820001, 0 },  // 10.130.0.1
+    { 0x0ac30101, 1 },  // 10.195.1.1
+    { 0x0ac80303, 2 },  // 10.200.3.3
+    { 0x0ac80709, 3 },  // 10.200.7.9
+    { 0x0ac8070a, 2 },  // 10.200.7.10
+    { 0x0a010000, -1 }  // 10.1.0.0
+};
+
+bool longest_match()
+{
+    for(unsigned int i = 0; i < sizeof(LOOKUP) / sizeof(LOOKUP[0]); i++) {
+        IP::Route * route = IP::route(IP::Address(LOOKUP[i].address));
+        if(LOOKUP[i].prefix < 0 ? (route != 0) : (!route || (route->gateway() != IP::Address(NESTED[LOOKUP[i].prefix].gateway)))) {
+            cout << "Lookup of " << IP::Address(LOOKUP[i].address) << " missed its longest match!" << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void source(IP * ip)
+{
+    IP::Address gateway = neighbor(ip->address(), 1);
+    IP::Address sink = neighbor(ip->address(), 2);
+
+    ip->router()->insert(ip->nic(), ip, ip->arp(), sink, gateway, IP::Address(0xffffffff)); // the longest prefix, so it beats the segment's
+
+    Link<UDP> com(UDP::Address(ip->address(), PORT), UDP::Address(sink, PORT));
+    Message msg;
+    memset(&msg, 0, sizeof(Message));
+
+    msg.round = WARM_UP;
+    for(unsigned int i = 0; i < 3; i++) {
+        com.send(&msg, sizeof(Message));
+        Alarm::delay(100000);
+    }
+
+    for(unsigned int round = 0; round < sizeof(ROUTES) / sizeof(ROUTES[0]); round++) {
+        Alarm::delay(SETTLE);
+
+        msg.round = round;
+        unsigned int sent = 0;
+        for(msg.sequence = 0; msg.sequence < COUNT; msg.sequence++)
+            if(com.send(&msg, sizeof(Message)) > 0)
+                sent++;
+
+        cout << "Round " << round << " (routes=" << ROUTES[round] << "): sent " << sent << " datagrams" << endl;
+        Alarm::delay(ROUND - SETTLE);
+    }
+}
+
+void gateway(IP * ip)
+{
+    for(unsigned int i = 0; i < sizeof(NESTED) / sizeof(NESTED[0]); i++)
+        ip->router()->insert(ip->nic(), ip, ip->arp(), IP::Address(NESTED[i].destination), IP::Address(NESTED[i].gateway), IP::Address(NESTED[i].mask));
+
+    unsigned int routes = 0;
+    for(unsigned int round = 0; round < sizeof(ROUTES) / sizeof(ROUTES[0]); round++) {
+        Time_Stamp start = TSC::time_stamp();
+
+        for(; routes < ROUTES[round]; routes++) {
+            unsigned int length = 8 + Random::random() % 25;
+            unsigned long mask = ~0UL << (32 - length);
+            unsigned long prefix = ((11 + Random::random() % 213) << 24 | (Random::random() & 0xffffff)) & mask; // 11.x.x.x to 223.x.x.x
+            ip->router()->insert(ip->nic(), ip, ip->arp(), IP::Address(prefix), ip->address(), IP::Address(mask));
+        }
+
+        unsigned int found = 0;
+        Time_Stamp t0 = TSC::time_stamp();
+        for(unsigned int i = 0; i < LOOKUPS; i++)
+            found += (IP::route(IP::Address(Random::random())) != 0);
+        Time_Stamp t1 = TSC::time_stamp();
+
+        unsigned long long t = us(t1 - t0);
+        cout << "BENCH,route_lookup_" << routes << "," << LOOKUPS << "," << t << "," << t * 1000 / LOOKUPS << endl;
+        cout << "Round " << round << ": " << found << " lookups matched a route" << endl;
+        if(!longest_match())
+            cout << "FAIL,route_lookup_" << routes << endl;
+
+        unsigned long long elapsed = us(TSC::time_stamp() - start);
+        if(elapsed < ROUND)
+            Alarm::delay(ROUND - elapsed);
+    }
+}
+
+int receiver(IP * ip)
+{
+    Link<UDP> com(UDP::Address(ip->address(), PORT), UDP::Address(neighbor(ip->address(), -2), PORT));
+    Message msg;
+
+    while(true) {
+        if(com.receive(&msg, sizeof(Message)) <= 0)
+            continue;
+        if(msg.round >= sizeof(ROUTES) / sizeof(ROUTES[0]))
+            continue;
+
+        Time_Stamp now = TSC::time_stamp();
+        if(!received[msg.round])
+            first[msg.round] = now;
+        last[msg.round] = now;
+        received[msg.round]++;
+    }
+
+    return 0;
+}
+
+void sink(IP * ip)
+{
+    new Thread(&receiver, ip);
+
+    for(unsigned int round = 0; round < sizeof(ROUTES) / sizeof(ROUTES[0]); round++) {
+        Alarm::delay(ROUND);
+
+        unsigned int n = received[round];
+        unsigned long long t = n ? us(last[round] - first[round]) : 0;
+        cout << "BENCH,ip_forward_" << ROUTES[round] << "," << n << "," << t << "," << (t ? n * 1000000ULL / t : 0) << endl;
+        if(!n)
+            cout << "FAIL,ip_forward_" << ROUTES[round] << endl;
+    }
+}
+
+int main()
+{
+    IP * ip = IP::get_by_nic(0);
+
+    cout << "IP Forwarding Benchmark" << endl;
+    cout << "  IP: " << ip->address() << endl;
+    cout << "  Datagrams: " << COUNT << " x " << SIZE << " bytes, lookups: " << LOOKUPS << endl;
+
+    Alarm::delay(1000000); // let all nodes boot
+
+    switch(ip->address()[3] % 3) {
+    case 1: source(ip); break;
+    case 2: gateway(ip); break;
+    default: sink(ip);
+    }
+
+    Ethernet::Statistics stat = ip->nic()->statistics();
+    cout << "Statistics\n"
+         << "Tx Packets: " << stat.tx_packets << "\n"
+         << "Tx Bytes:   " << stat.tx_bytes << "\n"
+         << "Rx Packets: " << stat.rx_packets << "\n"
+         << "Rx Bytes:   " << stat.rx_bytes << endl;
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
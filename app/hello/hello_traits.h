@@ -50,6 +50,8 @@ template<> struct Traits<Spin>: public Traits<Build>
 template<> struct Traits<Heaps>: public Traits<Build>
 {
     static const bool debugged = hysterically_debugged;
+    static const bool instrumented = false;             // usage counters, largest free block and fragmentation (see Clerk<System> HEAP_* events)
+    static const unsigned int ALLOCATION_SITES = 0;     // entries in the allocation-site histogram of instrumented heaps (0 => disabled)
 };
 
 template<> struct Traits<Ciphers>: public Traits<Build>
@@ -132,6 +134,13 @@ template<> struct Traits<Thread>: public Traits<Build>
     static const bool smp = Traits<System>::multicore;
     static const bool simulate_capacity = false;
     static const bool trace_idle = hysterically_debugged;
+    static const bool demand_paged_stacks = Traits<System>::multitask; // user-level stacks get a frame per page on first touch, lowest page is a guard
+    static const bool stack_watermark = false; // paint system-level stacks to report their high-water marks on deletion
+    static const bool pmu_virtualized = false; // count PMU_EVENTS per thread, saving and restoring them at context switches (requires monitored)
+
+    static constexpr PMU_Event PMU_EVENTS[] = {COMMITED_INSTRUCTIONS, CPU_CYCLES, LAST_LEVEL_CACHE_MISSES};
+
+    static const unsigned int JOB_RECORDS = 8; // per periodic thread (release, start, completion and lateness of the latest jobs)
 
     typedef Scheduling_Criteria::PRM Criterion;
     static const unsigned int QUANTUM = 10000; // us
@@ -208,6 +217,12 @@ template<> struct Traits<IP>: public Traits<Network>
 
     static const unsigned int TTL  = 0x40; // Time-to-live
 
+    static const unsigned int REASSEMBLIES = 8; // datagrams being reassembled at once
+    static const unsigned int REASSEMBLIES_PER_SOURCE = 4; // out of REASSEMBLIES
+
+    static const bool forwarding = false; // of datagrams to other hosts, along the routing table
+    static const bool arp_learning = false; // ARP mappings created from incoming datagrams' senders, on trusted links only
+
     static const bool enabled = Traits<Network>::enabled && (NETWORKS::Count<IP>::Result > 0);
 };
 
@@ -229,6 +244,16 @@ template<> struct Traits<Monitor>: public Traits<Build>
 {
     static const bool enabled = monitored;
 
+    static const bool streaming = false;                          // export captures continuously instead of at the end of the run (see Monitor::flush())
+    static const unsigned int STREAM_BUFFER = 256;                // captures per ring half per CPU
+    static const unsigned int STREAM_PERIOD = 100000;             // us between exports
+    static const unsigned int STREAM_UART = 1;                    // UART unit used when STREAM_UDP_ADDRESS == 0
+    static const unsigned long STREAM_UDP_ADDRESS = 0;            // IP address of the collector (e.g. 0x0a000001 for 10.0.0.1)
+    static const unsigned short STREAM_UDP_PORT = 5050;
+
+    static const bool statistics = true;                          // Welford mean/variance, EWMA, min/max and P2 p50/p99 per monitor
+    static const unsigned int EWMA_SHIFT = 3;                     // EWMA alpha = 1 / 2^EWMA_SHIFT
+
     static constexpr System_Event SYSTEM_EVENTS[]                 = {ELAPSED_TIME, DEADLINE_MISSES, CPU_EXECUTION_TIME, THREAD_EXECUTION_TIME, RUNNING_THREAD};
     static constexpr unsigned int SYSTEM_EVENTS_FREQUENCIES[]     = {           1,               1,                  1,                     1,              1}; // in Hz
 
@@ -239,6 +264,32 @@ template<> struct Traits<Monitor>: public Traits<Build>
     static constexpr unsigned int TRANSDUCER_EVENTS_FREQUENCIES[] = {          1,           1}; // in Hz
 };
 
+template<> struct Traits<Profiler>: public Traits<Build>
+{
+    static const bool enabled = false;
+    static const unsigned int SAMPLES = 1024; // per CPU
+};
+
+template<> struct Traits<Tracer>: public Traits<Build>
+{
+    static const bool enabled = false;
+    static const unsigned int EVENTS = 4096; // per CPU, a power of 2
+};
+
+template<> struct Traits<Latency>: public Traits<Build>
+{
+    static const bool enabled = false;
+    static const unsigned int SITES = 16; // distinct lock() call sites tracked per section per CPU
+};
+
+template<> struct Traits<Governor>: public Traits<Build>
+{
+    static const bool enabled = false;
+    static const bool deep_idle = true;     // idle CPUs drop to the lowest level and use CPU::deep_halt()
+    static const unsigned int STEPS = 8;    // frequency levels, CPU::clock() * i / STEPS
+    static const unsigned int MINIMUM = 25; // lowest frequency, in % of CPU::clock()
+};
+
 __END_SYS
 
 #endif
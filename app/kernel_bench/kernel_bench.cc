@@ -0,0 +1,325 @@
+// EPOS Kernel Primitive Benchmark
+//
+// Measures kernel primitives in TSC cycles. Each benchmark runs WARMUP untimed iterations
+// followed by REPETITIONS timed ones and prints a single machine-readable line:
+//
+//     BENCH,<name>,<samples>,<min>,<median>,<p99>,<max>
+//
+// Benchmarks that cannot run in the current configuration print "SKIP,<name>,<reason>" instead,
+// so that the output of two builds can be compared line by line (e.g. grep ^BENCH | sort).
+
+#include <utility/ostream.h>
+#include <architecture.h>
+#include <machine.h>
+#include <time.h>
+#include <process.h>
+#include <synchronizer.h>
+
+using namespace EPOS;
+
+typedef TSC::Time_Stamp Time_Stamp;
+
+const unsigned int WARMUP = 100;
+const unsigned int REPETITIONS = 1000;
+const unsigned int ITERATIONS = WARMUP + REPETITIONS;
+const int PERIOD = 100000; // us, only used to pin helper threads through the partitioned criterion
+
+OStream cout;
+
+Time_Stamp samples[REPETITIONS];
+Time_Stamp extra_samples[REPETITIONS];
+
+volatile Time_Stamp stamp;
+volatile unsigned int turn;
+volatile unsigned int acks;
+IC::Interrupt_Handler rescheduler;
+
+
+// Shell sort, so that reporting does not depend on the heap being benchmarked
+void sort(Time_Stamp * v, unsigned int n)
+{
+    for(unsigned int gap = n / 2; gap > 0; gap /= 2)
+        for(unsigned int i = gap; i < n; i++) {
+            Time_Stamp tmp = v[i];
+            unsigned int j = i;
+            for(; (j >= gap) && (v[j - gap] > tmp); j -= gap)
+                v[j] = v[j - gap];
+            v[j] = tmp;
+        }
+}
+
+void report(const char * name, Time_Stamp * v = samples, unsigned int n = REPETITIONS)
+{
+    sort(v, n);
+    cout << "BENCH," << name << "," << n << "," << v[0] << "," << v[n / 2] << "," << v[(n * 99) / 100] << "," << v[n - 1] << endl;
+}
+
+void skip(const char * name, const char * reason)
+{
+    cout << "SKIP," << name << "," << reason << endl;
+}
+
+Thread::Configuration on(unsigned int cpu)
+{
+    return Thread::Configuration(Thread::READY, Thread::Criterion(PERIOD, PERIOD, 0, cpu));
+}
+
+template<typename Operation>
+void bench(const char * name, Operation operation)
+{
+    for(unsigned int i = 0; i < WARMUP; i++)
+        operation();
+
+    for(unsigned int i = 0; i < REPETITIONS; i++) {
+        Time_Stamp t0 = TSC::time_stamp();
+        operation();
+        samples[i] = TSC::time_stamp() - t0;
+    }
+
+    report(name);
+}
+
+
+// Context switch: two threads of the same priority on the same CPU hand the CPU over to each other
+// through yield(). Each sample spans from the yield in one thread to the return from yield in the other.
+int switcher(Time_Stamp * v)
+{
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        stamp = TSC::time_stamp();
+        Thread::yield();
+        Time_Stamp t = TSC::time_stamp() - stamp;
+        if(i >= WARMUP)
+            v[i - WARMUP] = t;
+    }
+    return 0;
+}
+
+void context_switch()
+{
+    Thread * a = new Thread(on(0), &switcher, samples);
+    Thread * b = new Thread(on(0), &switcher, extra_samples);
+    a->join();
+    b->join();
+    delete a;
+    delete b;
+
+    report("context_switch_same_task");
+}
+
+
+// Semaphore ping pong: main wakes up a partner blocked on "ping" and blocks on "pong" until the partner
+// wakes it up again. Each sample is a round trip with two wake ups and two context switches.
+int ponger(Semaphore * ping, Semaphore * pong)
+{
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        ping->p();
+        pong->v();
+    }
+    return 0;
+}
+
+void semaphore_ping_pong(const char * name, unsigned int cpu)
+{
+    Semaphore ping(0);
+    Semaphore pong(0);
+    Thread * partner = new Thread(on(cpu), &ponger, &ping, &pong);
+
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        Time_Stamp t0 = TSC::time_stamp();
+        ping.v();
+        pong.p();
+        if(i >= WARMUP)
+            samples[i - WARMUP] = TSC::time_stamp() - t0;
+    }
+
+    partner->join();
+    delete partner;
+    report(name);
+}
+
+
+// Uncontended semaphore whose state was last written by another core, so each p() starts with a cache miss
+int bouncer(Semaphore * semaphore)
+{
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        while(turn != 1);
+        semaphore->p();
+        semaphore->v();
+        turn = 0;
+    }
+    return 0;
+}
+
+void semaphore_bounced()
+{
+    Semaphore semaphore;
+    turn = 0;
+    Thread * partner = new Thread(on(1), &bouncer, &semaphore);
+
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        while(turn != 0);
+        Time_Stamp t0 = TSC::time_stamp();
+        semaphore.p();
+        semaphore.v();
+        Time_Stamp t = TSC::time_stamp() - t0;
+        if(i >= WARMUP)
+            samples[i - WARMUP] = t;
+        turn = 1;
+    }
+
+    partner->join();
+    delete partner;
+    report("semaphore_pv_uncontended_cross_core");
+}
+
+
+// IPI round trip: CPU 0 interrupts CPU 1, which answers with an IPI back. The kernel's own rescheduler
+// still runs on both ends, so the measured path is the one taken by remote wake ups.
+void ipi_handler(IC::Interrupt_Id i)
+{
+    if(CPU::id() == 0)
+        acks++;
+    else
+        IC::ipi(0, IC::INT_RESCHEDULER);
+    rescheduler(i);
+}
+
+void ipi_round_trip()
+{
+    rescheduler = IC::int_vector(IC::INT_RESCHEDULER);
+    IC::int_vector(IC::INT_RESCHEDULER, &ipi_handler);
+
+    bench("ipi_round_trip", []() {
+        unsigned int expected = acks + 1;
+        IC::ipi(1, IC::INT_RESCHEDULER);
+        while(acks != expected);
+    });
+
+    IC::int_vector(IC::INT_RESCHEDULER, rescheduler);
+}
+
+
+// Alarm arm and cancel are measured separately on the same object
+void handler() {}
+
+void alarm_arm_cancel()
+{
+    Function_Handler function(&handler);
+    char buffer[sizeof(Alarm)];
+
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        Time_Stamp t0 = TSC::time_stamp();
+        Alarm * alarm = new (buffer) Alarm(1000000, &function);
+        Time_Stamp t1 = TSC::time_stamp();
+        alarm->~Alarm();
+        Time_Stamp t2 = TSC::time_stamp();
+        if(i >= WARMUP) {
+            samples[i - WARMUP] = t1 - t0;
+            extra_samples[i - WARMUP] = t2 - t1;
+        }
+    }
+
+    report("alarm_arm");
+    report("alarm_cancel", extra_samples);
+}
+
+
+// Heap and frame allocators, alloc and free measured separately
+void heap_alloc_free()
+{
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        Time_Stamp t0 = TSC::time_stamp();
+        char * p = new char[64];
+        Time_Stamp t1 = TSC::time_stamp();
+        delete [] p;
+        Time_Stamp t2 = TSC::time_stamp();
+        if(i >= WARMUP) {
+            samples[i - WARMUP] = t1 - t0;
+            extra_samples[i - WARMUP] = t2 - t1;
+        }
+    }
+
+    report("heap_alloc");
+    report("heap_free", extra_samples);
+}
+
+void mmu_alloc_free()
+{
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        Time_Stamp t0 = TSC::time_stamp();
+        CPU::Phy_Addr frame = MMU::alloc(1);
+        Time_Stamp t1 = TSC::time_stamp();
+        MMU::free(frame, 1);
+        Time_Stamp t2 = TSC::time_stamp();
+        if(i >= WARMUP) {
+            samples[i - WARMUP] = t1 - t0;
+            extra_samples[i - WARMUP] = t2 - t1;
+        }
+    }
+
+    report("mmu_alloc");
+    report("mmu_free", extra_samples);
+}
+
+
+// Uncontended p/v pairs of each real-time locking protocol
+void rt_protocols()
+{
+    Thread * tasks[] = { Thread::self() };
+    int levels[] = { 1 };
+
+    Semaphore_PIP pip;
+    bench("pip_pv", [&]() { pip.p(); pip.v(); });
+
+    Semaphore_IPCP ipcp(0);
+    bench("ipcp_pv", [&]() { ipcp.p(); ipcp.v(); });
+
+    Semaphore_PCP pcp(0);
+    bench("pcp_pv", [&]() { pcp.p(); pcp.v(); });
+
+    Semaphore_MPCP<true> mpcp(0);
+    bench("mpcp_pv", [&]() { mpcp.p(); mpcp.v(); });
+
+    Semaphore_SRP<true> srp(tasks, levels, 1);
+    bench("srp_pv", [&]() { srp.p(); srp.v(); });
+
+    Semaphore_MSRP msrp(tasks, levels, 1);
+    bench("msrp_pv", [&]() { msrp.p(); msrp.v(); });
+}
+
+
+int main()
+{
+    cout << "Kernel primitive benchmark (TSC cycles, " << WARMUP << " warm-up + " << REPETITIONS << " repetitions)" << endl;
+    cout << "# name,samples,min,median,p99,max" << endl;
+
+    bench("tsc_overhead", []() {});
+
+    bench("thread_yield", []() { Thread::yield(); });
+    context_switch();
+    skip("context_switch_cross_task", "single task in LIBRARY mode");
+
+    Semaphore semaphore;
+    bench("semaphore_pv_uncontended", [&]() { semaphore.p(); semaphore.v(); });
+    semaphore_ping_pong("semaphore_ping_pong_local", 0);
+
+    if(CPU::cores() > 1) {
+        semaphore_bounced();
+        semaphore_ping_pong("semaphore_ping_pong_cross_core", 1);
+        ipi_round_trip();
+    } else {
+        skip("semaphore_pv_uncontended_cross_core", "single core");
+        skip("semaphore_ping_pong_cross_core", "single core");
+        skip("ipi_round_trip", "single core");
+    }
+
+    rt_protocols();
+
+    alarm_arm_cancel();
+    heap_alloc_free();
+    mmu_alloc_free();
+
+    cout << "Done!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+// EPOS TCP Throughput Benchmark
+//
+// Two nodes (as in ip_test, the one with an odd address sends and its predecessor receives) transfer TRANSFER bytes
+// over a TCP connection per round. Each round drops a growing share of the incoming segments on both nodes
+// (i.e. data at the receiver and ACKs at the sender) with TCP::loss(), exercising fast retransmit, SACK and the
+// retransmission timer. The sender prints a single machine-readable line per round:
+//
+//     BENCH,tcp_loss_<per_mille>,<bytes>,<us>,<KB/s>
+//
+// The receiver checks the stream's contents and reports any mismatch or short transfer as "FAIL,tcp_loss_<per_mille>".
+
+#include <utility/ostream.h>
+#include <architecture.h>
+#include <machine.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+typedef TSC::Time_Stamp Time_Stamp;
+
+const unsigned int TRANSFER = 512 * 1024;
+const unsigned int CHUNK = 16 * 1024; // bytes per write()
+const unsigned int LOSSES[] = { 0, 5, 10, 20, 50 }; // per mille
+const unsigned short PORT = 8000;
+
+OStream cout;
+
+unsigned char data[CHUNK];
+
+
+unsigned char pattern(unsigned int offset) { return offset % 251; } // a prime, so chunks do not repeat the same bytes
+
+unsigned long long us(const Time_Stamp & ts) { return Convert::count2us<Hertz, Time_Stamp, unsigned long long>(TSC::frequency(), ts); }
+
+void send(const IP::Address & peer, unsigned int round)
+{
+    Alarm::delay(1000000); // let the receiver listen
+
+    Link<TCP> com(TCP::Address(IP::get_by_nic(0)->address(), PORT + round), TCP::Address(peer, PORT + round)); // connect
+    TCP::loss(LOSSES[round]);
+
+    unsigned int sent = 0;
+    Time_Stamp t0 = TSC::time_stamp();
+    while(sent < TRANSFER) {
+        unsigned int size = (TRANSFER - sent < CHUNK) ? TRANSFER - sent : CHUNK;
+        for(unsigned int i = 0; i < size; i++)
+            data[i] = pattern(sent + i);
+
+        int n = com.write(data, size);
+        if(n != int(size))
+            break;
+        sent += size;
+    }
+    Time_Stamp t1 = TSC::time_stamp();
+
+    TCP::loss(0); // let the connection close cleanly
+
+    unsigned long long t = us(t1 - t0);
+    cout << "BENCH,tcp_loss_" << LOSSES[round] << "," << sent << "," << t << "," << (t ? sent * 1000000ULL / 1024 / t : 0) << endl;
+    if(sent != TRANSFER)
+        cout << "FAIL,tcp_loss_" << LOSSES[round] << endl;
+}
+
+void receive(unsigned int round)
+{
+    Link<TCP> com(TCP::Address(IP::get_by_nic(0)->address(), PORT + round)); // listen
+    TCP::loss(LOSSES[round]);
+
+    unsigned int received = 0;
+    bool ok = true;
+    while(received < TRANSFER) {
+        int n = com.read(data, sizeof(data));
+        if(n <= 0)
+            break;
+        for(int i = 0; i < n; i++)
+            ok &= (data[i] == pattern(received + i));
+        received += n;
+    }
+
+    TCP::loss(0);
+
+    cout << "Round " << round << " (loss=" << LOSSES[round] << "/1000): received " << received << " bytes" << endl;
+    if(!ok || (received != TRANSFER))
+        cout << "FAIL,tcp_loss_" << LOSSES[round] << endl;
+}
+
+int main()
+{
+    IP * ip = IP::get_by_nic(0);
+
+    cout << "TCP Throughput Benchmark" << endl;
+    cout << "  IP: " << ip->address() << endl;
+    cout << "  MSS: " << TCP::MSS << ", window: " << TCP::WINDOW << ", transfer: " << TRANSFER << endl;
+
+    for(unsigned int round = 0; round < sizeof(LOSSES) / sizeof(LOSSES[0]); round++) {
+        if(ip->address()[3] % 2) { // sender
+            IP::Address peer = ip->address();
+            peer[3]--;
+            send(peer, round);
+        } else // receiver
+            receive(round);
+    }
+
+    Ethernet::Statistics stat = ip->nic()->statistics();
+    cout << "Statistics\n"
+         << "Tx Packets: " << stat.tx_packets << "\n"
+         << "Tx Bytes:   " << stat.tx_bytes << "\n"
+         << "Rx Packets: " << stat.rx_packets << "\n"
+         << "Rx Bytes:   " << stat.rx_bytes << endl;
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
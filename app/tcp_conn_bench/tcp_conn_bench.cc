@@ -0,0 +1,117 @@
+// EPOS TCP Concurrent Connections Benchmark
+//
+// Two nodes (as in ip_test, the one with an odd address is the client and its predecessor the server) open a growing
+// number of TCP connections, all of which stay open, so every incoming segment is demultiplexed among all of them and
+// each one keeps its timers in the shared wheel. Per round, the client writes MESSAGES small messages round-robin over
+// the open connections, each write returning once it was acknowledged, while the server reads them in the same order.
+// The client prints a single machine-readable line per round:
+//
+//     BENCH,tcp_conns_<connections>,<messages>,<us>,<us per message>
+//
+// The server checks the messages' contents and reports any mismatch or short read as "FAIL,tcp_conns_<connections>".
+
+#include <utility/ostream.h>
+#include <architecture.h>
+#include <machine.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+typedef TSC::Time_Stamp Time_Stamp;
+
+const unsigned int CONNECTIONS[] = { 1, 64, 512 }; // open during each round, cumulative
+const unsigned int MAX_CONNECTIONS = 512;
+const unsigned int MESSAGES = 2048; // per round
+const unsigned int SIZE = 64; // bytes per message
+const unsigned short PORT = 8000; // the server's, all connections are accepted on it
+const unsigned short CLIENT_PORT = 10000; // the client's first, one per connection
+
+OStream cout;
+
+Link<TCP> * links[MAX_CONNECTIONS];
+unsigned int opened = 0;
+
+unsigned char data[SIZE];
+
+
+unsigned char pattern(unsigned int message, unsigned int offset) { return (message * 7 + offset) % 251; }
+
+unsigned long long us(const Time_Stamp & ts) { return Convert::count2us<Hertz, Time_Stamp, unsigned long long>(TSC::frequency(), ts); }
+
+void client(const IP::Address & peer, unsigned int round)
+{
+    IP::Address me = IP::get_by_nic(0)->address();
+
+    for(; opened < CONNECTIONS[round]; opened++) {
+        Alarm::delay(20000); // let the server listen again
+        links[opened] = new Link<TCP>(TCP::Address(me, CLIENT_PORT + opened), TCP::Address(peer, PORT)); // connect
+    }
+
+    unsigned int sent = 0;
+    Time_Stamp t0 = TSC::time_stamp();
+    for(; sent < MESSAGES; sent++) {
+        for(unsigned int i = 0; i < SIZE; i++)
+            data[i] = pattern(sent, i);
+
+        if(links[sent % opened]->write(data, SIZE) != int(SIZE))
+            break;
+    }
+    Time_Stamp t1 = TSC::time_stamp();
+
+    unsigned long long t = us(t1 - t0);
+    cout << "BENCH,tcp_conns_" << opened << "," << sent << "," << t << "," << (sent ? t / sent : 0) << endl;
+    if(sent != MESSAGES)
+        cout << "FAIL,tcp_conns_" << opened << endl;
+}
+
+void server(unsigned int round)
+{
+    IP::Address me = IP::get_by_nic(0)->address();
+
+    for(; opened < CONNECTIONS[round]; opened++)
+        links[opened] = new Link<TCP>(TCP::Address(me, PORT)); // listen, a new listener for each connection
+
+    unsigned int received = 0;
+    bool ok = true;
+    for(; received < MESSAGES; received++) {
+        if(links[received % opened]->read(data, SIZE) != int(SIZE))
+            break;
+        for(unsigned int i = 0; i < SIZE; i++)
+            ok &= (data[i] == pattern(received, i));
+    }
+
+    cout << "Round " << round << " (connections=" << opened << "): received " << received << " messages" << endl;
+    if(!ok || (received != MESSAGES))
+        cout << "FAIL,tcp_conns_" << opened << endl;
+}
+
+int main()
+{
+    IP * ip = IP::get_by_nic(0);
+
+    cout << "TCP Concurrent Connections Benchmark" << endl;
+    cout << "  IP: " << ip->address() << endl;
+    cout << "  Buckets: " << TCP::BUCKETS << ", timer wheel: " << TCP::SLOTS << " x " << TCP::TICK << " us, messages: " << MESSAGES << " x " << SIZE << " bytes" << endl;
+
+    Alarm::delay(1000000); // let both nodes boot
+
+    for(unsigned int round = 0; round < sizeof(CONNECTIONS) / sizeof(CONNECTIONS[0]); round++) {
+        if(ip->address()[3] % 2) { // client
+            IP::Address peer = ip->address();
+            peer[3]--;
+            client(peer, round);
+        } else // server
+            server(round);
+    }
+
+    Ethernet::Statistics stat = ip->nic()->statistics();
+    cout << "Statistics\n"
+         << "Tx Packets: " << stat.tx_packets << "\n"
+         << "Tx Bytes:   " << stat.tx_bytes << "\n"
+         << "Rx Packets: " << stat.rx_packets << "\n"
+         << "Rx Bytes:   " << stat.rx_bytes << endl;
+
+    cout << "The end!" << endl;
+
+    return 0; // connections are left open, closing hundreds of them would only time TIME-WAIT
+}
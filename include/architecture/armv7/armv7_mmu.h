@@ -44,6 +44,9 @@ public:
         unsigned int size() const { return _bytes; }
         Phy_Addr phy_address() const { return _phy_addr; } // always CT
         int resize(unsigned int amount) { return 0; } // no resize in CT
+        Log_Addr log_address(unsigned int offset) const { return Log_Addr(_phy_addr) + offset; } // always mapped
+        bool populate(unsigned int offset) { return false; } // no demand paging in CT
+        unsigned int resident() const { return _bytes; }
 
     private:
         Phy_Addr _phy_addr;
@@ -13,6 +13,7 @@ template<> struct Traits<CPU>: public Traits<Build>
     static const unsigned int WORD_SIZE         = 32;
     static const unsigned int CLOCK             = Traits<Build>::MODEL == Traits<Build>::LM3S811 ? 50000000 : Traits<Build>::MODEL == Traits<Build>::Zynq ? 666666687 : 32000000;
     static const bool unaligned_memory_access   = false;
+    static const unsigned int CACHE_LINE_SIZE   = 32; // bytes, the unit of coherence (see Per_CPU)
 };
 
 template<> struct Traits<MMU>: public Traits<Build>
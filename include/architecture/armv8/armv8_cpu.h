@@ -115,6 +115,7 @@ public:
     using Base::cas;
 
     using Base::halt;
+    static void deep_halt() { ASM("dsb sy"); halt(); } // deeper states are reached through Machine::power()
 
     static void switch_context(Context ** o, Context * n) __attribute__ ((naked));
 
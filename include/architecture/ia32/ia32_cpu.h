@@ -95,7 +95,8 @@ public:
 
     // CR4 Flags
     enum {
-        CR4_PSE     = 1 << 8    // CR4 Performance Counter Enable
+        CR4_PSE     = 1 << 8,   // CR4 Performance Counter Enable
+        CR4_PGE     = 1 << 7    // Page Global Enable   (1->global pages survive CR3 reloads)
     };
 
     // Segment Flags
@@ -360,6 +361,15 @@ public:
 
     static void halt() { ASM("hlt"); }
 
+    // Halts in the C-state hinted by Traits<CPU>::MWAIT_HINT through MONITOR/MWAIT, if enabled, otherwise as halt()
+    static void deep_halt() {
+        if(Traits<CPU>::mwait) {
+            ASM("monitor" : : "a"(&_cpu_clock), "c"(0), "d"(0));
+            ASM("mwait" : : "a"(Traits<CPU>::MWAIT_HINT), "c"(0));
+        } else
+            halt();
+    }
+
     static void switch_context(Context * volatile * o, Context * volatile n);
 
     static void syscall(void * message);
@@ -43,6 +43,7 @@ public:
             IO   = 0x800, // User Def. (0=memory, 1=I/O)
             APP  = (PRE | RW  | ACC | USR),
             SYS  = (PRE | RW  | ACC),
+            GSYS = (SYS | GLB),   // system pages mapped at the same address in every address space
             PCI  = (SYS | PCD | IO),
             APIC = (SYS | PCD),
             VGA  = (SYS | PCD),
@@ -133,15 +134,17 @@ public:
         Chunk() {}
 
         Chunk(unsigned int bytes, const Flags & flags, const Color & color = WHITE)
-        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)) {
+        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)), _demand(flags & Flags::DP) {
             if(flags & IA32_Flags::CT)
                 _pt->map_contiguous(_from, _to, _flags, color);
+            else if(_demand) // only the highest page is mapped upfront (e.g. the top of a stack), the others are mapped by populate()
+                _pt->map(_to - 1, _to, _flags, color);
             else
                 _pt->map(_from, _to, _flags, color);
         }
 
         Chunk(const Phy_Addr & phy_addr, unsigned int bytes, const Flags & flags)
-        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)) {
+        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)), _demand(false) {
             _pt->remap(phy_addr, _from, _to, flags);
         }
 
@@ -165,6 +168,42 @@ public:
             return (_flags & IA32_Flags::CT) ? Phy_Addr(indexes((*_pt)[_from])) : Phy_Addr(false);
         }
 
+        // Logical address of a mapped byte of the chunk as seen through the physical memory window (i.e. without attaching it)
+        Log_Addr log_address(unsigned int offset) const {
+            PT_Entry entry = (*static_cast<Page_Table *>(phy2log(_pt)))[_from + offset / sizeof(Page)];
+            return entry ? phy2log(indexes(entry)) + (offset & (sizeof(Page) - 1)) : Log_Addr(false);
+        }
+
+        // Map the page containing offset in a demand-paged chunk (the lowest page is a guard and is never mapped)
+        bool populate(unsigned int offset) {
+            unsigned int page = _from + offset / sizeof(Page);
+            if(!_demand || (page <= _from) || (page >= _to))
+                return false;
+
+            Page_Table * pt = static_cast<Page_Table *>(phy2log(_pt));
+            if((*pt)[page]) // already mapped (e.g. by another CPU sharing the address space)
+                return true;
+
+            Phy_Addr frame = alloc(1, colorful ? phy2color(_pt) : WHITE);
+            if(!frame)
+                return false;
+            _pt->remap(frame, page, page + 1, _flags);
+            return true;
+        }
+
+        // Bytes currently backed by frames (for a demand-paged stack, this is its high-water mark)
+        unsigned int resident() const {
+            if(!_demand)
+                return size();
+
+            Page_Table * pt = static_cast<Page_Table *>(phy2log(_pt));
+            unsigned int n = 0;
+            for(unsigned int i = _from; i < _to; i++)
+                if((*pt)[i])
+                    n++;
+            return n * sizeof(Page);
+        }
+
         int resize(unsigned int amount) {
             if(_flags & IA32_Flags::CT)
                 return 0;
@@ -195,6 +234,7 @@ public:
         unsigned int _pts;
         IA32_Flags _flags;
         Page_Table * _pt;
+        bool _demand;
     };
 
     // Page Directory
@@ -124,6 +124,13 @@ public:
         wrmsr(EVTSEL0 + channel, 0);
     }
 
+    // Make a configured channel raise a PMI after the next period (< 2^31) events; must be called again after each PMI
+    static void sample(const Channel & channel, const Count & period) {
+        db<PMU>(TRC) << "PMU::sample(c=" << channel << ",p=" << period << ")" << endl;
+        wrmsr(PMC_BASE_ADDR + channel, static_cast<Reg32>(-period)); // sign-extended to the counter's width
+        wrmsr(EVTSEL0 + channel, rdmsr(EVTSEL0 + channel) | INT);
+    }
+
 protected:
     static Reg64 rdmsr(Reg32 msr) { return CPU::rdmsr(msr); }
     static void wrmsr(Reg32 msr, Reg64 val) { CPU::wrmsr(msr, val); }
@@ -684,6 +691,20 @@ public:
         wrmsr(GLOBAL_OVF, (PMC_MASK & 1ULL << (channel - FIXED))); //clear OVF flag
     }
 
+    static void sample(const Channel & channel, const Count & period) {
+        assert(channel < CHANNELS);
+        db<PMU>(TRC) << "PMU::sample(c=" << channel << ",p=" << period << ")" << endl;
+        if(channel < FIXED) {
+            wrmsr(FIXED_CTR0 + channel, (-period) & ((1ULL << 48) - 1)); // fixed counters are 48 bits wide
+            wrmsr(FIXED_CTR_CTL, rdmsr(FIXED_CTR_CTL) | (FIXED_CTR0_PMI << (channel * 4)));
+            wrmsr(GLOBAL_OVF, 1ULL << (CRT0_OVERFLOW + channel));
+        } else {
+            wrmsr(PMC_BASE_ADDR + channel - FIXED, static_cast<Reg32>(-period)); // sign-extended to the counter's width
+            wrmsr(EVTSEL0 + channel - FIXED, rdmsr(EVTSEL0 + channel - FIXED) | INT);
+            wrmsr(GLOBAL_OVF, 1ULL << (PMC0_OVERFLOW + channel - FIXED));
+        }
+    }
+
     static void handler(Handler * handler, const Channel & channel) { 
         if((channel - FIXED) < CHANNELS)
             _handlers[channel - FIXED] = handler;
@@ -13,6 +13,9 @@ template<> struct Traits<CPU>: public Traits<Build>
     static const unsigned int WORD_SIZE         = 32;
     static const unsigned int CLOCK             = 2000000000;
     static const bool unaligned_memory_access   = true;
+    static const unsigned int CACHE_LINE_SIZE   = 64; // bytes, the unit of coherence (see Per_CPU)
+    static const bool mwait                     = false; // deep_halt() with MONITOR/MWAIT (not available in QEMU without -overcommit cpu-pm=on)
+    static const unsigned int MWAIT_HINT        = 0x10; // target C-state - 1 in bits 7:4 (0x10 => C2)
 };
 
 template<> struct Traits<TSC>: public Traits<Build>
@@ -44,6 +44,7 @@ public:
             CD  = 0x010, // Cache Disable (0=cacheable, 1=non-cacheable)
             CT  = 0x020, // Contiguous (0=non-contiguous, 1=contiguous)
             IO  = 0x040, // Memory Mapped I/O (0=memory, 1=I/O)
+            DP  = 0x080, // Demand Paging (0=mapped on creation, 1=mapped on first access, lowest page is a guard)
             SYS = (PRE | RW ),
             APP = (PRE | RW | USR)
         };
@@ -4,12 +4,14 @@
 #define __clerk_h
 
 #include <utility/convert.h>
+#include <utility/statistics.h>
 #include <architecture.h>
 #include <machine.h>
 #include <system.h>
 #include <time.h>
 #include <transducer.h>
 #include <process.h>
+#include <real-time.h>
 
 extern "C" { void __pre_main(); }
 
@@ -30,8 +32,31 @@ protected:
     static const unsigned int TIME_ACCEPTED_DRIFT = 2;            // ts difference between captures +/- 2 * frequency
     static const unsigned int MINIMUN_SNAPSHOTS_TO_VALIDATE = 20; // start verification if #SNAPSHOTS greater than this value
 
+    // Streaming export (captures go to per-CPU double-buffered rings drained by an exporter thread)
+    static const bool streaming = Traits<Monitor>::streaming;
+    static const unsigned int STREAM_BUFFER = streaming ? Traits<Monitor>::STREAM_BUFFER : 1;
+    static const unsigned int STREAM_FRAME = 512; // bytes, including the header, must fit in a UDP datagram
+    static const unsigned char STREAM_MAGIC = 0xe5;
+
+    // Online statistics (per monitor, in O(1) time and memory, see utility/statistics.h)
+    static const bool statistics = Traits<Monitor>::statistics;
+
+    struct Record {
+        unsigned int id;
+        Time_Stamp ts;
+        long long value;
+    };
+
+    struct Stream {
+        Simple_Spin lock;
+        volatile unsigned int active;
+        volatile unsigned int count[2];
+        volatile unsigned int dropped;
+        Record records[2][STREAM_BUFFER];
+    };
+
 public:
-    Monitor(): _captures(0), _t0(TSC::time_stamp()) {}
+    Monitor(): _id(0), _captures(0), _t0(TSC::time_stamp()) {}
     virtual ~Monitor() {}
 
     virtual void capture() = 0;
@@ -42,6 +67,10 @@ public:
 
     static void process_batch() {
         disable_captures();
+        if(streaming) { // whatever was captured after the exporter's last round
+            flush();
+            return;
+        }
         OStream os; // we are using OStream instead of db to avoid <CPU_ID> print in each line.
         db<Monitor>(TRC) << "Monitor::process_batch()" << endl;
         os << "FINAL_TS<" << count2us(_monitors[0].begin()->object()->time_since_t0()) << ">" << endl;
@@ -72,6 +101,9 @@ public:
             }
         }
         _enable = true;
+
+        if(streaming && !_exporter)
+            _exporter = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::LOW), &exporter);
     }
 
     static void disable_captures() { _enable = false; }
@@ -92,7 +124,24 @@ protected:
         return Convert::count2us<Hertz, Time_Stamp, Microsecond>(TSC::frequency(), t);
     }
 
+    // Append a capture to this CPU's ring (called by capture() with interrupts disabled)
+    static void stream(unsigned int id, const Time_Stamp & ts, long long value);
+
 private:
+    static int exporter();
+    static void flush();
+    static void send(const unsigned char * data, unsigned int size);
+
+    // LEB128 unsigned varint, at most 10 bytes
+    static unsigned int varint(unsigned char * out, unsigned long long v) {
+        unsigned int n = 0;
+        for(; v >= 0x80; v >>= 7)
+            out[n++] = static_cast<unsigned char>(v | 0x80);
+        out[n++] = static_cast<unsigned char>(v);
+        return n;
+    }
+    static unsigned long long zigzag(long long v) { return (static_cast<unsigned long long>(v) << 1) ^ static_cast<unsigned long long>(v >> 63); }
+
     template<unsigned int CHANNEL>
     static void init_system_monitoring();
 
@@ -102,12 +151,17 @@ private:
     static void init();
 
 protected:
+    unsigned int _id; // order of creation on its CPU, used to tag streamed records
     unsigned int _captures;
     Time_Stamp _t0;
 
+    static Per_CPU<Simple_List<Monitor>> _monitors; // also updated by Clerk_Monitor
+
 private:
     static volatile bool _enable;
-    static Simple_List<Monitor> _monitors[Traits<Build>::CPUS];
+    static Stream _streams[Traits<Build>::CPUS];
+    static Microsecond _last_export[Traits<Build>::CPUS];
+    static Thread * _exporter;
 };
 
 
@@ -129,13 +183,14 @@ public:
     };
 
 public:
-    Clerk_Monitor(Clerk * clerk, const Hertz & frequency, bool data_to_us = false): _clerk(clerk), _frequency(frequency), _period(us2count((frequency > 0) ? 1000000 / frequency : -1UL)), _last_capture(0), _average(0), _data_to_us(data_to_us), _link(this) {
+    Clerk_Monitor(Clerk * clerk, const Hertz & frequency, bool data_to_us = false): _clerk(clerk), _frequency(frequency), _period(us2count((frequency > 0) ? 1000000 / frequency : -1UL)), _last_capture(0), _invalid(0), _data_to_us(data_to_us), _link(this) {
         db<Monitor>(TRC) << "Clerk_Monitor(clerk=" << clerk << ") => " << this << ")" << endl;
-        _snapshots = Traits<Build>::EXPECTED_SIMULATION_TIME * frequency;
+        _snapshots = streaming ? 0 : Traits<Build>::EXPECTED_SIMULATION_TIME * frequency;
         // if((_snapshots * sizeof(Snapshot)) > Traits<Monitor>::MAX_BUFFER_SIZE)
         //     _snapshots = Traits<Monitor>::MAX_BUFFER_SIZE * sizeof(Snapshot);
-        _buffer = new (SYSTEM) Snapshot[_snapshots];
+        _buffer = streaming ? 0 : new (SYSTEM) Snapshot[_snapshots];
 
+        _id = _monitors[CPU::id()].size();
         _monitors[CPU::id()].insert(&_link);
     }
     ~Clerk_Monitor() {
@@ -149,12 +204,27 @@ public:
 
     void capture() {
         Time_Stamp ts = time_since_t0();
+        if(streaming) {
+            if((ts - _last_capture) >= _period) {
+                Snapshot s;
+                s.ts = ts;
+                s.data = _clerk->read();
+                screen(s);
+                long long value = to_value(s.data);
+                stream(_id, ts, value);
+                update(value);
+                _captures++;
+                _last_capture = ts;
+            }
+            return;
+        }
         if(_captures < _snapshots && ((ts - _last_capture) >= _period)) {
             _buffer[_captures].ts = ts;
             _buffer[_captures].data = _clerk->read();
             // a counter reset happens frequently depending on the selected feature and its capacity (32 or 64 bits)
             // is it worth a reset call to avoid such behavior?
-            _average = (_average * _captures + _buffer[_captures].data) / (_captures + 1);
+            screen(_buffer[_captures]);
+            update(to_value(_buffer[_captures].data));
             _captures++;
             _last_capture = ts;
         }
@@ -165,6 +235,8 @@ public:
     }
 
     void print(OStream & os) const {
+        if(streaming) // captures were already exported
+            return;
         if (_data_to_us) {
             for(unsigned int i = 0; i < _captures; i++)
                 os << count2us(_buffer[i].ts) << "," << count2us(_buffer[i].data) << endl;
@@ -174,77 +246,62 @@ public:
         }
     }
 
-    // Validate a snapshot against the collected time series
-    bool validate(const Snapshot & s) {
-        if(_captures > MINIMUN_SNAPSHOTS_TO_VALIDATE) {
-            // Statistic validation
-            // Drift is a deviation from a predicted value, a statistical error, that
-            // can be measured as standard deviation from the predicted values (v - predicted_v) ^ 2
-            // The statistical predictor has a default acceptable value that can be adjusted.
-            // If the prediction is the average, the accepted drift may be on 'x' times average...
-            // need to always update model (average is updated every capture)
-            // This detector is used on level.c, spectrum.c,
-
-            // First verification
-            // On a gateway scenario... anomaly detection by delay 'x' times bigger than average delay or expected delay
-            // this detector is used on loss.c
-
-            // Second verification
-
-            // Percentage of high (or low) values...
-            // if the buffer is filled up, check the number of SNAPSHOTS with value equal to the maximum or equal to 0
-            // if the number of repetitions of the max value is bigger than a quarter of the total number of elements
-            // there is an anomaly
-            // This detector is used on clip.c
-            // not implemented (not sure if this is a valid verification here), maybe set a base value (everything greater or lower would be an anomaly)
-            // at current event begin, if previous event not succeed, there is an anomaly
-            // this detector is used on processtrace.c
-            // not implemented (on gateway scenarios, would be great)
-            // using dynamic std_dev calc.
-            // Welford's algorithm computes the sample variance incrementally.
-            // https://stackoverflow.com/questions/5543651/computing-standard-deviation-in-a-stream
-            // for each of the captures:
-            // delta = cur_value - mean;
-            // mean += delta / SNAPSHOTS;
-            // M2 += delta * (cur_value - mean);
-            // var = M2 / SNAPSHOTS;
-            // std = squareRoot(var);
-            // with a pre-defined hard-limit and soft limit
-            // if curr_value out of (mean +/- std * (hard-limit or limit)): anomaly
-            // this detector is used on spike.c
-
-            // Third verification
-            // Voter.c analysis the amount of anomalies on a channel (here Clerk_Monitor)
-            // if this is greater than number of detectors / 5 (here, detectors are Clerks)
-
-            unsigned int drift;
-            unsigned int time_deviation;
-            unsigned int delta;
-            Data std;
-
-            // first verification
-            drift = (s.data - _average);
-            drift *= drift;
-            if(drift > AVERAGE_ACCEPTED_DRIFT * _average)
-                return false;
-
-            // second verification
-            if((s.ts - _period) < 0)
-                time_deviation = -1 * (s.ts - _period);
-            else
-                time_deviation = s.ts - _period;
-            if(time_deviation > TIME_ACCEPTED_DRIFT * _period)
-                return false;
-
-            // third verification
-            delta = s.data - _average;
-            std = delta*(_average-(delta/_captures));
-            std /= _captures;
-            std = squareRoot(std);
-            if((s.data > (_average + std * STD_DEV_ACCEPTED_DRIFT)) || (s.data < (_average - std * STD_DEV_ACCEPTED_DRIFT)))
-                return false;
+    // Statistics of the captured values (in us for time related clerks)
+    unsigned long samples() const { return _running.count(); }
+    long long min() const { return _running.min(); }
+    long long max() const { return _running.max(); }
+    long long mean() const { return _running.mean(); }
+    unsigned long long variance() const { return _running.variance(); }
+    long long std_dev() const { return _running.std_dev(); }
+    long long ewma() const { return _ewma.value(); }
+    long long p50() const { return _p50.value(); }
+    long long p99() const { return _p99.value(); }
+    unsigned int invalid() const { return _invalid; } // captures that failed validate() as they were taken
+
+    // Anomaly detectors applied to a snapshot against this monitor's history, all in O(1):
+    // level (drift from the EWMA), spike (beyond STD_DEV_ACCEPTED_DRIFT standard deviations),
+    // clip (beyond p99 by more than the p50-p99 spread) and timing (capture interval drift)
+    unsigned int anomalies(const Snapshot & s) const {
+        if(!statistics || (_running.count() <= MINIMUN_SNAPSHOTS_TO_VALIDATE))
+            return 0;
+
+        long long v = to_value(s.data);
+        unsigned int n = 0;
+
+        if(Math::abs(v - _ewma.value()) > AVERAGE_ACCEPTED_DRIFT * Math::abs(_ewma.value()))
+            n++;
+        if(Math::abs(v - _running.mean()) > STD_DEV_ACCEPTED_DRIFT * _running.std_dev())
+            n++;
+        if(v > _p99.value() + (_p99.value() - _p50.value()))
+            n++;
+        if(_captures && (s.ts > _last_capture)) { // no interval before the first capture (nor for older snapshots)
+            Time_Stamp interval = s.ts - _last_capture;
+            if((interval > _period) && (interval - _period > TIME_ACCEPTED_DRIFT * _period))
+                n++;
+        }
+
+        return n;
+    }
+
+    // A snapshot is valid if no detector flags it (the voter)
+    bool validate(const Snapshot & s) const { return !anomalies(s); }
+
+private:
+    long long to_value(const Data & data) const { return _data_to_us ? static_cast<long long>(count2us(data)) : static_cast<long long>(data); }
+
+    // Each capture is validated against the history before it, i.e. before update()
+    void screen(const Snapshot & s) {
+        if(statistics && !validate(s))
+            _invalid++;
+    }
+
+    void update(long long value) {
+        if(statistics) {
+            _running.update(value);
+            _ewma.update(value);
+            _p50.update(value);
+            _p99.update(value);
         }
-        return true;
     }
 
 private:
@@ -252,7 +309,11 @@ private:
     Hertz _frequency;
     Time_Stamp _period;
     Time_Stamp _last_capture;
-    Data _average;
+    unsigned int _invalid;
+    Running_Statistics<long long> _running;
+    EWMA<long long, Traits<Monitor>::EWMA_SHIFT> _ewma;
+    P2_Quantile<long long, 500> _p50;
+    P2_Quantile<long long, 990> _p99;
     unsigned int _snapshots;
     Snapshot * _buffer;
     bool _data_to_us;
@@ -303,7 +364,7 @@ public:
         case Event::ELAPSED_TIME:
             return Alarm::elapsed();
         case Event::DEADLINE_MISSES:
-            return t->_statistics.missed_deadlines;
+            return real_time(t) ? periodic(t)->misses() : 0;
         case Event::RUNNING_THREAD:
             return reinterpret_cast<volatile unsigned int>(t);
         case Event::THREAD_EXECUTION_TIME:
@@ -312,6 +373,32 @@ public:
             return t->_statistics.execution_time;
         case Event::CPU_EXECUTION_TIME:
             return t->_statistics.idle_time[CPU::id()];
+        case Event::HEAP_IN_USE:
+            return heap()->statistics().in_use;
+        case Event::HEAP_PEAK:
+            return heap()->statistics().peak;
+        case Event::HEAP_ALLOCATIONS:
+            return heap()->statistics().allocations;
+        case Event::HEAP_FREES:
+            return heap()->statistics().frees;
+        case Event::HEAP_FREE_BLOCKS:
+            return heap()->free_blocks();
+        case Event::HEAP_LARGEST_FREE_BLOCK:
+            return heap()->largest_free_block();
+        case Event::HEAP_FRAGMENTATION:
+            return heap()->fragmentation();
+        case Event::THREAD_INSTRUCTIONS: // per job for real-time threads (see Traits<Thread>::pmu_virtualized)
+            return t->pmu_events(Traits_Tokens::COMMITED_INSTRUCTIONS, real_time(t));
+        case Event::THREAD_CYCLES:
+            return t->pmu_events(Traits_Tokens::CPU_CYCLES, real_time(t));
+        case Event::THREAD_LLC_MISSES:
+            return t->pmu_events(Traits_Tokens::LAST_LEVEL_CACHE_MISSES, real_time(t));
+        case Event::JOB_RESPONSE_TIME_MIN: // in us
+            return real_time(t) ? Data(periodic(t)->response_time_min()) : 0;
+        case Event::JOB_RESPONSE_TIME_AVG:
+            return real_time(t) ? Data(periodic(t)->response_time_avg()) : 0;
+        case Event::JOB_RESPONSE_TIME_MAX:
+            return real_time(t) ? Data(periodic(t)->response_time_max()) : 0;
         default:
             return 0;
         }
@@ -325,7 +412,11 @@ public:
         case Event::ELAPSED_TIME:
             break;
         case Event::DEADLINE_MISSES:
-            t->_statistics.missed_deadlines = 0;
+        case Event::JOB_RESPONSE_TIME_MIN:
+        case Event::JOB_RESPONSE_TIME_AVG:
+        case Event::JOB_RESPONSE_TIME_MAX:
+            if(real_time(t))
+                periodic(t)->reset_job_statistics();
             break;
         case Event::RUNNING_THREAD:
             break;
@@ -339,6 +430,13 @@ public:
         }
     }
 
+private:
+    // The heap behind malloc() and new (see system.h)
+    static Heap * heap() { return Traits<System>::multiheap ? Application::_heap : System::_heap; }
+
+    static bool real_time(Thread * t) { return (t->priority() > Thread::Criterion::PERIODIC) && (t->priority() < Thread::Criterion::APERIODIC); }
+    static Periodic_Thread * periodic(Thread * t) { return reinterpret_cast<Periodic_Thread *>(t); } // only for real_time(t), as in wait_next()
+
 private:
     Event _event;
     Clerk_Monitor<Clerk> * _monitor;
@@ -351,6 +449,8 @@ private:
 template<>
 class Clerk<PMU>: private PMU
 {
+    friend class Profiler; // for _in_use
+
 public:
     using PMU::CHANNELS;
     using PMU::EVENTS;
@@ -389,7 +489,53 @@ public:
 private:
     Channel _channel;
 
-    static bool _in_use[Traits<Build>::CPUS][CHANNELS];
+    static Per_CPU<bool[CHANNELS]> _in_use;
+};
+
+
+// Statistical Profiler
+// Samples the interrupted instruction and the running thread every "period" occurrences of a PMU event (by counter overflow interrupts)
+// Each CPU keeps its latest SAMPLES samples in a ring; dump() prints them for offline symbolization with tools/eposprof
+class Profiler
+{
+private:
+    static const bool enabled = Traits<Profiler>::enabled;
+    static const unsigned int SAMPLES = enabled ? Traits<Profiler>::SAMPLES : 1;
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+
+    typedef CPU::Log_Addr Log_Addr;
+
+public:
+    typedef PMU::Event Event;
+    typedef PMU::Count Count;
+    typedef PMU::Channel Channel;
+
+    struct Sample {
+        Log_Addr ip;
+        Thread * thread;
+    };
+
+public:
+    // Start/stop sampling on the calling CPU
+    static bool start(const Event & event, const Count & period);
+    static void stop();
+
+    static unsigned int taken(unsigned int cpu) { return _taken[cpu]; }
+    static unsigned int samples(unsigned int cpu) { return (_taken[cpu] < SAMPLES) ? _taken[cpu] : SAMPLES; }
+    static const Sample & sample(unsigned int cpu, unsigned int i) { // i = 0 is the oldest sample in the ring
+        return _ring[cpu][(_taken[cpu] - samples(cpu) + i) % SAMPLES];
+    }
+
+    static void dump();
+
+private:
+    static void pmi(const Log_Addr & ip);
+
+private:
+    static Sample _ring[CPUS][SAMPLES];
+    static volatile unsigned int _taken[CPUS];
+    static Channel _channel[CPUS];
+    static Count _period[CPUS];
 };
 
 template<unsigned int CHANNEL>
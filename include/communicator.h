@@ -61,6 +61,11 @@ public:
         Buffer * buf = updated();
         return Channel::receive(buf, from, data, size);
     }
+    template<typename View>
+    int receive(View * view) { // zero-copy: the view borrows the received buffers until view->release()
+        Buffer * buf = updated();
+        return Channel::receive(buf, view);
+    }
 
     int receive_all(void * data, unsigned int size) { // block until "size" bytes are received
         int r = 0;
@@ -125,31 +130,28 @@ public:
         return _connection->write(data, size);
     }
 
-    int read_some(void * data, unsigned int size) { // receive up to "size" bytes from a single packet
-        Buffer * buf = updated();
-        return _connection->read(buf, data, size);
+    int read_some(void * data, unsigned int size) { // receive up to "size" bytes, as many as the connection holds
+        return _connection->read(data, size);
+    }
+    template<typename View>
+    int read_some(View * view) { // zero-copy: the view borrows the next received segment until view->release()
+        return _connection->read(view);
     }
 
     int read(void * d, unsigned int size) { // block until "size" bytes are received
         char * data = reinterpret_cast<char *>(d);
         unsigned int received = 0;
-        do {
-            Buffer * buf = updated();
-            unsigned int segment_size = _connection->read(buf, data, size);
-            data += segment_size;
-            received += segment_size;
-        } while(received <= size);
-        return size;
+        while(received < size) {
+            int r = _connection->read(data + received, size - received);
+            if(r <= 0)
+                break;
+            received += r;
+        }
+        return received;
     }
 
-    int read_all(void * d, unsigned int size) { // block until "size" bytes are received considering only full segments
-        char * data = reinterpret_cast<char *>(d);
-        int r = 0;
-        for(unsigned int received = 0, coppied = 0; received < size; received += coppied) {
-            Buffer * buf = updated();
-            r += _connection->read(buf, data + received, coppied = ((received + (buf->size() - HEADERS_SIZE)) > size ? (size - received) : (buf->size() - HEADERS_SIZE)));
-        }
-        return r;
+    int read_all(void * d, unsigned int size) { // block until "size" bytes are received (the connection buffers segments, so none is cut)
+        return read(d, size);
     }
 
 private:
@@ -180,6 +182,8 @@ public:
 
     int send(const void * data, unsigned int size) { return Base::send(Base::_address, _peer, data, size); }
     int receive(void * data, unsigned int size) { return Base::receive(data, size); }
+    template<typename View>
+    int receive(View * view) { return Base::receive(view); }
 
     const Address & peer() const { return _peer;}
 
@@ -203,6 +207,8 @@ public:
     ~Link() {}
 
     int read(void * data, unsigned int size) { return Base::read_all(data, size); }
+    template<typename View>
+    int read(View * view) { return Base::read_some(view); }
     int write(const void * data, unsigned int size) { return Base::write(data, size); }
 
     const Address & peer() const { return _peer;}
@@ -234,6 +240,8 @@ public:
     template<typename Message>
     int receive(const Message & message) { return Base::receive(message); }
     int receive(Address * from, void * data, unsigned int size) { return Base::receive(from, data, size); }
+    template<typename View>
+    int receive(View * view) { return Base::receive(view); }
 
     template<typename Message>
     int reply(const Message & message) { return Base::reply(message); }
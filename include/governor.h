@@ -0,0 +1,120 @@
+// EPOS Energy-aware Frequency Governor Declarations
+
+#ifndef __governor_h
+#define __governor_h
+
+#include <architecture.h>
+#include <machine.h>
+#include <utility/spin.h>
+#include <utility/scheduler.h>
+#include <utility/per_cpu.h>
+
+__BEGIN_SYS
+
+// Cycle-conserving DVFS (Pillai and Shin, 2001) on top of the real-time scheduler
+// Each periodic thread contributes capacity / period to the utilization of its partition when a job is released
+// and the utilization actually observed (execution / period) once the job completes, so slack left by early
+// completions lowers the frequency until the next release. The lowest of STEPS frequency levels that keeps the
+// partition schedulable (U for EDF, U / (n(2^(1/n) - 1)) for RM) is applied by each CPU at its next dispatch
+// through Machine::clock(). Threads with UNKNOWN capacity claim a whole CPU, so the governor never scales
+// below what the declared task set needs. Only PCs (IA32 clock modulation) actually slow down, other machines keep
+// their clocks, and thus their timers, fixed.
+class Governor
+{
+public:
+    static const bool enabled = Traits<Governor>::enabled;
+
+private:
+    static const bool deep_idle = enabled && Traits<Governor>::deep_idle;
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+    static const unsigned int STEPS = Traits<Governor>::STEPS;
+    static const unsigned int MIN_STEP = (Traits<Governor>::MINIMUM * STEPS + 99) / 100;
+    static const unsigned int PARTITIONS = Traits<Thread>::Criterion::QUEUES;
+    static const bool dynamic = Traits<Thread>::Criterion::dynamic;
+
+    typedef TSC::Time_Stamp Time_Stamp;
+
+public:
+    static const unsigned long SCALE = 1000000; // utilizations are in parts per million
+
+    struct Partition {
+        Partition(): utilization(0), tasks(0), target(STEPS) {}
+
+        unsigned long utilization;
+        unsigned int tasks;
+        volatile unsigned int target;
+    };
+
+    struct Core {
+        Core(): level(0), since(0), changes(0), frequency(0) { for(unsigned int i = 0; i < STEPS; i++) residency[i] = 0; }
+
+        unsigned int level;                     // 1 .. STEPS, 0 => not set yet
+        Time_Stamp since;
+        Time_Stamp residency[STEPS];            // TSC ticks spent at each level
+        unsigned long changes;
+        Hertz frequency;                        // as reported by Machine::clock()
+    };
+
+public:
+    // Utilization share of a job (capacity or execution over period), in SCALE units
+    static unsigned long share(unsigned long work, unsigned long period) {
+        if(!work || !period || (work >= period))
+            return SCALE;
+        unsigned long s = static_cast<unsigned long long>(work) * SCALE / period;
+        return s ? s : 1;
+    }
+
+    // Replaces a thread's contribution ("current", 0 => none) to its partition's utilization by "updated"
+    static void update(unsigned int partition, unsigned long & current, unsigned long updated) {
+        if(enabled)
+            account(partition, current, updated);
+    }
+
+    // Partition of a thread given its scheduling criterion (0 for single-queue criteria)
+    template<typename C>
+    static unsigned int partition(const C & criterion) { return queue(criterion, 0); }
+
+    // Called at every dispatch, with interrupts disabled
+    static void apply() {
+        if(enabled)
+            scale(_partitions[(CPU::id() * PARTITIONS) / CPUS].target);
+    }
+
+    // Called by idle threads instead of CPU::halt()
+    static void idle() {
+        if(deep_idle) {
+            lowest();
+            CPU::int_enable();
+            CPU::deep_halt();
+        } else {
+            CPU::int_enable();
+            CPU::halt();
+        }
+    }
+
+    static unsigned long utilization(unsigned int partition) { return _partitions[partition].utilization; }
+    static unsigned int level(unsigned int cpu) { return _cores[cpu].level; }
+    static const Core & core(unsigned int cpu) { return _cores[cpu]; }
+
+    static void dump();
+
+private:
+    template<typename C>
+    static auto queue(const C & criterion, int) -> decltype(criterion.queue(), 0U) { return criterion.queue(); }
+    template<typename C>
+    static unsigned int queue(const C & criterion, long) { return 0; }
+
+    static void account(unsigned int partition, unsigned long & current, unsigned long updated);
+    static unsigned int level(unsigned long utilization, unsigned int tasks);
+    static void scale(unsigned int level);
+    static void lowest();
+
+private:
+    static Simple_Spin _lock;
+    static Per_CPU<Partition> _partitions;
+    static Per_CPU<Core> _cores;
+};
+
+__END_SYS
+
+#endif
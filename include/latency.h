@@ -0,0 +1,76 @@
+// EPOS Critical Section Latency Tracer Declarations
+
+#ifndef __latency_h
+#define __latency_h
+
+#include <architecture.h>
+
+__BEGIN_SYS
+
+// Longest interrupts-off and preemption-off intervals per CPU and per call site
+// Thread::lock() opens an INTERRUPTS section when it disables interrupts and a PREEMPTION section once it holds the
+// scheduler lock. Thread::unlock() and Thread::dispatch() close them (a section opened by one thread may be closed
+// by another, the one that resumes after the context switch). Sites are return addresses into the code that
+// called lock() and can be resolved with addr2line like the Profiler's samples.
+class Latency
+{
+private:
+    static const bool enabled = Traits<Latency>::enabled;
+    static const unsigned int SITES = enabled ? Traits<Latency>::SITES : 1; // per section per CPU
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+
+    typedef TSC::Time_Stamp Time_Stamp;
+
+public:
+    enum Section {
+        INTERRUPTS,
+        PREEMPTION,
+        SECTIONS
+    };
+
+    struct Site {
+        unsigned long address;
+        unsigned long count;
+        Time_Stamp max;
+        Time_Stamp total;
+    };
+
+public:
+    static void begin(const Section & s) {
+        if(enabled)
+            open(s);
+    }
+
+    static void end(const Section & s) {
+        if(enabled)
+            close(s);
+    }
+
+    // Longest interval (in TSC ticks) observed on a CPU and its opening site
+    static Time_Stamp max(const Section & s, unsigned int cpu) { return _max[s][cpu]; }
+    static unsigned long max_site(const Section & s, unsigned int cpu) { return _max_site[s][cpu]; }
+
+    static const Site & site(const Section & s, unsigned int cpu, unsigned int i) { return _sites[s][cpu][i]; }
+
+    // Intervals whose site did not fit into the table (still accounted in max())
+    static unsigned long overflows(const Section & s, unsigned int cpu) { return _overflows[s][cpu]; }
+
+    static void reset();
+    static void dump();
+
+private:
+    static void open(const Section & s) __attribute__((noinline)); // must be a real call to take the caller's address
+    static void close(const Section & s);
+
+private:
+    static Time_Stamp _start[SECTIONS][CPUS];
+    static unsigned long _open_site[SECTIONS][CPUS];
+    static Time_Stamp _max[SECTIONS][CPUS];
+    static unsigned long _max_site[SECTIONS][CPUS];
+    static unsigned long _overflows[SECTIONS][CPUS];
+    static Site _sites[SECTIONS][CPUS][SITES];
+};
+
+__END_SYS
+
+#endif
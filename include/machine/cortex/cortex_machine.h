@@ -43,6 +43,9 @@ public:
 
     static const UUID & uuid() { return System::info()->bm.uuid; }
 
+    // Sets the core clock as close as possible to (but not below) frequency and returns the resulting clock
+    static Hertz clock(const Hertz & frequency) { return Engine::clock(frequency); }
+
 private:
     static void pre_init(System_Info * si);
     static void init();
@@ -68,6 +68,8 @@ public:
 
     static void smp_barrier_init(unsigned int n_cpus) { assert(n_cpus == 1); }
 
+    static Hertz clock(const Hertz & frequency) { return CPU::clock(); }
+
     static void power(const Power_Mode & mode) {
         // Change in power mode will only be effective when ASM("wfi") is executed
         switch(mode) {
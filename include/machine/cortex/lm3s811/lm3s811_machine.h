@@ -39,6 +39,8 @@ public:
     static void smp_barrier_init(unsigned int n_cpus) { assert(n_cpus == 1); }
 
     static void power(const Power_Mode & mode) {}
+
+    static Hertz clock(const Hertz & frequency) { return CPU::clock(); }
     
 private:
     static void pre_init();
@@ -28,6 +28,9 @@ public:
 
     static const UUID & uuid() { return System::info()->bm.uuid; }
 
+    // ARM clock changes go through the VideoCore firmware mailbox, which is not supported yet
+    static Hertz clock(const Hertz & frequency) { return CPU::clock(); }
+
 public:
     static void smp_barrier_init(unsigned int n_cpus) {
         _cores = n_cpus;
@@ -29,6 +29,9 @@ public:
 
     static const UUID & uuid() { return System::info()->bm.uuid; }
 
+    // The PBX has no software clock control (neither does QEMU), so frequency changes are only recorded
+    static Hertz clock(const Hertz & frequency) { return (frequency < CPU::clock()) ? frequency : CPU::clock(); }
+
 public:
     static void smp_barrier_init(unsigned int n_cpus) {
         // TODO: I guess this should be in SETUP, so all machines get to INIT with all designated cores enabled
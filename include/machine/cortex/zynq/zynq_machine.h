@@ -243,6 +243,10 @@ protected:
         }
     }
 
+    // ARM_CLK_CTRL also divides CPU_3x2x, which drives the private and global timers that time keeping and scheduling
+    // are calibrated on, so the CPU clock is kept fixed and DVFS is left to IA32 clock modulation
+    static Hertz clock(const Hertz & frequency) { return CPU::clock(); }
+
     // Returns the frequency set, -1 if frequency can't be set
     static int fpga0_clk_freq(unsigned int freq) {
         const unsigned int div_max = 63, tol = 20;
@@ -207,6 +207,40 @@ public:
         static void init();
 };
 
+// Deferred receive processing (NAPI-like)
+// The ISR of a NIC that uses it only acknowledges the interrupt, masks further receive interrupts and calls wake().
+// A thread per NIC then calls poll() in rounds of at most "budget" frames, yielding the CPU between rounds, until
+// poll() returns less than the budget, meaning the ring was drained and the NIC re-enabled receive interrupts.
+// Upper layers (e.g. IP::update()) are thus notified at a thread priority instead of in the ISR.
+// Threads cannot be created when NICs are initialized, so start() is called at the first attach().
+class Deferred_Receiver
+{
+protected:
+    Deferred_Receiver(): _thread(0), _semaphore(0), _budget(0), _rounds(0), _frames(0) {}
+    virtual ~Deferred_Receiver();
+
+    // Hands at most budget frames up, re-enabling receive interrupts if fewer were pending
+    virtual unsigned int poll(unsigned int budget) = 0;
+
+    void start(int priority, unsigned int budget);
+    bool started() const { return _thread; }
+    void wake();
+
+public:
+    unsigned long rounds() const { return _rounds; }
+    unsigned long frames() const { return _frames; }
+
+private:
+    static int receiver(Deferred_Receiver * r);
+
+private:
+    Thread * _thread;
+    Semaphore * _semaphore;
+    unsigned int _budget;
+    unsigned long _rounds;
+    unsigned long _frames;
+};
+
 // Polymorphic NIC base class
 template<typename Family>
 class NIC: public Family, public Family::Observed
@@ -234,6 +268,11 @@ public:
     virtual Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload) = 0;
     virtual int send(Buffer * buf) = 0;
     virtual void free(Buffer * buf) = 0;
+
+    // Batched transmission: post() hands the frames of a buffer pool to the NIC without notifying it, flush() notifies
+    // it once (i.e. rings the doorbell) for everything posted since the last flush() and waits for it to be sent
+    virtual int post(Buffer * buf) { return send(buf); }
+    virtual void flush() {}
     virtual bool drop(unsigned int id) { return false; };
 
     virtual const Address & address() = 0;
@@ -145,6 +145,10 @@ template<> struct Traits<Ethernet>: public Traits<Machine_Common>
     static const bool enabled = (Traits<Build>::NODES > 1) && (UNITS > 0);
 
     static const bool promiscuous = false;
+
+    static const bool deferred_receive = false;     // if set, ISRs only wake a per-NIC thread that polls received frames (see Deferred_Receiver)
+    static const int RECEIVE_PRIORITY = 1;          // of that thread, as a Thread::Criterion (1 = Thread::HIGH)
+    static const unsigned int RECEIVE_BUDGET = 16;  // frames handed up per polling round
 };
 
 template<> struct Traits<PCNet32>: public Traits<Ethernet>
@@ -154,6 +158,7 @@ template<> struct Traits<PCNet32>: public Traits<Ethernet>
 
     static const unsigned int SEND_BUFFERS = 64; // per unit
     static const unsigned int RECEIVE_BUFFERS = 256; // per unit
+    static const unsigned int SPARE_BUFFERS = 64; // per unit, swapped into the receive ring while upper layers hold received buffers
 };
 
 template<> struct Traits<E100>: public Traits<Ethernet>
@@ -4,6 +4,7 @@
 #define __e100_h
 
 #include <machine/ic.h>
+#include <utility/spin.h>
 #include <network/ethernet.h>
 
 __BEGIN_SYS
@@ -209,6 +210,9 @@ public:
         irq_mask_none = 0x00,
         irq_mask_all  = 0x01,
         irq_sw_gen    = 0x02,
+        irq_mask_rnr  = 0x10,
+        irq_mask_fr   = 0x40,
+        irq_mask_rx   = irq_mask_fr | irq_mask_rnr,
     };
 
     enum scb_cmd_lo {
@@ -522,7 +526,7 @@ protected:
 };
 
 
-class E100: public NIC<Ethernet>, private IF<(Traits<E100>::EXPECTED_SIMULATION_TIME > 0), i82559ER, i82559c>::Result
+class E100: public NIC<Ethernet>, public Deferred_Receiver, private IF<(Traits<E100>::EXPECTED_SIMULATION_TIME > 0), i82559ER, i82559c>::Result
 {
     friend class Machine_Common;
 
@@ -540,6 +544,7 @@ private:
     static const unsigned int UNITS = Traits<E100>::UNITS;
     static const unsigned int TX_BUFS = Traits<E100>::SEND_BUFFERS;
     static const unsigned int RX_BUFS = Traits<E100>::RECEIVE_BUFFERS;
+    static const bool deferred = Traits<E100>::deferred_receive;
     static const unsigned int DMA_BUFFER_SIZE =
         ((sizeof(ConfigureCB) + 15) & ~15U) +
         ((sizeof(MACaddrCB) + 15) & ~15U) +
@@ -567,6 +572,8 @@ public:
     Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
     void free(Buffer * buf);
     int send(Buffer * buf);
+    int post(Buffer * buf);
+    void flush();
 
     const Address & address() { return _address; }
     void address(const Address & address) { _address = address; }
@@ -577,6 +584,8 @@ public:
 
     void attach(Observer * o, const Protocol & p) {
         NIC<Ethernet>::attach(o, p);
+        if(deferred)
+            start(Traits<E100>::RECEIVE_PRIORITY, Traits<E100>::RECEIVE_BUDGET);
         ; // enable receive interrupt
     }
 
@@ -591,6 +600,29 @@ public:
 private:
     void handle_int();
 
+    // Posting and flushing come from applications, the receiver thread and ARP, so they run one at a time, interrupts disabled
+    int enqueue(Buffer * buf); // post() with the lock held
+    void drain(); // flush() with the lock held
+
+    void lock() {
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
+        if(Traits<System>::multicore)
+            _lock.acquire();
+        _disabled = disabled;
+    }
+
+    void unlock() {
+        bool disabled = _disabled;
+        if(Traits<System>::multicore)
+            _lock.release();
+        if(!disabled)
+            CPU::int_enable();
+    }
+    unsigned int handle_rx(unsigned int budget);
+    unsigned int poll(unsigned int budget);
+
     static void int_handler(IC::Interrupt_Id interrupt);
 
     bool verifyPendingInterrupts(void);
@@ -601,6 +633,7 @@ private:
     void i82559_flush() { read8(&_csr->scb.status); }
     void i82559_disable_irq() { write8(irq_mask_all, &_csr->scb.cmd_hi); }
     void i82559_enable_irq() { write8(irq_mask_none, &_csr->scb.cmd_hi); }
+    void i82559_disable_rx_irq() { write8(irq_mask_rx, &_csr->scb.cmd_hi); }
 
     int self_test();
 
@@ -731,6 +764,11 @@ private:
     Buffer * _rx_buffer[RX_BUFS];
     Buffer * _tx_buffer[TX_BUFS];
 
+    Buffer * _posted[TX_BUFS];  // sent at the next flush()
+    unsigned int _posts;
+    Spin _lock;
+    bool _disabled; // interrupt state before lock()
+
     DMA_Buffer * _dma_buffer;
 
     static Device _devices[UNITS];
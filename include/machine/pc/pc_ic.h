@@ -533,6 +533,13 @@ public:
     using Engine::ipi;
     using Engine::irq2int;
 
+    // PMU overflow interrupts (PMIs) bypass dispatch() to hand the interrupted instruction pointer to a profiler
+    typedef void (* PMI_Handler)(const Log_Addr & ip);
+    static void pmi_handler(const PMI_Handler & h) {
+        db<IC>(TRC) << "IC::pmi_handler(h=" << reinterpret_cast<void *>(h) << ")" << endl;
+        _pmi_handler = h;
+    }
+
 private:
     static void dispatch(unsigned int i);
 
@@ -543,13 +550,18 @@ private:
     static void entry();
     static void exc_not(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
     static void exc_pf (Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
+    static void exc_pf_entry();
+    static bool exc_pf_demand(Reg32 address);
     static void exc_gpf(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
     static void exc_fpu(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
+    static void pmi_entry();
+    static void pmi(Reg32 eip);
 
     static void init();
 
 private:
     static Interrupt_Handler _int_vector[INTS];
+    static PMI_Handler _pmi_handler;
 };
 
 __END_SYS
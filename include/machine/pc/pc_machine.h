@@ -38,6 +38,12 @@ public:
     static void reboot();
     static void poweroff();
 
+    // Core clock through clock modulation (12.5 % steps), which leaves the TSC untouched
+    static Hertz clock(const Hertz & frequency) {
+        CPU::clock(frequency);
+        return (frequency < CPU::clock()) ? frequency : CPU::clock();
+    }
+
     static const UUID & uuid() { return System::info()->bm.uuid; }
 
 private:
@@ -5,6 +5,7 @@
 
 #include <architecture.h>
 #include <utility/convert.h>
+#include <utility/spin.h>
 #include <network/ethernet.h>
 
 __BEGIN_SYS
@@ -389,7 +390,7 @@ public:
 
 
 // PCNet32 PC Ethernet NIC
-class PCNet32: public NIC<Ethernet>, private Am79C970A
+class PCNet32: public NIC<Ethernet>, public Deferred_Receiver, private Am79C970A
 {
     friend class Machine_Common;
 
@@ -401,16 +402,18 @@ private:
 
     // Mode
     static const bool promiscuous = Traits<PCNet32>::promiscuous;
+    static const bool deferred = Traits<PCNet32>::deferred_receive;
 
     // Transmit and Receive Ring sizes
     static const unsigned int UNITS = Traits<PCNet32>::UNITS;
     static const unsigned int TX_BUFS = Traits<PCNet32>::SEND_BUFFERS;
     static const unsigned int RX_BUFS =Traits<PCNet32>::RECEIVE_BUFFERS;
+    static const unsigned int SPARE_BUFS = Traits<PCNet32>::SPARE_BUFFERS;
 
     // Size of the DMA Buffer that will host the ring buffers and the init block
     static const unsigned int DMA_BUFFER_SIZE = ((sizeof(Init_Block) + 15) & ~15U) +
         RX_BUFS * ((sizeof(Rx_Desc) + 15) & ~15U) + TX_BUFS * ((sizeof(Tx_Desc) + 15) & ~15U) +
-        RX_BUFS * ((sizeof(Buffer) + 15) & ~15U) + TX_BUFS * ((sizeof(Buffer) + 15) & ~15U); // align128() cannot be used here
+        (RX_BUFS + SPARE_BUFS) * ((sizeof(Buffer) + 15) & ~15U) + TX_BUFS * ((sizeof(Buffer) + 15) & ~15U); // align128() cannot be used here
 
     // Interrupt dispatching binding
     struct Device {
@@ -430,6 +433,8 @@ public:
     Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
     void free(Buffer * buf);
     int send(Buffer * buf);
+    int post(Buffer * buf);
+    void flush();
 
     const Address & address() { return _address; }
     void address(const Address & address) { _address = address; }
@@ -440,13 +445,20 @@ public:
 
     void attach(Observer * o, const Protocol & p) {
         NIC<Ethernet>::attach(o, p);
+        if(deferred)
+            start(Traits<PCNet32>::RECEIVE_PRIORITY, Traits<PCNet32>::RECEIVE_BUDGET);
+        lock();
         csr(3, csr(3) & ~ CSR3_RINTM); // enable receive interrupt
+        unlock();
     }
 
     void detach(Observer * o, const Protocol & p) {
         NIC<Ethernet>::detach(o, p);
-        if(!observers())
+        if(!observers()) {
+            lock();
             csr(3, csr(3) | CSR3_RINTM); // disable receive interrupt
+            unlock();
+        }
     }
 
     static PCNet32 * get(unsigned int unit = 0) { return get_by_unit(unit); }
@@ -454,6 +466,32 @@ public:
 private:
     void handle_int();
 
+    // Posting and flushing come from applications, the receiver thread and ARP, so they run one at a time, interrupts disabled
+    int enqueue(Buffer * buf); // post() with the lock held
+    void drain(); // flush() with the lock held
+
+    void lock() {
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
+        if(Traits<System>::multicore)
+            _lock.acquire();
+        _disabled = disabled;
+    }
+
+    void unlock() {
+        bool disabled = _disabled;
+        if(Traits<System>::multicore)
+            _lock.release();
+        if(!disabled)
+            CPU::int_enable();
+    }
+    unsigned int handle_rx(unsigned int budget);
+    unsigned int poll(unsigned int budget);
+    void refill(unsigned int i);
+
+    Phy_Addr phy(Buffer * buf) { return _dma_buf->phy_address() + (Log_Addr(buf) - _dma_buf->log_address()); }
+
     static void int_handler(IC::Interrupt_Id interrupt);
 
     static PCNet32 * get_by_unit(unsigned int unit) {
@@ -493,6 +531,12 @@ private:
 
     Buffer * _rx_buffer[RX_BUFS];
     Buffer * _tx_buffer[TX_BUFS];
+    Buffer::List _spares;       // DMA buffers not bound to any descriptor, linked by link2()
+
+    Buffer * _posted[TX_BUFS];  // sent at the next flush()
+    unsigned int _posts;
+    Spin _lock;
+    bool _disabled; // interrupt state before lock()
 
     static Device _devices[UNITS];
 };
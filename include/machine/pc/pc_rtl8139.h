@@ -9,11 +9,12 @@
 
 #include <architecture.h>
 #include <utility/convert.h>
+#include <utility/spin.h>
 #include <network/ethernet.h>
 
 __BEGIN_SYS
 
-class RTL8139: public NIC<Ethernet>
+class RTL8139: public NIC<Ethernet>, public Deferred_Receiver
 {
     friend class Machine_Common;
 
@@ -69,6 +70,7 @@ private:
     static const unsigned int PCI_DEVICE_ID = 0x8139; // RTL8139
     static const unsigned int PCI_REG_IO = 0;
     static const unsigned int UNITS = Traits<RTL8139>::UNITS;
+    static const bool deferred = Traits<RTL8139>::deferred_receive;
 
     // Buffer config
     static const unsigned int RX_NO_WRAP_SIZE = Traits<RTL8139>::RECEIVE_BUFFERS;
@@ -96,6 +98,8 @@ public:
     Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
     void free(Buffer * buf);
     int send(Buffer * buf);
+    int post(Buffer * buf);
+    void flush();
 
     const Address & address() { return _address; }
     void address(const Address & address) { _address = address; }
@@ -107,13 +111,18 @@ public:
     virtual void attach(Observer * o, const Protocol & p) {
         db<RTL8139>(TRC) << "RTL8139::attach(p=" << p  << ")" << endl;
         NIC<Ethernet>::attach(o, p);
+        if(deferred)
+            start(Traits<RTL8139>::RECEIVE_PRIORITY, Traits<RTL8139>::RECEIVE_BUDGET);
         CPU::out16 (_io_port + IMR, ROK); // enable receive int
     }
 
     virtual void detach(Observer * o, const Protocol & p) {
         NIC<Ethernet>::detach(o, p);
-        if(!observers())
+        if(!observers()) {
+            lock();
             CPU::out16(_io_port + IMR, CPU::in16(_io_port + IMR) & ~ROK); // disable receive int
+            unlock();
+        }
     }
 
     static RTL8139 * get(unsigned int unit = 0) { return get_by_unit(unit); }
@@ -121,6 +130,29 @@ public:
 private:
     void handle_int();
 
+    // Posting and flushing come from applications, the receiver thread and ARP, so they run one at a time, interrupts disabled
+    int enqueue(Buffer * buf); // post() with the lock held
+    void drain(); // flush() with the lock held
+
+    void lock() {
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
+        if(Traits<System>::multicore)
+            _lock.acquire();
+        _disabled = disabled;
+    }
+
+    void unlock() {
+        bool disabled = _disabled;
+        if(Traits<System>::multicore)
+            _lock.release();
+        if(!disabled)
+            CPU::int_enable();
+    }
+    unsigned int handle_rx(unsigned int budget);
+    unsigned int poll(unsigned int budget);
+
     static void int_handler(IC::Interrupt_Id interrupt);
 
     static RTL8139 * get_by_unit(unsigned int unit) {
@@ -160,6 +192,11 @@ private:
     char * _rx_buffer;
     Buffer * _tx_buffer[TX_BUFS];
 
+    unsigned int _posted[TX_BUFS]; // descriptors started since the last flush()
+    unsigned int _posts;
+    Spin _lock;
+    bool _disabled; // interrupt state before lock()
+
     static Device _devices[UNITS];
 };
 
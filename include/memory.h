@@ -41,6 +41,7 @@ private:
 
 public:
     typedef CPU::Phy_Addr Phy_Addr;
+    typedef CPU::Log_Addr Log_Addr;
     typedef MMU::Flags Flags;
 
 public:
@@ -50,7 +51,11 @@ public:
 
     unsigned int size() const;
     Phy_Addr phy_address() const;
+    Log_Addr log_address(unsigned int offset) const;
     int resize(int amount);
+
+    bool populate(unsigned int offset);
+    unsigned int resident() const;
 };
 
 __END_SYS
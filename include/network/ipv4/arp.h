@@ -22,8 +22,22 @@ public:
     typedef typename Network::Address PA;
     typedef typename NIC::Address HA;
 
+    typedef typename NIC::Buffer Buffer;
+
+    // Timing, in us
+    static const unsigned int TICK = 1000000; // requests are repeated once per tick at most (RFC 1122)
+
+    // Cache (RFC 1122), in ticks
+    static const unsigned int AGE = 300; // a resolved entry is removed after that long without confirmation
+    static const unsigned int REFRESH = 30; // before it ages out, an entry in use is confirmed with unicast requests
+
+    // Datagrams held while an address is pending, the oldest one is dropped to make room for a new one
+    static const unsigned int QUEUE = 3;
+    static const unsigned int FRAMES = 8; // per held datagram
+
 private:
     static const unsigned int ENTRIES = Traits<Build>::NODES;
+    static const unsigned int CAPACITY = 8 * ENTRIES; // requests to us create no entries beyond it
 
     class Mapping;
     typedef Simple_Hash<Mapping, ENTRIES, PA> Table;
@@ -88,53 +102,120 @@ private:
     class Mapping
     {
     public:
-        Mapping(const PA & pa, const HA & ha): _ha(ha), _sem(0), _link(this, pa) {}
-        Mapping(const PA & pa, Semaphore * sem): _ha(HA::NULL), _sem(sem), _link(this, pa) {}
+        Mapping(const PA & pa, const HA & ha, bool permanent = false): _ha(ha), _age(AGE), _tries(0), _used(false), _permanent(permanent), _held(0), _link(this, pa) {
+            for(unsigned int i = 0; i < QUEUE; i++)
+                _queue[i] = 0;
+        }
+        Mapping(const PA & pa): _ha(HA::NULL), _age(AGE), _tries(1), _used(false), _permanent(false), _held(0), _link(this, pa) { // the first request is sent by resolve()
+            for(unsigned int i = 0; i < QUEUE; i++)
+                _queue[i] = 0;
+        }
+        ~Mapping() {
+            for(unsigned int i = 0; i < QUEUE; i++)
+                if(_queue[i])
+                    discard(_queue[i]);
+        }
 
+        const PA & pa() const { return _link.key(); }
         const HA & ha() const { return _ha; }
-        Semaphore * semaphore() { return _sem; }
+        bool pending() const { return !_ha; }
+        bool permanent() const { return _permanent; }
+        bool awaiting() const { return _tries; } // a reply to a request of ours
         Element * link() { return &_link; }
 
-        void update(const HA & ha) {
+        void use() { _used = true; }
+
+        void refresh() {
+            _age = AGE;
+            _tries = 0;
+            _used = false;
+        }
+
+        // Datagrams sent before the reply arrives, in order
+        void hold(Buffer * pool) {
+            if(_queue[_held % QUEUE])
+                discard(_queue[_held % QUEUE]); // the oldest one
+            _queue[_held % QUEUE] = pool;
+            _held++;
+        }
+
+        // Confirms the mapping, the datagrams held so far are moved into queue, in order
+        unsigned int update(const HA & ha, Buffer ** queue) {
             _ha = ha;
-            if(_sem) {
-                _sem->v();
-                _sem = 0;
+            refresh();
+
+            unsigned int n = 0;
+            unsigned int first = (_held > QUEUE) ? _held - QUEUE : 0;
+            for(unsigned int i = first; i < _held; i++) {
+                queue[n++] = _queue[i % QUEUE];
+                _queue[i % QUEUE] = 0;
             }
+            _held = 0;
+
+            return n;
+        }
+
+        // A tick went by, returns false once the mapping must be removed
+        bool age(bool * request) {
+            *request = false;
+
+            if(pending()) {
+                if(_tries >= Traits<Network>::RETRIES)
+                    return false;
+                _tries++;
+                *request = true;
+                return true;
+            }
+
+            if(!_age || !--_age)
+                return false;
+            if((_age <= REFRESH) && _used) {
+                _tries++;
+                *request = true; // unicast, to the cached address
+            }
+
+            return true;
         }
 
         friend Debug & operator<<(Debug & db, const Mapping & m) {
-            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",sem=" << m._sem << "}";
+            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",age=" << m._age << ",tries=" << m._tries << ",held=" << m._held << "}";
             return db;
         }
 
     private:
         HA _ha;
-        Semaphore * _sem;
+        unsigned int _age; // ticks left
+        unsigned int _tries; // requests sent without a reply
+        bool _used; // by resolve() since the last confirmation
+        bool _permanent;
+        Buffer * _queue[QUEUE];
+        unsigned int _held;
         Element _link; // PA is the key
     };
 
 
 public:
-    ARP(NIC * nic, Network * net): _nic(nic), _net(net) {
+    ARP(NIC * nic, Network * net): _entries(0), _nic(nic), _net(net), _ticks(0), _handler(&_ticks) {
         db<IP>(TRC) << "ARP::ARP(nic=" << nic << ",net=" << net << ") => " << this << endl;
 
         _nic->attach(this, NIC::PROTO_ARP);
+        _ager = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::HIGH)), &ager, this);
+        _alarm = new (SYSTEM) Alarm(TICK, &_handler, INFINITE);
     }
 
     ~ARP() {
         db<IP>(TRC) << "ARP::~ARP(this=" << this << ")" << endl;
 
+        delete _alarm;
+        delete _ager;
         _nic->detach(this, NIC::PROTO_ARP);
 
         lock();
-        for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
-            if(it) {
-                db<IP>(INF) << "ARP::~ARP: removing and deleting " << *it->object() << endl;
+        for(Element * el = first(); el; el = first()) {
+            db<IP>(INF) << "ARP::~ARP: removing and deleting " << *el->object() << endl;
 
-                _table.remove(it);
-                delete it->object();
-            }
+            _table.remove(el);
+            delete el->object();
         }
         unlock();
     }
@@ -142,72 +223,110 @@ public:
     void insert(const PA & pa, const HA & ha) {
         db<IP>(TRC) << "ARP::insert(pa=" << pa << ",ha=" << ha << ")" << endl;
 
-        Mapping * map = new (SYSTEM) Mapping(pa, ha);
+        Mapping * map = new (SYSTEM) Mapping(pa, ha, true); // never ages
 
         lock();
         _table.insert(map->link());
+        _entries++;
         unlock();
     }
 
     void remove(const PA & pa) {
         db<IP>(TRC) << "ARP::remove(pa=" << pa << ")" << endl;
 
+        lock();
         Element * el = _table.remove_key(pa);
+        if(el)
+            _entries--;
+        unlock();
+
         if(el) {
             db<IP>(INF) << "ARP::remove: removing and deleting " << *el->object() << endl;
             delete el->object();
         }
     }
 
+    // Never blocks: an unknown address yields HA::NULL and its resolution goes on in background, while datagrams to it
+    // are given to hold() and sent once the reply arrives
     HA resolve(const PA & pa) {
         db<IP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
 
-        volatile HA ha = HA(HA::NULL);
+        HA ha = HA(HA::NULL);
+        bool request = false;
 
         lock();
         Element * el = _table.search_key(pa);
+        if(el) {
+            ha = el->object()->ha();
+            el->object()->use();
+        } else {
+            _table.insert((new (SYSTEM) Mapping(pa))->link());
+            _entries++;
+            request = true;
+        }
         unlock();
 
-        if(el)
-            ha = el->object()->ha();
-        else {
-            db<IP>(TRC) << "sending requests" << endl;
+        db<IP>(TRC) << ha << endl;
 
-            Semaphore sem(0);
-            Mapping * map = new (SYSTEM) Mapping(pa, &sem);
-            lock();
-            _table.insert(map->link());
-            unlock();
+        if(request)
+            send(REQUEST, HA::BROADCAST, pa);
 
-            for(unsigned int i = 0; (i < Traits<Network>::RETRIES) && !ha; i++) {
-                Packet request(REQUEST, _nic->address(), _net->address(), HA::BROADCAST, pa);
-                db<IP>(INF) << "ARP::resolve:request=" << request << endl;
-                _nic->send(HA::BROADCAST, NIC::PROTO_ARP, &request, sizeof(Packet));
+        return ha;
+    }
 
-                Semaphore_Handler handler(&sem);
-                Alarm alarm(Traits<Network>::TIMEOUT * 1000000, &handler, 1);
-                sem.p();
+    // Takes a datagram built while pa was being resolved (i.e. frames with a null destination allocated from the
+    // system heap, for NIC buffers must be sent in order) and sends it as soon as pa is known
+    int hold(const PA & pa, Buffer * pool) {
+        db<IP>(TRC) << "ARP::hold(pa=" << pa << ",buf=" << pool << ")" << endl;
 
-                ha = map->ha();
-            }
+        int size = 0;
+        for(typename Buffer::Element * el = pool->link(); el; el = el->next())
+            size += el->object()->size();
 
-            lock();
-            if(!ha) {
-                _table.remove(map->link());
-                delete map;
-            }
-            unlock();
+        HA ha = HA(HA::NULL);
+        bool request = false;
+
+        lock();
+        Element * el = _table.search_key(pa);
+        if(!el) { // it aged out meanwhile
+            el = (new (SYSTEM) Mapping(pa))->link();
+            _table.insert(el);
+            _entries++;
+            request = true;
+        }
+        if(el->object()->pending())
+            el->object()->hold(pool);
+        else
+            ha = el->object()->ha(); // resolved meanwhile
+        unlock();
 
-            db<IP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
+        if(request)
+            send(REQUEST, HA::BROADCAST, pa);
+
+        if(ha) {
+            release(ha, pool);
+            _nic->flush();
         }
 
-        // Even being declared volatile, "ha" gets messed up and a PF occurs without the memcpy
-        HA ha2;
-        memcpy(&ha2, const_cast<HA *>(&ha), sizeof(HA));
+        return size;
+    }
 
-        db<IP>(TRC) << ha2 << endl;
+    // Traffic from a sender on the local network (e.g. an incoming datagram) refreshes its resolved mapping, as long as
+    // it came from the cached address, but never overwrites one; it only creates one if learning is enabled, which is
+    // meant for trusted links, since any host on the link could otherwise fill the cache with forged sources
+    void confirm(const PA & pa, const HA & ha) {
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el) {
+            if(!el->object()->permanent() && !el->object()->pending() && (el->object()->ha() == ha))
+                el->object()->refresh();
+        } else if(Traits<Network>::arp_learning && (_entries < CAPACITY)) {
+            db<IP>(TRC) << "ARP::confirm(pa=" << pa << ",ha=" << ha << ")" << endl;
 
-        return ha2;
+            _table.insert((new (SYSTEM) Mapping(pa, ha))->link());
+            _entries++;
+        }
+        unlock();
     }
 
 //    PA resolve(const HA & ha) {
@@ -238,24 +357,19 @@ public:
         Packet * packet = buf->frame()->template data<Packet>();
         db<IP>(INF) << "ARP::update:pkt=" << packet << " => " << *packet << endl;
 
+        // The sender's mapping of a request is merged into the cache (RFC 826), creating it if the request is to us,
+        // while a reply is only taken for a mapping we sent a request for
+        if(packet->spa() && (packet->spa() != _net->address()))
+            merge(packet->spa(), packet->sha(), packet->op() == REPLY, packet->tpa() == _net->address());
+
         if((packet->op() == REQUEST) && (packet->tpa() == _net->address())) {
 
             Packet reply(REPLY, _nic->address(), _net->address(), packet->sha(), packet->spa());
             db<IP>(TRC) << "ARP::update: replying query for " << packet->tpa() << " with " << reply << endl;
             _nic->send(packet->sha(), NIC::PROTO_ARP, &reply, sizeof(Packet));
 
-        } else if((packet->op() == REPLY) && (packet->tha() == _nic->address())) {
-
-            lock();
-            Element * el = _table.search_key(packet->spa());
-            if(el) {
-                db<IP>(TRC) << "ARP::update: got reply for query on " << packet->spa() << ": " << packet->sha() << endl;
-                el->object()->update(packet->sha());
-            } else
-                db<IP>(WRN) << "ARP::update: got reply for query on " << packet->spa() << ", which is not in table!" << endl;
-            unlock();
-
-        }
+        } else if((packet->op() == REPLY) && (packet->tha() == _nic->address()))
+            db<IP>(TRC) << "ARP::update: got reply for query on " << packet->spa() << ": " << packet->sha() << endl;
 
         _nic->free(buf);
     }
@@ -264,7 +378,7 @@ public:
         db<IP>(INF) << "ARP::Table => {" << endl;
         for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
             if(it)
-                db<IP>(INF) << hex << it << " => {" << it->key() << "," << it->object()->ha() << "}" << endl;
+                db<IP>(INF) << hex << it << " => " << *it->object() << endl;
             else
                 db<IP>(INF) << hex << it << " => EMPTY" << endl;
         }
@@ -273,23 +387,146 @@ public:
     }
 
 private:
+    void send(const Oper & op, const HA & to, const PA & pa) {
+        Packet request(op, _nic->address(), _net->address(), to, pa);
+        db<IP>(INF) << "ARP::send:request=" << request << endl;
+        _nic->send(to, NIC::PROTO_ARP, &request, sizeof(Packet));
+    }
+
+    // Copies a held datagram into NIC buffers, now addressed to ha, and posts them (the caller flushes the NIC)
+    void release(const HA & ha, Buffer * pool) {
+        db<IP>(TRC) << "ARP::release(ha=" << ha << ",buf=" << pool << ")" << endl;
+
+        for(typename Buffer::Element * el = pool->link(); el; el = el->next()) {
+            Buffer * held = el->object();
+            Buffer * buf = _nic->alloc(ha, NIC::PROTO_IP, 0, 0, held->size());
+            if(!buf)
+                break;
+            memcpy(buf->frame()->template data<void>(), held->frame()->template data<void>(), held->size());
+            _nic->post(buf);
+        }
+
+        discard(pool);
+    }
+
+    void merge(const PA & pa, const HA & ha, bool reply, bool create) {
+        Buffer * queue[QUEUE];
+        unsigned int n = 0;
+
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el) {
+            Mapping * map = el->object();
+            if(!map->permanent() && (!reply || map->awaiting()))
+                n = map->update(ha, queue);
+        } else if(!reply && create && (_entries < CAPACITY)) {
+            db<IP>(TRC) << "ARP::merge(pa=" << pa << ",ha=" << ha << ")" << endl;
+
+            _table.insert((new (SYSTEM) Mapping(pa, ha))->link());
+            _entries++;
+        }
+        unlock();
+
+        if(n) {
+            for(unsigned int i = 0; i < n; i++)
+                release(ha, queue[i]);
+            _nic->flush();
+        }
+    }
+
+    static void discard(Buffer * pool) {
+        for(typename Buffer::Element * el = pool->link(), * next; el; el = next) {
+            next = el->next();
+            delete el->object();
+        }
+    }
+
+    Element * first() {
+        typename Table::Iterator it = _table.begin();
+        return (it != _table.end()) ? static_cast<Element *>(it) : 0;
+    }
+
+    // The alarm handler runs in interrupt context, where sending and deleting are not allowed, so it only counts ticks
+    // on _ticks and the cache is aged by this thread instead
+    static int ager(ARP * arp) {
+        while(true) {
+            arp->_ticks.p();
+            tick(arp);
+        }
+
+        return 0;
+    }
+
+    // Ages the cache and repeats requests, once per TICK
+    static void tick(ARP * arp) {
+        // The table is walked once, requests are sent and expired mappings removed afterwards, as many as fit in BURST
+        // (the others are handled at the next tick)
+        static const unsigned int BURST = 8;
+        PA pas[BURST];
+        HA has[BURST];
+        Mapping * expired[BURST];
+        unsigned int requests = 0;
+        unsigned int removals = 0;
+
+        arp->lock();
+        for(typename Table::Iterator it = arp->_table.begin(); it != arp->_table.end(); it++) {
+            Mapping * map = it->object();
+            if(map->permanent())
+                continue;
+
+            bool request;
+            if(!map->age(&request)) {
+                if(removals < BURST)
+                    expired[removals++] = map;
+            } else if(request && (requests < BURST)) {
+                pas[requests] = map->pa();
+                has[requests++] = map->pending() ? HA(HA::BROADCAST) : map->ha();
+            }
+        }
+        for(unsigned int i = 0; i < removals; i++) {
+            db<IP>(INF) << "ARP::tick: removing and deleting " << *expired[i] << endl;
+
+            arp->_table.remove(expired[i]->link());
+            arp->_entries--;
+        }
+        arp->unlock();
+
+        for(unsigned int i = 0; i < removals; i++)
+            delete expired[i]; // along with the datagrams it held
+
+        for(unsigned int i = 0; i < requests; i++)
+            arp->send(REQUEST, has[i], pas[i]);
+    }
+
+    // update() may run in an ISR (i.e. without deferred receive), so the interrupt state is restored, not just enabled
     void lock() {
-        CPU::int_disable();
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
         if(Traits<System>::multicore)
             _lock.acquire();
+        _disabled = disabled;
     }
 
     void unlock() {
+        bool disabled = _disabled;
         if(Traits<System>::multicore)
             _lock.release();
-        CPU::int_enable();
+        if(!disabled)
+            CPU::int_enable();
     }
 
 private:
     Table _table;
+    unsigned int _entries;
     Spin _lock;
+    bool _disabled; // interrupt state before lock()
     NIC * _nic;
     Network * _net;
+    Semaphore _ticks; // elapsed, not yet handled by the ager
+    Semaphore_Handler _handler;
+    Alarm * _alarm;
+    Thread * _ager;
 };
 
 __END_SYS
@@ -63,6 +63,13 @@ public:
             DF = 2  // Don't Fragment
         };
 
+        // 16-bit words for incremental checksum updates (see sum(i, old))
+        enum {
+            LENGTH          = 1,
+            FRAGMENT        = 3, // flags and offset
+            TTL_PROTOCOL    = 4
+        };
+
     public:
         Header() {}
         Header(const Address & from, const Address & to, const Protocol & prot, unsigned int size) :
@@ -90,14 +97,18 @@ public:
         }
 
         unsigned char ttl() { return _ttl; }
+        void ttl(unsigned char t) { _ttl = t; }
 
         const Protocol & protocol() const { return _protocol; }
 
         unsigned short checksum() const { return ntohs(_checksum); }
 
         void sum() { _checksum = 0; _checksum = htons(IP::checksum(reinterpret_cast<unsigned char *>(this), _ihl * 4)); }
+        void sum(unsigned int i, unsigned short old) { _checksum = htons(IP::update(ntohs(_checksum), old, word(i))); } // after the i-th word changed from old
         bool check() { return (IP::checksum(reinterpret_cast<unsigned char *>(this), _ihl * 4) != 0xffff); }
 
+        unsigned short word(unsigned int i) const { unsigned short w; memcpy(&w, reinterpret_cast<const unsigned char *>(this) + i * sizeof(short), sizeof(short)); return ntohs(w); }
+
         const Address & from() const { return _from; }
         void from(const Address & from){ _from = from; }
 
@@ -181,80 +192,177 @@ public:
 
     typedef Packet PDU;
 
-private:
-    // Fragment key = f(from, id) = (from & ~_netmask) << 16 | id (fragmentation can only happen on localnet)
-    typedef unsigned long Key;
+    // Zero-copy view of the payload of a received (possibly reassembled) datagram
+    // Slices point straight into the NIC buffers of the pool, which are lent to the holder of the view until release()
+    class View
+    {
+    public:
+        static const unsigned int MAX_SLICES = (MTU + MFS - 1) / MFS;
+
+        struct Slice
+        {
+            const unsigned char * data;
+            unsigned int size;
+        };
+
+    public:
+        View(): _pool(0), _slices(0), _size(0) {}
+        View(Buffer * pool, unsigned int header); // header = transport header size, present only in the first fragment
+        ~View() { release(); }
+
+        operator bool() const { return _pool; }
+
+        const void * data() const { return _slices ? _slice[0].data : 0; } // first slice only
+        unsigned int size() const { return _size; }
+
+        unsigned int slices() const { return _slices; }
+        const Slice & operator[](unsigned int i) const { return _slice[i]; }
+
+        unsigned int copy(void * data, unsigned int size) const; // gather at most size bytes into data
+        void skip(unsigned int size); // drop the first size bytes (e.g. already consumed by the caller)
+        void release();
+        Buffer * detach(); // stop borrowing the pool without giving it back, the caller becomes responsible for it
+
+    private:
+        View(const View &);
+        View & operator=(const View &);
+
+    private:
+        Buffer * _pool;
+        unsigned int _slices;
+        unsigned int _size;
+        Slice _slice[MAX_SLICES];
+    };
+
+    // Scatter list of a caller's message, gathered into transmit buffers by Gather
+    struct IO_Vector
+    {
+        const void * data;
+        unsigned int size;
+    };
+
+    // Cursor over a scatter list that copies and checksums in a single pass over the data
+    class Gather
+    {
+    public:
+        Gather(const IO_Vector * iov, unsigned int count);
+
+        unsigned int size() const { return _size; } // of the whole list
+
+        unsigned int copy(void * data, unsigned int size); // next (at most) size bytes of the list into data
+        unsigned long sum() const { return _sum; } // unfolded 16-bit one's complement sum of the bytes copied so far
 
-    // List to hold received Buffers containing datagram fragments
-    class Fragmented;
-    typedef Simple_Hash<Fragmented, Traits<Build>::NODES, Key> Reassembling;
+    private:
+        const IO_Vector * _iov;
+        unsigned int _count;
+        unsigned int _offset;
+        unsigned int _copied;
+        unsigned int _size;
+        unsigned long _sum;
+    };
 
+private:
+    // A datagram being reassembled, whose fragments are chained in offset order as they arrive
     class Fragmented
     {
         friend class IP;
 
     private:
         static const unsigned int MAX_FRAGMENTS = (MTU + MFS - 1) / MFS; // 45 for Ethernet
-        typedef Reassembling::Element Element;
 
     public:
-        Fragmented(const Key & key): _frags(MAX_FRAGMENTS), _handler(&timeout, this), _alarm(TIMEOUT, &_handler), _link(this, key) {}
-
-        void insert(Buffer * buf) {
-            Packet * packet = buf->frame()->data<Packet>();
-
-            if(_bitmap.set(packet->offset() / MFS)) // if not a dup, then insert
-                _list.insert(buf->link());
+        Fragmented(): _id(0), _protocol(0), _frags(0), _age(0), _head(0), _tail(0) {}
+
+        bool free() const { return !_head; }
+        bool match(const Packet * packet) const { return (packet->from() == _from) && (packet->id() == _id) && (packet->protocol() == _protocol); }
+
+        void acquire(const Packet * packet, unsigned int age) {
+            _from = packet->from();
+            _id = packet->id();
+            _protocol = packet->protocol();
+            _frags = MAX_FRAGMENTS;
+            _age = age;
+            _bitmap = Bitmap<MAX_FRAGMENTS>();
+        }
 
-            if(!(packet->flags() & Header::MF))
-                _frags = (packet->offset() + MFS) / MFS;
+        bool insert(Buffer * buf); // false for duplicates
+        bool reassembled() const { return _bitmap.full(_frags); }
+        bool age() { return !_age || !--_age; } // true once expired
 
-            db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
+        Buffer * release() { // the chained fragments are the datagram's pool
+            Buffer * pool = _head->object();
+            _head = _tail = 0;
+            return pool;
         }
 
-        bool reassembled() const { return _bitmap.full(_frags); }
+    private:
+        Address _from;
+        unsigned short _id;
+        Protocol _protocol;
+        unsigned int _frags;
+        unsigned int _age; // in sweeps
+        Bitmap<MAX_FRAGMENTS> _bitmap;
+        Buffer::Element * _head;
+        Buffer::Element * _tail;
+    };
 
-        void reorder();
+    // Fixed-capacity reassembly table, swept by a single timer
+    class Reassembling
+    {
+    public:
+        static const unsigned int ENTRIES = Traits<IP>::REASSEMBLIES;
+        static const unsigned int PER_SOURCE = Traits<IP>::REASSEMBLIES_PER_SOURCE; // against fragment floods
+        static const unsigned int SWEEP = 1000000; // us
+        static const unsigned int AGE = (TIMEOUT + SWEEP - 1) / SWEEP; // in sweeps
 
-        Buffer * pool() { return _list.head()->object(); }
+    public:
+        Buffer * insert(Buffer * buf); // the whole datagram once its last fragment arrives, 0 otherwise
 
-        Element * link() { return &_link; }
+        void sweep(); // expires stale datagrams, once per SWEEP
 
     private:
-        static void timeout(Fragmented * frag) {
-            frag->pool()->nic()->free(frag->pool());
-            delete frag;
+        // The sweeper runs at the timer interrupt and the receiving threads possibly on other CPUs
+        void lock() {
+            bool disabled = CPU::int_disabled();
+            if(!disabled)
+                CPU::int_disable();
+            if(Traits<System>::multicore)
+                _lock.acquire();
+            _disabled = disabled;
+        }
+
+        void unlock() {
+            bool disabled = _disabled;
+            if(Traits<System>::multicore)
+                _lock.release();
+            if(!disabled)
+                CPU::int_enable();
         }
 
     private:
-        unsigned int _frags;
-        Bitmap<MAX_FRAGMENTS> _bitmap;
-        Buffer::List _list;
-        Functor_Handler<Fragmented> _handler;
-        Alarm _alarm;
-        Element _link;
+        Fragmented _table[ENTRIES];
+        Spin _lock;
+        bool _disabled; // interrupt state before lock()
     };
 
-
+public:
     class Router;
 
     class Route
     {
         friend class Router;
 
-    private:
-        typedef Simple_List<Route> Table;
-        typedef Table::Element Element;
-
     public:
         Route(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0):
-            _destination(d), _gateway(g), _genmask(m), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _link(this) {}
+            _destination(d), _gateway(g), _genmask(m), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _spare(0) {}
 
         const Address & gateway() const { return _gateway; }
         NIC<Ethernet> * nic() { return _nic; }
         IP * ip() { return _ip; }
         ARP<NIC<Ethernet>, IP> * arp() { return _arp; }
 
+        const Address & hop(const Address & to) const { return (_gateway == _ip->address()) ? to : _gateway; } // whose MAC frames go to
+
         friend Debug & operator<<(Debug & db, const Route & r) {
             db << "{d=" << r._destination
                 << ",g=" << r._gateway
@@ -277,53 +385,89 @@ private:
         IP * _ip;
         ARP<NIC<Ethernet>, IP> * _arp;
 
-        Element _link;
+        Route * _spare; // next in the Router's list of retired routes
     };
 
 
+    // Routes are kept in a path-compressed binary trie keyed by destination prefix, so search() finds the longest
+    // matching prefix visiting at most one node per prefix bit, no matter how many routes there are or in which order
+    // they were inserted. Inserting a prefix already in the table replaces its route.
+    // Lookups run on the receiving threads (possibly on other CPUs) and hand routes out, so the trie is guarded by a Spin
+    // and replaced or removed routes and nodes are never deleted, but retired to be recycled by later insertions.
     class Router
     {
     private:
-        typedef Route::Table::Element Element;
+        struct Node
+        {
+            Node(unsigned int p, unsigned int l, Route * r): prefix(p), length(l), route(r) { child[0] = child[1] = 0; }
+
+            unsigned int prefix; // host order, bits past length are zero
+            unsigned int length;
+            Route * route; // 0 if the node only branches
+            Node * child[2];
+        };
 
     public:
-        void insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0) {
-            Route * route = new (SYSTEM) Route(nic, ip, arp, d, g, m, t, w);
+        Router(): _root(0), _routes(0), _spare_nodes(0), _spare_routes(0) {}
 
-            db<IP>(TRC) << "IP::Router::insert() => " << *route << endl;
+        void insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0);
+        void remove(const Address & to); // the route search(to) would return
 
-            _table.insert(&route->_link);
-        }
+        Route * search(const Address & to) {
+            db<IP>(TRC) << "IP::Router::search(to=" << to << ")" << endl;
 
-        void remove(const Address & to) {
-            db<IP>(TRC) << "IP::Router::remove(to=" << to << ")" << endl;
+            unsigned int a = bits(to);
+            Route * route = 0;
+            lock();
+            for(Node * n = _root; n && !((a ^ n->prefix) & mask(n->length)); n = (n->length < 32) ? n->child[bit(a, n->length)] : 0)
+                if(n->route)
+                    route = n->route;
+            unlock();
 
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Router::remove: removing and deleting " << *e->object() << endl;
+            if(route)
+                db<IP>(INF) << "IP::Router::search: found route to " << to << " => " << *route << endl;
 
-                _table.remove(e);
-                delete e->object();
-            }
+            return route;
         }
 
-        Route * search(Address to) {
-            // Assume default (0.0.0.0) to have genmask 0.0.0.0 and be the last route in table
-            // Assume all routes to be network routes (i.g. flags "G")
-            db<IP>(TRC) << "IP::Route::search(to=" << to << ")" << endl;
-
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Route::search: found route to " << to << " => " << *e->object() << endl;
-                return e->object();
-            } else
-                return 0;
+        unsigned int routes() const { return _routes; }
+
+    private:
+        static unsigned int bits(const Address & a) { return (static_cast<unsigned int>(a[0]) << 24) | (a[1] << 16) | (a[2] << 8) | a[3]; }
+        static unsigned int mask(unsigned int length) { return length ? ~0U << (32 - length) : 0; }
+        static unsigned int bit(unsigned int a, unsigned int i) { return (a >> (31 - i)) & 1; } // i-th most significant
+        static unsigned int common(unsigned int a, unsigned int b) { return (a == b) ? 32 : __builtin_clz(a ^ b); } // leading bits
+
+        // Called with the lock held
+        Node * node(unsigned int prefix, unsigned int length, Route * route);
+        Route * route(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t, unsigned int w);
+        void retire(Node * n) { n->child[0] = _spare_nodes; _spare_nodes = n; }
+        void retire(Route * r) { r->_spare = _spare_routes; _spare_routes = r; }
+
+        void lock() {
+            bool disabled = CPU::int_disabled();
+            if(!disabled)
+                CPU::int_disable();
+            if(Traits<System>::multicore)
+                _lock.acquire();
+            _disabled = disabled;
+        }
+
+        void unlock() {
+            bool disabled = _disabled;
+            if(Traits<System>::multicore)
+                _lock.release();
+            if(!disabled)
+                CPU::int_enable();
         }
 
     private:
-        Route::Table _table;
+        Node * _root;
+        unsigned int _routes;
+        Node * _spare_nodes; // linked by child[0]
+        Route * _spare_routes;
+        Spin _lock;
+        bool _disabled; // interrupt state before lock()
     };
 
 
@@ -358,13 +502,27 @@ public:
     }
 
     static Route * route(const Address & to) { return _router.search(to); }
+    static unsigned long unroutable() { return _unroutable; }
 
     static Buffer * alloc(const Address & to, const Protocol & prot, unsigned int once, unsigned int payload);
     static int send(Buffer * buf);
+    static int post(Buffer * buf); // like send(), but the NIC is only notified at flush()
+    static void flush();
 
     static const unsigned int mtu() { return MTU; }
 
+    // Internet checksum (RFC 1071)
     static unsigned short checksum(const void * data, unsigned int size);
+    static unsigned long sum(const void * data, unsigned int size); // 16-bit one's complement sum, not complemented, to be accumulated
+    static unsigned long copy_and_sum(void * to, const void * from, unsigned int size, bool odd = false); // odd: from starts at an odd byte of the sum
+
+    // Incremental update of a checksum after a 16-bit word it covers changed from old to now (RFC 1624, eqn. 3)
+    static unsigned short update(unsigned short checksum, unsigned short old, unsigned short now) {
+        unsigned long sum = static_cast<unsigned short>(~checksum) + static_cast<unsigned short>(~old) + now;
+        sum = (sum & 0xffff) + (sum >> 16);
+        sum = (sum & 0xffff) + (sum >> 16);
+        return ~sum;
+    }
 
     static void attach(Observer * obs, const Protocol & prot) { _observed.attach(obs, prot); }
     static void detach(Observer * obs, const Protocol & prot) { _observed.detach(obs, prot); }
@@ -386,9 +544,21 @@ private:
     void config_by_dhcp();
 
     void update(Ethernet::Observed * obs, const Ethernet::Protocol & prot, Buffer * buf);
+    void forward(Buffer * buf); // transit datagrams, when Traits<IP>::forwarding
+
+    // This network (0/8), loopback (127/8), multicast (224/4) and reserved (240/4) addresses (RFC 1812, 4.2.2.11)
+    static bool martian(const Address & a) { return (a[0] == 0) || (a[0] == 127) || (a[0] >= 224); }
+
+    static unsigned long fold(unsigned long long sum);
 
     static bool notify(const Protocol & prot, Buffer * buf) { return _observed.notify(prot, buf); }
 
+    static void sweep() { _reassembling.sweep(); }
+
+    // Datagrams to next hops still being resolved are built in frames from the system heap and held by ARP
+    static Buffer * hold(NIC<Ethernet> * nic, unsigned int once, unsigned int payload);
+    static int defer(Buffer * buf);
+
     template<unsigned int UNIT>
     inline static void init_helper() {
         NIC<Ethernet> * nic = Traits<Ethernet>::DEVICES::Get<Traits<IP>::NICS[UNIT]>::Result::get(Traits<IP>::NICS[UNIT]);
@@ -411,7 +581,10 @@ protected:
     static IP * _networks[UNITS];
     static Router _router;
     static Reassembling _reassembling;
+    static Function_Handler _sweeper_handler;
+    static Alarm * _sweeper;
     static Observed _observed; // shared by all IP instances, so the default for binding on a port is for all IPs
+    static volatile unsigned long _unroutable; // datagrams dropped for lack of a route, either forwarded or held while their next hop was resolved
 };
 
 template<>
@@ -11,6 +11,9 @@
 #include <network/ipv4/udp.h> // TCP::Address == UDP_Address
 #include <utility/handler.h>
 #include <utility/random.h>
+#include <utility/convert.h>
+#include <utility/hash.h>
+#include <architecture/tsc.h>
 #include <time.h>
 #include <synchronizer.h>
 
@@ -28,7 +31,36 @@ public:
 
     static const unsigned int RETRIES = Traits<TCP>::RETRIES;
     static const unsigned int TIMEOUT = Traits<TCP>::TIMEOUT * 1000000;
-    static const unsigned int WINDOW = Traits<TCP>::WINDOW;
+    static const unsigned int WINDOW = Traits<TCP>::WINDOW; // receive buffer per connection, in bytes
+
+private:
+    // Smallest RFC 7323 shift that makes W fit in the 16-bit window field
+    template<unsigned int W, unsigned int S = 0>
+    struct Scale { static const unsigned int Result = ((W >> S) <= 0xffff) ? S : Scale<W, S + 1>::Result; };
+    template<unsigned int W>
+    struct Scale<W, 14> { static const unsigned int Result = 14; };
+
+public:
+    static const unsigned int SCALE = Scale<WINDOW>::Result;
+
+    // Delayed ACKs (RFC 1122), in us
+    static const unsigned int ACK_DELAY = 200000;
+
+    // Retransmission timeout bounds (RFC 6298), in us
+    static const unsigned int RTO_INITIAL = 1000000;
+    static const unsigned int RTO_MIN = 200000;
+
+    // Timer wheel shared by all connections: us per tick and slots per turn (timers farther away stay for more turns)
+    static const unsigned int TICK = 10000;
+    static const unsigned int SLOTS = 256;
+
+    // Connection table, hashed by the 4-tuple
+    static const unsigned int BUCKETS = 256;
+
+    // Keepalive (RFC 1122), only for connections that enable it, in s
+    static const unsigned int KEEPALIVE_IDLE = 7200;
+    static const unsigned int KEEPALIVE_INTERVAL = 75;
+    static const unsigned int KEEPALIVE_PROBES = 9;
 
     typedef IP::Buffer Buffer;
 
@@ -58,6 +90,16 @@ public:
             CWR = 0x80
         };
 
+        // Options
+        enum {
+            EOL = 0,
+            NOP = 1,
+            WINDOW_SCALE = 3,
+            SACK_PERMITTED = 4,
+            SACK = 5
+        };
+        static const unsigned int MAX_OPTIONS = 40;
+
     public:
         Header() {}
         Header(const Port & from, const Port & to, unsigned int sequence, unsigned short window)
@@ -71,6 +113,9 @@ public:
         unsigned int flags() const { return _flags; }
         unsigned int window() const { return ntohs(_window); }
 
+        unsigned int size() const { return _data_offset * 4; } // including options
+        void size(unsigned int s) { _data_offset = s / 4; }
+
         unsigned short checksum() const { return ntohs(_checksum); }
 
         friend OStream & operator<<(OStream & db, const Header & h) {
@@ -98,6 +143,10 @@ public:
     static const unsigned int MSS = IP::MFS - sizeof(Header);
     static const unsigned int HEADERS_SIZE = sizeof(IP::Header) + sizeof(Header);
 
+    // Sequence numbers wrap around at 2^32, so they are compared by the sign of their difference (RFC 1982)
+    static bool seq_lt(unsigned int a, unsigned int b) { return static_cast<int>(a - b) < 0; }
+    static bool seq_leq(unsigned int a, unsigned int b) { return static_cast<int>(a - b) <= 0; }
+
     typedef unsigned char Data[MTU];
 
     class Segment: public Header
@@ -108,9 +157,13 @@ public:
         Header * header() { return this; }
 
         template<typename T>
-        T * data() { return reinterpret_cast<T *>(&_data); }
+        T * data() { return reinterpret_cast<T *>(reinterpret_cast<unsigned char *>(this) + size()); }
+
+        unsigned char * options() { return reinterpret_cast<unsigned char *>(this) + sizeof(Header); }
+        const unsigned char * option(unsigned char kind); // the option's first byte, 0 if absent
 
         void sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int length);
+        void sum(const IP::Address & from, const IP::Address & to, unsigned long data, unsigned int length); // of data already summed
         bool check(unsigned int length) { return IP::checksum(this, length) != 0xffff; } // FIXME
 
         friend Debug & operator<<(Debug & db, const Segment & m) {
@@ -123,6 +176,28 @@ public:
     } __attribute__((packed));
 
 
+    // A timer of the shared wheel, whose handler runs at the tick's interrupt, like an Alarm's
+    class Timer
+    {
+        friend class TCP;
+
+    public:
+        typedef List_Elements::Doubly_Linked<Timer> Element;
+
+    public:
+        Timer(Handler * h): _handler(h), _expiry(0), _armed(false), _link(this) {}
+        ~Timer() { TCP::disarm(this); }
+
+        bool armed() const { return _armed; }
+
+    private:
+        Handler * _handler;
+        unsigned int _expiry; // in ticks
+        volatile bool _armed;
+        Element _link;
+    };
+
+
     class Connection: public Header, private TCP::Observer, public TCP::Observed
     {
         friend class TCP;
@@ -144,21 +219,62 @@ public:
 
         typedef void (Connection:: * State_Handler)();
 
+        typedef List_Elements::Singly_Linked_Ordered<Connection, unsigned int> Element; // in TCP's table
+
+        // Congestion control (RFC 5681 and RFC 6582)
+        static const unsigned int INITIAL_WINDOW = (MSS > 2190) ? 2 * MSS : (MSS > 1095) ? 3 * MSS : 4 * MSS;
+        static const unsigned int INITIAL_THRESHOLD = 65535;
+        static const unsigned int DUPLICATES = 3; // duplicate ACKs that trigger a fast retransmit
+
+        // Selective acknowledgments (RFC 2018)
+        static const unsigned int SACK_BLOCKS = 3; // per ACK, together with timestamps there would be room for 3 only
+        static const unsigned int QUEUE = WINDOW / MSS + 1; // out-of-order segments held by the receiver
+
+        // Receive buffering
+        static const unsigned int RING = QUEUE + 1; // segments not yet read by the application, including those in _queue
+
+        struct Block {
+            unsigned int left;
+            unsigned int right;
+        };
+
     public:
         Connection(const Address & from, const Address & to)
-        : Header(from.port(), to.port(), Random::random() & 0x00ffffff, WINDOW), _peer(to.ip()), _peer_window(0), _next(ntohl(_sequence)),
-          _unacknowledged(_next), _initial(_next), _state(CLOSED), _handler(&Connection::closed), _current(0), _length(0), _valid(false),
-          _streaming(false), _retransmiting(false), _timeout_handler(&timeout,this), _alarm(0), _tries(0), _observer(0) {}
-        ~Connection() { if(_alarm) delete _alarm; close(); }
+        : Header(from.port(), to.port(), Random::random() & 0x00ffffff, (WINDOW > 0xffff) ? 0xffff : WINDOW), _peer(to.ip()), _peer_window(0), _next(ntohl(_sequence)),
+          _max(_next), _unacknowledged(_next), _initial(_next), _state(CLOSED), _handler(&Connection::closed), _current(0), _length(0), _valid(false),
+          _streaming(false), _retransmit(false), _recovering(false), _progress(0), _retransmission_handler(&expired, this),
+          _retransmission(&_retransmission_handler), _congestion(INITIAL_WINDOW), _threshold(INITIAL_THRESHOLD),
+          _recover(0), _duplicates(0), _last(0), _srtt(0), _rttvar(0), _rto(RTO_INITIAL), _timing(false), _timed(0), _sent(0),
+          _sack(false), _sacks(0), _queued(0), _head(0), _used(0), _offset(0), _buffered(0), _advertised(0), _scale(0), _peer_scale(0),
+          _readable(0), _waiting(false), _pending(0), _delayed_handler(&delayed, this), _delayed(&_delayed_handler), _keepalive(false), _probes(0),
+          _keepalive_handler(&idle, this), _keeper(&_keepalive_handler), _timeout_handler(&timeout,this), _timer(&_timeout_handler), _tries(0), _observer(0), _users(0), _link(this) {
+            for(unsigned int i = 0; i < QUEUE; i++)
+                _queue[i] = 0;
+            for(unsigned int i = 0; i < RING; i++)
+                _ring[i] = 0;
+        }
+        ~Connection() {
+            TCP::disarm(&_timer);
+            close();
+            for(unsigned int i = 0; i < QUEUE; i++)
+                if(_queue[i])
+                    _queue[i]->nic()->free(_queue[i]);
+            for(unsigned int i = 0; i < RING; i++)
+                if(_ring[i])
+                    _ring[i]->nic()->free(_ring[i]);
+        }
 
         const volatile State & state() const { return _state; }
         const Header * header() const { return this; }
 
         int write(const void * data, unsigned int size);
-        int read(Buffer * buf, void * data, unsigned int size);
+        int read(void * data, unsigned int size); // blocks until some data arrives, returns 0 once the peer closed the connection
+        int read(IP::View * view); // zero-copy: view borrows the next received segment until view->release()
 
         const IP::Address & peer() const { return _peer; }
 
+        void keepalive(bool enable); // probes an idle connection and closes it if the peer is gone
+
         Connection_Id id() const {
             Connection_Id tmp = _peer[0] << 24 | _peer[1] << 16 | _peer[2] << 8 | _peer[3];
             tmp = (tmp << 32) | ((to() << 16) | from());
@@ -183,7 +299,8 @@ public:
 
         friend Debug & operator<<(Debug & db, const Connection & c) {
             db << *c.header()
-               << ",peer=" << c._peer << ",pwin=" << c._peer_window << ",uack=" << ntohl(c._unacknowledged) << ",stat=" << c._state;
+               << ",peer=" << c._peer << ",pwin=" << c._peer_window << ",uack=" << c._unacknowledged << ",stat=" << c._state
+               << ",cwnd=" << c._congestion << ",ssth=" << c._threshold << ",rto=" << c._rto;
             if(c._current)
                 db << ",curr=" << c._current << " => " << *c._current << ",len=" << c._length;
             return db;
@@ -193,6 +310,7 @@ public:
         void state(const State & s) {
             _state = s;
             _handler = _handlers[s];
+            wake(); // readers return once no more data can arrive
         }
 
         void update(TCP::Observed * osb, const Connection_Id & cid, Buffer * buf);
@@ -216,18 +334,64 @@ public:
         void closed();
 
         void fsend(const Flags & flags);
-        int dsend(const void * data, unsigned int size);
+        int dsend(unsigned int sequence, const void * data, unsigned int size, bool batch = false, bool push = false);
+        int dsend(unsigned int sequence, const IP::IO_Vector * iov, unsigned int count, bool batch = false, bool push = false);
 
         bool check_sequence();
         void process_fin();
 
+        // Sliding window
+        void process_ack();
+        void measure(unsigned int rtt);
+        unsigned int sacked(unsigned int sequence) const;
+        unsigned int limit(unsigned int sequence, unsigned int end) const;
+
+        // Reassembly and receive buffering
+        bool enqueue(Buffer * pool);
+        void dequeue();
+        unsigned int blocks(Block * list) const;
+        bool deliver(Buffer * pool);
+        bool readable();
+        void consumed(unsigned int size);
+        void wake(); // the reader waiting in readable(), if any
+        unsigned int space() const;
+        void advertise();
+        void acknowledge();
+        void scale();
+        static void delayed(Connection * c);
+
+        static void expired(Connection * c);
+        static void idle(Connection * c);
+
+        static Segment * segment(Buffer * pool) { return pool->frame()->data<Packet>()->data<Segment>(); }
+        static unsigned int length(Buffer * pool) { return pool->size() - sizeof(IP::Header) - segment(pool)->size(); }
+        static unsigned int since(const TSC::Time_Stamp & ts) { return Convert::count2us<Hertz, TSC::Time_Stamp, unsigned long long>(TSC::frequency(), TSC::time_stamp() - ts); }
+
         static void timeout(Connection * c);
         void set_timeout(const Microsecond & time = TIMEOUT);
 
+        void lock() {
+            bool disabled = CPU::int_disabled();
+            if(!disabled)
+                CPU::int_disable();
+            if(Traits<System>::multicore)
+                _lock.acquire();
+            _disabled = disabled;
+        }
+
+        void unlock() {
+            bool disabled = _disabled;
+            if(Traits<System>::multicore)
+                _lock.release();
+            if(!disabled)
+                CPU::int_enable();
+        }
+
     private:
         IP::Address _peer;
-        unsigned short  _peer_window;   // (host endianness)
+        unsigned int _peer_window;      // already scaled (host endianness)
         unsigned int _next;             // next regular sequence number to be sent, it tells how far the conversation has gone (host endianness)
+        unsigned int _max;              // highest sequence number sent, _next goes back to _unacknowledged on a retransmission timeout (host endianness)
         unsigned int _unacknowledged;   // earliest unacknowledged sequence number sent (host endianness)
         const unsigned int _initial;    // initial sequence number (host endianness)
 
@@ -243,26 +407,83 @@ public:
 
         // Stream stuff
         volatile bool _streaming;
-        volatile bool _retransmiting;
+        volatile bool _retransmit;      // the segment at _unacknowledged must be sent again (fast retransmit or partial ACK)
+        volatile bool _recovering;      // in NewReno fast recovery
+        volatile unsigned int _progress; // ACKs that advanced _unacknowledged
         Condition _stream;
-
-        // Timeout stuff
+        Functor_Handler<Connection> _retransmission_handler;
+        Timer _retransmission;          // wakes write() up when the RTO expires
+
+        // Congestion control
+        unsigned int _congestion;       // cwnd
+        unsigned int _threshold;        // ssthresh
+        unsigned int _recover;          // _max when fast recovery started
+        unsigned int _duplicates;
+        TSC::Time_Stamp _last;          // when the retransmission timer was (re)started
+
+        // Round-trip time estimation (Jacobson/Karels), in us
+        unsigned int _srtt;
+        unsigned int _rttvar;
+        unsigned int _rto;
+        bool _timing;                   // a segment is being timed (Karn's algorithm never times retransmissions)
+        unsigned int _timed;            // sequence number whose acknowledgment ends the measurement
+        TSC::Time_Stamp _sent;
+
+        // Selective acknowledgments
+        bool _sack;                     // the peer sent SACK-permitted in its SYN
+        Block _sacked[SACK_BLOCKS];     // ranges above _unacknowledged the peer reported to hold
+        unsigned int _sacks;
+        Buffer * _queue[QUEUE];         // out-of-order segments received
+        unsigned int _queued;
+
+        // Receive buffering
+        Buffer * _ring[RING];           // in-order segments, from _head on
+        unsigned int _head;
+        unsigned int _used;
+        unsigned int _offset;           // bytes of the segment at _head already read
+        unsigned int _buffered;         // bytes in _ring not yet read
+        unsigned int _advertised;       // right edge of the last window advertised
+        unsigned int _scale;            // shift applied to the windows we advertise (SCALE if the peer agreed, 0 otherwise)
+        unsigned int _peer_scale;       // shift applied to the windows the peer advertises
+        Semaphore _readable;            // v()ed once per wait, so a segment delivered from another CPU before the reader sleeps is not missed
+        bool _waiting;                  // a reader is (about to be) waiting on _readable
+        Spin _lock;                     // of the ring, shared by the readers and the receiving thread
+        bool _disabled;                 // interrupt state before lock()
+
+        // Delayed ACK
+        volatile unsigned int _pending; // segments received but not acknowledged yet
+        Functor_Handler<Connection> _delayed_handler;
+        Timer _delayed;
+
+        // Keepalive
+        bool _keepalive;
+        volatile unsigned int _probes;  // sent since the last segment received
+        Functor_Handler<Connection> _keepalive_handler;
+        Timer _keeper;
+
+        // Timeout stuff (connect, close and TIME-WAIT)
         Functor_Handler<Connection> _timeout_handler;
-        Alarm * _alarm;
+        Timer _timer;
         volatile int _tries; // either for close() or open() calls
 
         TCP::Observer * _observer;
+        volatile unsigned int _users;   // receivers dispatching a segment to it (see TCP::search())
+        Element _link;
     };
 
+    typedef Hash<Connection, BUCKETS, unsigned int, Connection::Element> Table;
+
 protected:
     TCP() {
         db<TCP>(TRC) << "TCP::TCP()" << endl;
         IP::attach(this, IP::TCP);
+        _clock = new (SYSTEM) Alarm(TICK, &_tick_handler, INFINITE);
     }
 
 public:
     ~TCP() {
         db<TCP>(TRC) << "TCP::~TCP()" << endl;
+        delete _clock;
         IP::detach(this, IP::TCP);
     }
 
@@ -270,9 +491,8 @@ public:
         db<TCP>(TRC) << "TCP::attach(obs=" << obs << ",from=" << from << ",to=" << to << ")" << endl;
 
         Connection * conn = new Connection(from, to);
-        Connection_Id id = conn->id();
         conn->attach(obs);
-        _observed.attach(conn, id);
+        insert(conn);
 
         if(to)
             for(unsigned int i = 0; (i < RETRIES) && (conn->state() != Connection::ESTABLISHED); i++)
@@ -281,7 +501,8 @@ public:
             conn->listen();
 
         if(conn->state() != Connection::ESTABLISHED) {
-            delete conn;
+            conn->close();
+            destroy(conn);
             conn = 0;
         }
 
@@ -289,21 +510,49 @@ public:
     }
 
     static void detach(Observer * obs, Connection * conn) {
-        Connection_Id id = conn->id();
         conn->detach(obs);
-        delete conn;
-        _observed.detach(conn, id);
+        conn->close(); // the peer's FIN and ACK must still find the connection
+        destroy(conn);
     }
 
+    // Fault injection: drops per_mille out of every 1000 incoming segments (e.g. to benchmark loss recovery)
+    static void loss(unsigned int per_mille) { _loss = per_mille; }
+
+    static void arm(Timer * t, unsigned int ticks);
+    static void disarm(Timer * t);
+    static unsigned int ticks(const Microsecond & time) { return (time + TICK - 1) / TICK; }
+
 private:
     void update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool);
 
+    // Connection table
+    static void insert(Connection * c);
+    static void remove(Connection * c);
+    static Connection * search(const Connection_Id & id); // the connection found is held until release()
+    static void release(Connection * c) { CPU::fdec(c->_users); }
+    static void destroy(Connection * c); // removes and deletes c once no receiver holds it
+    static unsigned int key(const Connection_Id & id) {
+        unsigned int k = static_cast<unsigned int>(id >> 32) ^ static_cast<unsigned int>(id); // peer ^ ports
+        k ^= k >> 16;
+        return k ^ (k >> 8); // every byte reaches the bucket index
+    }
+
+    static void tick();
+
     unsigned short mss(Buffer * buf) {
        return buf->nic()->mtu() - sizeof(IP::Header) - sizeof(Header);
     }
 
 private:
-    static Observed _observed; // Channel protocols are singletons
+    static Table _connections; // Channel protocols are singletons
+    static Spin _lock; // of _connections
+    static unsigned int _loss;
+
+    static List<Timer> _wheel[SLOTS];
+    static Spin _wheel_lock; // of _wheel, _ticks and the timers in it
+    static volatile unsigned int _ticks;
+    static Function_Handler _tick_handler;
+    static Alarm * _clock;
 };
 
 __END_SYS
@@ -108,6 +108,7 @@ public:
 
         void sum_header(const IP::Address & from, const IP::Address & to);
         void sum_data(const void * data, unsigned int size);
+        void sum_data(unsigned long sum); // of data already summed (e.g. by IP::Gather)
         void sum_trailer();
         bool check() { return Traits<UDP>::checksum ? (IP::checksum(this, length()) != 0xffff) : true; }
 
@@ -133,7 +134,9 @@ public:
     }
 
     static int send(const Address & from, const Address & to, const void * data, unsigned int size);
+    static int send(const Address & from, const Address & to, const IP::IO_Vector * iov, unsigned int count);
     static int receive(Buffer * buf, void * data, unsigned int size);
+    static int receive(Buffer * buf, IP::View * view); // zero-copy: view borrows buf until view->release()
 
     static void attach(Observer * obs, const Address & addr) { _observed.attach(obs, addr.port()); }
     static void detach(Observer * obs, const Address & addr) { _observed.detach(obs, addr.port()); }
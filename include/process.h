@@ -7,7 +7,9 @@
 #include <utility/queue.h>
 #include <utility/handler.h>
 #include <utility/scheduler.h>
+#include <utility/per_cpu.h>
 #include <memory.h>
+#include <latency.h>
 
 extern "C" { void __exit(); }
 
@@ -27,6 +29,8 @@ class Thread
     friend class System;                // for init()
     friend class IC;                    // for link() for priority ceiling
     friend class Clerk<System>;         // for _statistics
+    friend class Task;                  // for _task_link
+    friend class Monitor;               // for _thread_count
 
 protected:
     static const bool smp = Traits<Thread>::smp;
@@ -34,10 +38,15 @@ protected:
     static const bool preemptive = Traits<Thread>::Criterion::preemptive;
     static const bool multitask = Traits<System>::multitask;
     static const bool reboot = Traits<System>::reboot;
+    static const bool demand_paged = multitask && Traits<Thread>::demand_paged_stacks;
+    static const bool stack_watermark = Traits<Thread>::stack_watermark;
+    static const bool pmu_virtualized = monitored && Traits<Thread>::pmu_virtualized;
 
     static const unsigned int QUANTUM = Traits<Thread>::QUANTUM;
     static const unsigned int STACK_SIZE = multitask ? Traits<System>::STACK_SIZE : Traits<Application>::STACK_SIZE;
     static const unsigned int USER_STACK_SIZE = Traits<Application>::STACK_SIZE;
+    static const unsigned char STACK_PAINT = 0xa5;
+    static const unsigned int PMU_EVENTS = pmu_virtualized ? COUNTOF(Traits<Thread>::PMU_EVENTS) : 1;
 
     typedef CPU::Log_Addr Log_Addr;
     typedef CPU::Context Context;
@@ -55,6 +64,9 @@ public:
     // Thread Priority
     typedef Scheduling_Criteria::Priority Priority;
 
+    // PMU events counted per thread (see Traits<Thread>::PMU_EVENTS)
+    typedef Traits_Tokens::PMU_Event PMU_Event;
+
     // Thread Scheduling Criterion
     typedef Traits<Thread>::Criterion Criterion;
     enum {
@@ -73,44 +85,40 @@ public:
     // Thread Configuration
     // t = 0 => Task::self()
     // ss = 0 => user-level stack on an auto expand segment
+    // st != 0 => preallocated system-level stack of ss bytes (e.g. from a Thread_Pool), not released when the thread is deleted
     struct Configuration {
-        Configuration(const State & s = READY, const Criterion & c = NORMAL, const Color & a = WHITE, Task * t = 0, unsigned int ss = STACK_SIZE)
-        : state(s), criterion(c), color(a), task(t), stack_size(ss) {}
+        Configuration(const State & s = READY, const Criterion & c = NORMAL, const Color & a = WHITE, Task * t = 0, unsigned int ss = STACK_SIZE, char * st = 0)
+        : state(s), criterion(c), color(a), task(t), stack_size(ss), stack(st) {}
 
         State state;
         Criterion criterion;
         Color color;
         Task * task;
         unsigned int stack_size;
+        char * stack;
     };
 
     // Thread Statistics (mostly for Monitor)
     struct _Statistics {
-        _Statistics(): execution_time(0), last_execution(0), jobs(0), average_execution_time(0), hyperperiod_count_thread(0), hyperperiod_jobs(0), hyperperiod_average_execution_time(0), alarm_times(0), times_p_count(0), missed_deadlines(0) {}
+        _Statistics(): execution_time(0), last_execution(0), jobs(0), average_execution_time(0) {
+            for(unsigned int i = 0; i < PMU_EVENTS; i++)
+                pmu_events[i] = pmu_job_start[i] = pmu_job_events[i] = 0;
+        }
 
         // Thread Execution Time
         unsigned int execution_time;
         unsigned int last_execution;
         unsigned int jobs;
         unsigned int average_execution_time;
-        unsigned int hyperperiod_count_thread;
-        unsigned int hyperperiod_jobs;
-        unsigned int hyperperiod_average_execution_time;
-
-        // Dealine Miss count
-        Alarm * alarm_times;
-        unsigned int times_p_count;
-        unsigned int missed_deadlines;
 
-        // On Migration
-        static unsigned int hyperperiod[Traits<Build>::CPUS];              // recalculate, on _old_hyperperiod + hyperperiod update
-        static TSC::Time_Stamp last_hyperperiod[Traits<Build>::CPUS];      // wait for old hyperperiod and update
-        static unsigned int hyperperiod_count[Traits<Build>::CPUS];        // reset on next hyperperiod
+        // Virtualized PMU counters (only while the thread is running)
+        unsigned long long pmu_events[PMU_EVENTS];
+        unsigned long long pmu_job_start[PMU_EVENTS];
+        unsigned long long pmu_job_events[PMU_EVENTS];   // during the last job of a periodic thread
 
         // CPU Execution Time
-        static TSC::Time_Stamp hyperperiod_idle_time[Traits<Build>::CPUS]; //
-        static TSC::Time_Stamp idle_time[Traits<Build>::CPUS];
-        static TSC::Time_Stamp last_idle[Traits<Build>::CPUS];
+        static Per_CPU<TSC::Time_Stamp> idle_time;
+        static Per_CPU<TSC::Time_Stamp> last_idle;
     };
 
     union _Dummy_Statistics {
@@ -119,24 +127,15 @@ public:
         unsigned int last_execution;
         unsigned int jobs;
         unsigned int average_execution_time;
-        unsigned int hyperperiod_count_thread;
-        unsigned int hyperperiod_jobs;
-        unsigned int hyperperiod_average_execution_time;
 
-        // Dealine Miss count
-        Alarm * alarm_times;
-        unsigned int times_p_count;
-        unsigned int missed_deadlines;
-
-        // On Migration
-        static unsigned int hyperperiod[Traits<Build>::CPUS];              // recalculate, on _old_hyperperiod + hyperperiod update
-        static TSC::Time_Stamp last_hyperperiod[Traits<Build>::CPUS];      // wait for old hyperperiod and update
-        static unsigned int hyperperiod_count[Traits<Build>::CPUS];        // reset on next hyperperiod
+        // Virtualized PMU counters (only while the thread is running)
+        unsigned long long pmu_events[PMU_EVENTS];
+        unsigned long long pmu_job_start[PMU_EVENTS];
+        unsigned long long pmu_job_events[PMU_EVENTS];   // during the last job of a periodic thread
 
         // CPU Execution Time
-        static TSC::Time_Stamp hyperperiod_idle_time[Traits<Build>::CPUS]; //
-        static TSC::Time_Stamp idle_time[Traits<Build>::CPUS];
-        static TSC::Time_Stamp last_idle[Traits<Build>::CPUS];
+        static Per_CPU<TSC::Time_Stamp> idle_time;
+        static Per_CPU<TSC::Time_Stamp> last_idle;
     };
     typedef IF<monitored, _Statistics, _Dummy_Statistics>::Result Statistics;
 
@@ -165,6 +164,13 @@ public:
 
     Task * task() const { return _task; }
 
+    // Count of a PMU event in Traits<Thread>::PMU_EVENTS for this thread (whole lifetime or last job)
+    unsigned long long pmu_events(const PMU_Event & event, bool job = false) const;
+
+    // Stack high-water marks in bytes (system-level with stack_watermark, user-level with demand-paged stacks)
+    unsigned int stack_high_water() const;
+    unsigned int user_stack_high_water() const;
+
     int join();
     void pass();
     void suspend() { suspend(false); }
@@ -177,7 +183,7 @@ public:
     Criterion & criterion() { return const_cast<Criterion &>(_link.rank()); }
 
 protected:
-    void constructor_prologue(const Color & color, unsigned int stack_size);
+    void constructor_prologue(const Color & color, unsigned int stack_size, char * stack = 0);
     void constructor_epilogue(const Log_Addr & entry, unsigned int stack_size);
 
     Thread_Queue::Element * link() { return &_link; }
@@ -199,13 +205,17 @@ protected:
 
     static void lock() {
         CPU::int_disable();
+        Latency::begin(Latency::INTERRUPTS);
         if(smp)
             _lock.acquire();
+        Latency::begin(Latency::PREEMPTION);
     }
 
     static void unlock() {
+        Latency::end(Latency::PREEMPTION);
         if(smp)
             _lock.release();
+        Latency::end(Latency::INTERRUPTS);
         CPU::int_enable();
     }
 
@@ -228,20 +238,31 @@ protected:
 
     static int idle();
 
+    static bool stack_fault(const Log_Addr & address);
+
+    // Accumulate the PMU counts since the last call into t (with interrupts disabled)
+    static void pmu_charge(Thread * t);
+    static void pmu_job_end(Thread * t);
+
 private:
     static void init();
+    static void pmu_init();
 
 protected:
     Task * _task;
     Segment * _user_stack;
+    Log_Addr _user_stack_address;
 
     char * _stack;
+    unsigned int _stack_size;
+    bool _own_stack;
     Context * volatile _context;
     volatile State _state;
     Thread_Queue * _waiting;
     FIFO_Queue * _waiting_fifo;
     Thread * volatile _joining;
     Thread_Queue::Element _link;
+    Thread_Queue::Element _task_link;
 
     Statistics _statistics;
 
@@ -249,6 +270,8 @@ protected:
     static Scheduler_Timer * _timer;
     static Scheduler<Thread> _scheduler;
     static Spin _lock;
+    static Clerk<PMU> * _pmu_clerks[Traits<Build>::CPUS][PMU_EVENTS];
+    static Per_CPU<unsigned long long[PMU_EVENTS]> _pmu_base;
 };
 
 
@@ -311,8 +334,8 @@ public:
 private:
     void activate() const { _as->activate(); }
 
-    void insert(Thread * t) { _threads.insert(new (SYSTEM) Queue::Element(t)); }
-    void remove(Thread * t) { Queue::Element * el = _threads.remove(t); if(el) delete el; }
+    void insert(Thread * t) { _threads.insert(&t->_task_link); }
+    void remove(Thread * t) { _threads.remove(&t->_task_link); }
 
     static Task * volatile current() { return _current; }
     static void current(Task * t) { _current = t; }
@@ -363,10 +386,71 @@ private:
 };
 
 
+// A pool of N preallocated threads of type T (e.g. Thread, Periodic_Thread), each with a STACK_SIZE-bytes system-level stack of color COLOR
+// Threads created by the pool recycle its storage, stacks, contexts and task list elements, so spawning them does not touch the heap
+template<typename T, unsigned int N, unsigned int STACK_SIZE = (Traits<System>::multitask ? Traits<System>::STACK_SIZE : Traits<Application>::STACK_SIZE), Color COLOR = WHITE>
+class Thread_Pool
+{
+public:
+    typedef typename T::Configuration Configuration;
+
+public:
+    Thread_Pool() {
+        for(unsigned int i = 0; i < N; i++) {
+            if(Traits<MMU>::colorful && (COLOR != WHITE))
+                _stacks[i] = new (COLOR) char[STACK_SIZE];
+            else
+                _stacks[i] = new (SYSTEM) char[STACK_SIZE];
+            _busy[i] = 0;
+        }
+    }
+    ~Thread_Pool() {
+        for(unsigned int i = 0; i < N; i++)
+            delete _stacks[i];
+    }
+
+    // Returns 0 if all threads in the pool are in use
+    template<typename ... Tn>
+    T * create(const Configuration & conf, int (* entry)(Tn ...), Tn ... an) {
+        for(unsigned int i = 0; i < N; i++)
+            if(!CPU::tsl(_busy[i])) {
+                Configuration c = conf;
+                c.color = COLOR;
+                c.stack_size = STACK_SIZE;
+                c.stack = _stacks[i];
+                return new (&_threads[i]) T(c, entry, an ...);
+            }
+
+        db<Thread>(WRN) << "Thread_Pool::create(this=" << this << "): pool exhausted!" << endl;
+
+        return 0;
+    }
+    template<typename ... Tn>
+    T * create(int (* entry)(Tn ...), Tn ... an) { return create(Configuration(), entry, an ...); }
+
+    // Same semantics as deleting a thread (i.e. call join() first to wait for it to finish)
+    void destroy(T * t) {
+        unsigned int i = reinterpret_cast<Storage *>(t) - _threads;
+        assert(i < N);
+        t->~T();
+        _busy[i] = 0;
+    }
+
+    unsigned int size() const { return N; }
+
+private:
+    struct Storage { char data[sizeof(T)]; } __attribute__((aligned(8)));
+
+    Storage _threads[N];
+    char * _stacks[N];
+    volatile int _busy[N];
+};
+
+
 // Thread inline methods that depend on Task
 template<typename ... Tn>
 inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
-: _task(Task::self()), _user_stack(0), _state(READY), _waiting(0), _waiting_fifo(0), _joining(0), _link(this, NORMAL)
+: _task(Task::self()), _user_stack(0), _state(READY), _waiting(0), _waiting_fifo(0), _joining(0), _link(this, NORMAL), _task_link(this)
 {
     constructor_prologue(WHITE, STACK_SIZE);
     _context = CPU::init_stack(0, _stack + STACK_SIZE, &__exit, entry, an ...);
@@ -375,35 +459,46 @@ inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
 
 template<typename ... Tn>
 inline Thread::Thread(const Configuration & conf, int (* entry)(Tn ...), Tn ... an)
-: _task(conf.task ? conf.task : Task::self()), _state(conf.state), _waiting(0), _waiting_fifo(0), _joining(0), _link(this, conf.criterion)
+: _task(conf.task ? conf.task : Task::self()), _state(conf.state), _waiting(0), _waiting_fifo(0), _joining(0), _link(this, conf.criterion), _task_link(this)
 {
     if(multitask && !conf.stack_size) { // Auto-expand, user-level stack
         constructor_prologue(conf.color, STACK_SIZE);
-        _user_stack = new (SYSTEM) Segment(USER_STACK_SIZE);
 
-        // Attach the thread's user-level stack to the current address space so we can initialize it
-        Log_Addr ustack = Task::self()->address_space()->attach(_user_stack);
+        Log_Addr ustack;
+        if(demand_paged) {
+            // Only the highest page of a demand-paged stack is mapped at this point (the others are mapped by stack_fault()).
+            // It can be initialized through the physical memory window, so the stack needs not be attached to the current address space
+            _user_stack = new (SYSTEM) Segment(USER_STACK_SIZE, WHITE, Segment::Flags::APP | Segment::Flags::DP);
+            ustack = _user_stack->log_address(_user_stack->size() - 1) + 1 - _user_stack->size();
+        } else {
+            _user_stack = new (SYSTEM) Segment(USER_STACK_SIZE);
+
+            // Attach the thread's user-level stack to the current address space so we can initialize it
+            ustack = Task::self()->address_space()->attach(_user_stack);
+        }
 
         // Initialize the thread's user-level stack and determine a relative stack pointer (usp) from the top of the stack
-        Log_Addr usp = ustack + USER_STACK_SIZE;
+        Log_Addr usp = ustack + _user_stack->size();
         if(conf.criterion == MAIN)
             usp -= CPU::init_user_stack(usp, 0, an ...); // the main thread of each task must return to crt0 to call _fini (global destructors) before calling __exit
         else
             usp -= CPU::init_user_stack(usp, &__exit, an ...); // __exit will cause a Page Fault that must be properly handled
 
-        // Attach the thread's user-level stack from the current address space
-        Task::self()->address_space()->detach(_user_stack, ustack);
+        // Detach the thread's user-level stack from the current address space
+        if(!demand_paged)
+            Task::self()->address_space()->detach(_user_stack, ustack);
 
         // Attach the thread's user-level stack to its task's address space so it will be able to access it when it runs
         ustack = _task->address_space()->attach(_user_stack);
+        _user_stack_address = ustack;
 
         // Determine an absolute stack pointer (usp) from the top of the thread's user-level stack considering the address it will see it when it runs
-        usp = ustack + USER_STACK_SIZE - usp;
+        usp = ustack + _user_stack->size() - usp;
 
         // Initialize the thread's system-level stack
         _context = CPU::init_stack(usp, _stack + STACK_SIZE, &__exit, entry, an ...);
     } else {
-        constructor_prologue(conf.color, conf.stack_size);
+        constructor_prologue(conf.color, conf.stack_size, conf.stack);
         _user_stack = 0;
         _context = CPU::init_stack(0, _stack + conf.stack_size, &__exit, entry, an ...);
     }
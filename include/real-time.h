@@ -9,6 +9,7 @@
 #include <time.h>
 #include <process.h>
 #include <synchronizer.h>
+#include <governor.h>
 
 __BEGIN_SYS
 
@@ -32,13 +33,35 @@ public:
         ANY         = Scheduling_Criteria::RT_Common::ANY
     };
 
+    // Job Record (time stamps in TSC ticks)
+    struct Job {
+        TSC::Time_Stamp release;
+        TSC::Time_Stamp start;
+        TSC::Time_Stamp completion;
+        long long lateness; // completion - absolute deadline (> 0 => deadline miss)
+    };
+
+    // Deadline Miss Handler (called by wait_next() of the late thread)
+    typedef void (* Miss_Handler)(Periodic_Thread * t, const Job & job);
+
 protected:
+    static const unsigned int JOB_RECORDS = Traits<Thread>::JOB_RECORDS;
+
     // Alarm Handler for periodic threads under static scheduling policies
     class Static_Handler: public Semaphore_Handler
     {
     public:
-        Static_Handler(Semaphore * s, Periodic_Thread * t): Semaphore_Handler(s) {}
+        Static_Handler(Semaphore * s, Periodic_Thread * t): Semaphore_Handler(s), _thread(t) {}
         ~Static_Handler() {}
+
+        void operator()() {
+            _thread->job_release();
+
+            Semaphore_Handler::operator()();
+        }
+
+    private:
+        Periodic_Thread * _thread;
     };
 
     // Alarm Handler for periodic threads under dynamic scheduling policies
@@ -49,6 +72,7 @@ protected:
         ~Dynamic_Handler() {}
 
         void operator()() {
+            _thread->job_release();
             _thread->criterion().update();
 
             Semaphore_Handler::operator()();
@@ -62,8 +86,8 @@ protected:
 
 public:
     struct Configuration: public Thread::Configuration {
-        Configuration(const Microsecond & p, const Microsecond & d = SAME, const Microsecond & cap = UNKNOWN, const Microsecond & act = NOW, const unsigned int n = INFINITE, int cpu_id = ANY, const State & s = READY, const Criterion & c = NORMAL, const Color & a = WHITE, Task * t = 0, unsigned int ss = STACK_SIZE)
-        : Thread::Configuration(s, c, a, t, ss), period(p), deadline(d == SAME ? p : d), capacity(cap), activation(act), times(n), cpu(cpu_id) {}
+        Configuration(const Microsecond & p, const Microsecond & d = SAME, const Microsecond & cap = UNKNOWN, const Microsecond & act = NOW, const unsigned int n = INFINITE, int cpu_id = ANY, const State & s = READY, const Criterion & c = NORMAL, const Color & a = WHITE, Task * t = 0, unsigned int ss = STACK_SIZE, char * st = 0)
+        : Thread::Configuration(s, c, a, t, ss, st), period(p), deadline(d == SAME ? p : d), capacity(cap), activation(act), times(n), cpu(cpu_id) {}
 
         Microsecond period;
         Microsecond deadline;
@@ -76,29 +100,17 @@ public:
 public:
     template<typename ... Tn>
     Periodic_Thread(const Microsecond & p, int (* entry)(Tn ...), Tn ... an)
-    : Thread(Thread::Configuration(SUSPENDED, Criterion(p)), entry, an ...),
-      _semaphore(0), _handler(&_semaphore, this), _alarm(p, &_handler, INFINITE) { resume(); }
+    : Thread(Thread::Configuration(SUSPENDED, Criterion(p)), entry, an ...), _deadline(us2count(p)), _miss_handler(0),
+      _capacity(UNKNOWN), _share(0), _semaphore(0), _handler(&_semaphore, this), _alarm(p, &_handler, INFINITE) { job_reset(); resume(); }
 
     template<typename ... Tn>
     Periodic_Thread(const Configuration & conf, int (* entry)(Tn ...), Tn ... an)
-    : Thread(Thread::Configuration(SUSPENDED, (conf.criterion != NORMAL) ? conf.criterion : Criterion(conf.period), conf.color, conf.task, conf.stack_size), entry, an ...),
-      _semaphore(0), _handler(&_semaphore, this), _alarm(conf.period, &_handler, conf.times) {
-        if(monitored) {
-            if(INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::THREAD_EXECUTION_TIME) || INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::CPU_EXECUTION_TIME)) {
-                TSC::Time_Stamp ts = TSC::time_stamp();
-                if(_statistics.last_hyperperiod[_link.rank().queue()] == 0) {
-                    _statistics.last_hyperperiod[_link.rank().queue()] = ts;
-                    _statistics.hyperperiod[_link.rank().queue()] = Convert::us2count<TSC::Time_Stamp, Microsecond>(TSC::frequency(), conf.period);
-                } else {
-                    _statistics.hyperperiod[_link.rank().queue()] = Math::lcm(_statistics.hyperperiod[_link.rank().queue()], Convert::us2count<TSC::Time_Stamp, Microsecond>(TSC::frequency(),conf.period));
-                }
-                _statistics.last_execution = ts;
-            }
-            if(INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::DEADLINE_MISSES)) {
-                _statistics.times_p_count = conf.times;
-                _statistics.alarm_times = &_alarm;
-            }
-        }
+    : Thread(Thread::Configuration(SUSPENDED, (conf.criterion != NORMAL) ? conf.criterion : Criterion(conf.period), conf.color, conf.task, conf.stack_size, conf.stack), entry, an ...),
+      _deadline(us2count(conf.deadline)), _miss_handler(0), _capacity(conf.capacity), _share(0), _semaphore(0), _handler(&_semaphore, this), _alarm(conf.period, &_handler, conf.times) {
+        job_reset();
+        if(monitored)
+            if(INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::THREAD_EXECUTION_TIME) || INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::CPU_EXECUTION_TIME))
+                _statistics.last_execution = TSC::time_stamp();
         if((conf.state == READY) || (conf.state == RUNNING)) {
             _state = SUSPENDED;
             resume();
@@ -106,9 +118,22 @@ public:
             _state = conf.state;
     }
 
+    ~Periodic_Thread() { Governor::update(partition(), _share, 0); }
+
     const Microsecond & period() const { return _alarm.period(); }
     void period(const Microsecond & p) { _alarm.period(p); }
 
+    // Job records and response times (i = 0 is the last completed job, up to JOB_RECORDS - 1 back)
+    unsigned int jobs() const { return _completed; }
+    unsigned int misses() const { return _misses; }
+    const Job & job(unsigned int i = 0) const { return _jobs[(_completed - 1 - i) % JOB_RECORDS]; }
+    Microsecond response_time_min() const { return _responses ? count2us(_response_min) : Microsecond(0); }
+    Microsecond response_time_max() const { return count2us(_response_max); }
+    Microsecond response_time_avg() const { return _responses ? count2us(_response_sum / _responses) : Microsecond(0); }
+    void reset_job_statistics() { _misses = 0; _responses = 0; _response_min = -1ULL; _response_max = 0; _response_sum = 0; }
+
+    void miss_handler(Miss_Handler h) { _miss_handler = h; }
+
     static volatile bool wait_next() {
         Periodic_Thread * t = reinterpret_cast<Periodic_Thread *>(running());
 
@@ -122,19 +147,88 @@ public:
                 t->_statistics.execution_time = 0;
             }
 
-            if(INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::DEADLINE_MISSES))
-                t->_statistics.missed_deadlines = t->_statistics.times_p_count - (t->_statistics.alarm_times->_times);
+            if(pmu_virtualized)
+                pmu_job_end(t);
         }
 
+        t->job_complete();
+
         db<Thread>(TRC) << "Thread::wait_next(this=" << t << ",times=" << t->_alarm._times << ")" << endl;
 
-        if(t->_alarm._times)
+        if(t->_alarm._times) {
             t->_semaphore.p();
+            t->_jobs[t->_completed % JOB_RECORDS].start = TSC::time_stamp();
+        }
 
         return t->_alarm._times;
     }
 
 protected:
+    // Called by the alarm handler (with interrupts disabled)
+    void job_release() {
+        Job & j = _jobs[_releases % JOB_RECORDS]; // a backlog of more than JOB_RECORDS jobs overwrites pending records
+        j.release = TSC::time_stamp();
+        j.start = j.completion = 0;
+        j.lateness = 0;
+        _releases++;
+
+        if(Governor::enabled) // worst case until the job completes
+            Governor::update(partition(), _share, Governor::share(_capacity, period()));
+    }
+
+    void job_complete() {
+        TSC::Time_Stamp now = TSC::time_stamp();
+        Job & j = _jobs[_completed % JOB_RECORDS];
+        j.completion = now;
+        j.lateness = static_cast<long long>(now - j.release - _deadline);
+
+        TSC::Time_Stamp response = now - j.release;
+        if(response < _response_min)
+            _response_min = response;
+        if(response > _response_max)
+            _response_max = response;
+        _response_sum += response;
+        _responses++;
+        _completed++;
+
+        if(Governor::enabled) // the slack left by this job is reclaimed until the next release
+            Governor::update(partition(), _share, Governor::share(count2us(now - j.start), period()));
+
+        if(j.lateness > 0) {
+            _misses++;
+            db<Thread>(INF) << "Periodic_Thread::wait_next(this=" << this << "): deadline missed by " << count2us(j.lateness) << " us!" << endl;
+            if(_miss_handler)
+                _miss_handler(this, j);
+        }
+    }
+
+    // The first job is released with the thread (or at its activation)
+    void job_reset() {
+        _releases = _completed = 0;
+        reset_job_statistics();
+        job_release();
+        _jobs[0].start = _jobs[0].release;
+    }
+
+    unsigned int partition() { return Governor::partition(criterion()); }
+
+    static TSC::Time_Stamp us2count(const Microsecond & t) { return Convert::us2count<TSC::Time_Stamp, Microsecond>(TSC::frequency(), t); }
+    static Microsecond count2us(const TSC::Time_Stamp & t) { return Convert::count2us<Hertz, TSC::Time_Stamp, Microsecond>(TSC::frequency(), t); }
+
+protected:
+    TSC::Time_Stamp _deadline;
+    Job _jobs[JOB_RECORDS];
+    volatile unsigned int _releases;
+    unsigned int _completed;
+    unsigned int _misses;
+    unsigned int _responses; // jobs completed since the last reset_job_statistics()
+    TSC::Time_Stamp _response_min;
+    TSC::Time_Stamp _response_max;
+    TSC::Time_Stamp _response_sum;
+    Miss_Handler _miss_handler;
+    Microsecond _capacity;
+    unsigned long _share; // of the utilization of the partition (see Governor)
+
     Semaphore _semaphore;
     Handler _handler;
     Alarm _alarm;
@@ -157,6 +251,7 @@ private:
         if(activation) {
             // Wait for activation time
             t->_semaphore.p();
+            t->job_reset();
 
             // Adjust alarm's period
             t->_alarm.~Alarm();
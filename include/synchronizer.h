@@ -248,8 +248,8 @@ protected:
     using Base::begin_atomic;
     using Base::end_atomic;
 public:
-    Semaphore_Ceiling(){}
-    Semaphore_Ceiling(Priority_t ceiling, int value = 1) : Semaphore_RT<T, Q>(value), _cpu(1) { _ceiling[0] = ceiling; }
+    Semaphore_Ceiling(): _cpu(1), _ceiling(&_local_ceiling) {}
+    Semaphore_Ceiling(Priority_t ceiling, int value = 1) : Semaphore_RT<T, Q>(value), _cpu(1), _ceiling(&_local_ceiling) { _ceiling[0] = ceiling; }
     Semaphore_Ceiling(int cpu, Priority_t * ceiling, int value = 1) : Semaphore_RT<T, Q>(value), _cpu(cpu), _ceiling(ceiling) {}
     
     Priority_t ceiling( int cpu = 0 ) { return _ceiling[cpu]; }
@@ -259,6 +259,7 @@ public:
 private:
     int _cpu;
     Priority_t * _ceiling;
+    Priority_t _local_ceiling; // storage for single-core ceilings
 };
 
 template<bool T, bool Q>
@@ -470,7 +471,7 @@ public:
 
 protected:
     static const int _cpu = Traits<Build>::CPUS;
-    static int _systemCeiling[_cpu];
+    static Per_CPU<int, _cpu> _systemCeiling;
     static Semaphore_MSRP * _globalResources[MAX_RESOURCES];
     static int _nGR; /* Number of current global resources actives */
 
@@ -13,7 +13,8 @@ __BEGIN_SYS
 class Application
 {
     friend class Init_Application;
-    friend void * ::malloc(size_t);
+    friend class Clerk<System>;         // for _heap
+    friend void * ::_malloc(size_t, void *);
     friend void ::free(void *);
 
 private:
@@ -28,8 +29,9 @@ class System
 {
     friend class Init_System;
     friend class Init_Application;
+    friend class Clerk<System>;         // for _heap
     friend void CPU::Context::load() const volatile;
-    friend void * ::malloc(size_t);
+    friend void * ::_malloc(size_t, void *);
     friend void ::free(void *);
     friend void * ::operator new(size_t, const EPOS::System_Allocator &);
     friend void * ::operator new[](size_t, const EPOS::System_Allocator &);
@@ -61,9 +63,9 @@ private:
     static const unsigned int COLORS = Traits<MMU>::COLORS;
 
 public:
-    static void * alloc(unsigned int bytes, const EPOS::Color & allocator) {
+    static void * alloc(unsigned int bytes, const EPOS::Color & allocator, void * site = 0) {
         assert(static_cast<unsigned int>(allocator) <= COLORS);
-        return _heap[allocator]->alloc(bytes);
+        return _heap[allocator]->alloc(bytes, site);
     }
 
 private:
@@ -78,17 +80,23 @@ __END_SYS
 
 extern "C"
 {
-    // Standard C Library allocators
-    inline void * malloc(size_t bytes) {
+    // Allocates from the application's heap on behalf of the caller at site (see Heap_Sites)
+    inline void * _malloc(size_t bytes, void * site) {
         __USING_SYS;
         if(Traits<System>::multiheap)
-            return Application::_heap->alloc(bytes);
+            return Application::_heap->alloc(bytes, site);
         else
-            return System::_heap->alloc(bytes);
+            return System::_heap->alloc(bytes, site);
+    }
+
+    // Standard C Library allocators
+    // These and the operators new below are never inlined, so each one can take its caller's address
+    __attribute__((noinline)) inline void * malloc(size_t bytes) {
+        return _malloc(bytes, __builtin_return_address(0));
     }
 
-    inline void * calloc(size_t n, unsigned int bytes) {
-        void * ptr = malloc(n * bytes);
+    __attribute__((noinline)) inline void * calloc(size_t n, unsigned int bytes) {
+        void * ptr = _malloc(n * bytes, __builtin_return_address(0));
         memset(ptr, 0, n * bytes);
         return ptr;
     }
@@ -103,28 +111,28 @@ extern "C"
 }
 
 // C++ dynamic memory allocators and deallocators
-inline void * operator new(size_t bytes) {
-    return malloc(bytes);
+__attribute__((noinline)) inline void * operator new(size_t bytes) {
+    return _malloc(bytes, __builtin_return_address(0));
 }
 
-inline void * operator new[](size_t bytes) {
-    return malloc(bytes);
+__attribute__((noinline)) inline void * operator new[](size_t bytes) {
+    return _malloc(bytes, __builtin_return_address(0));
 }
 
-inline void * operator new(size_t bytes, const EPOS::System_Allocator & allocator) {
-    return _SYS::System::_heap->alloc(bytes);
+__attribute__((noinline)) inline void * operator new(size_t bytes, const EPOS::System_Allocator & allocator) {
+    return _SYS::System::_heap->alloc(bytes, __builtin_return_address(0));
 }
 
-inline void * operator new[](size_t bytes, const EPOS::System_Allocator & allocator) {
-    return _SYS::System::_heap->alloc(bytes);
+__attribute__((noinline)) inline void * operator new[](size_t bytes, const EPOS::System_Allocator & allocator) {
+    return _SYS::System::_heap->alloc(bytes, __builtin_return_address(0));
 }
 
-inline void * operator new(size_t bytes, const EPOS::Color & allocator) {
-    return _SYS::Page_Coloring::alloc(bytes, allocator);
+__attribute__((noinline)) inline void * operator new(size_t bytes, const EPOS::Color & allocator) {
+    return _SYS::Page_Coloring::alloc(bytes, allocator, __builtin_return_address(0));
 }
 
-inline void * operator new[](size_t bytes, const EPOS::Color & allocator) {
-    return _SYS::Page_Coloring::alloc(bytes, allocator);
+__attribute__((noinline)) inline void * operator new[](size_t bytes, const EPOS::Color & allocator) {
+    return _SYS::Page_Coloring::alloc(bytes, allocator, __builtin_return_address(0));
 }
 
 // Delete cannot be declared inline due to virtual destructors
@@ -135,6 +135,10 @@ class Delay;
 
 template<typename T> class Clerk;
 class Monitor;
+class Profiler;
+class Tracer;
+class Latency;
+class Governor;
 
 class Network;
 class ELP;
@@ -213,6 +217,19 @@ struct Traits_Tokens
         CPU_EXECUTION_TIME,
         THREAD_EXECUTION_TIME,
         RUNNING_THREAD,
+        HEAP_IN_USE,
+        HEAP_PEAK,
+        HEAP_ALLOCATIONS,
+        HEAP_FREES,
+        HEAP_FREE_BLOCKS,
+        HEAP_LARGEST_FREE_BLOCK,
+        HEAP_FRAGMENTATION,
+        THREAD_INSTRUCTIONS,
+        THREAD_CYCLES,
+        THREAD_LLC_MISSES,
+        JOB_RESPONSE_TIME_MIN,
+        JOB_RESPONSE_TIME_AVG,
+        JOB_RESPONSE_TIME_MAX,
     };
 
     // Monitor events (PMU)
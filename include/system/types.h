@@ -36,6 +36,7 @@ extern "C"
 {
     void * malloc(size_t);
     void free(void *);
+    void * _malloc(size_t, void *);
 }
 
 inline void * operator new(size_t s, void * a) { return a; }
@@ -0,0 +1,71 @@
+// EPOS Scheduler Tracer Declarations
+
+#ifndef __tracer_h
+#define __tracer_h
+
+#include <architecture.h>
+#include <utility/per_cpu.h>
+
+__BEGIN_SYS
+
+// Per-CPU binary trace of scheduling events
+// Each event costs a time stamp read and a few stores into the CPU's ring (callers run with interrupts disabled)
+// dump() prints the rings for tools/epostrace, which converts them to the Chrome trace format (chrome://tracing, Perfetto)
+class Tracer
+{
+private:
+    static const bool enabled = Traits<Tracer>::enabled;
+    static const unsigned int EVENTS = enabled ? Traits<Tracer>::EVENTS : 1; // a power of 2
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+
+    typedef TSC::Time_Stamp Time_Stamp;
+
+public:
+    enum Type {
+        DISPATCH,       // a = prev, b = next
+        WAKEUP,         // a = thread, b = CPU
+        SLEEP,          // a = thread, b = queue
+        PRIORITY,       // a = thread, b = priority
+        MIGRATION,      // a = thread, b = new CPU
+        IPI_SEND,       // a = destination CPU, b = interrupt
+        IPI_RECEIVE,    // a = interrupt
+        ALARM           // a = alarm, b = elapsed ticks
+    };
+
+    struct Event {
+        Time_Stamp ts;
+        unsigned long a;
+        unsigned long b;
+        unsigned int type;
+    };
+
+public:
+    static void record(const Type & type, unsigned long a = 0, unsigned long b = 0) {
+        if(!enabled)
+            return;
+
+        unsigned int cpu = CPU::id();
+        Event & e = _ring[cpu][_head[cpu]++ & (EVENTS - 1)];
+        e.ts = TSC::time_stamp();
+        e.type = type;
+        e.a = a;
+        e.b = b;
+    }
+
+    template<typename T1, typename T2>
+    static void record(const Type & type, T1 * a, T2 * b) { record(type, reinterpret_cast<unsigned long>(a), reinterpret_cast<unsigned long>(b)); }
+    template<typename T>
+    static void record(const Type & type, T * a, unsigned long b = 0) { record(type, reinterpret_cast<unsigned long>(a), b); }
+
+    static unsigned int recorded(unsigned int cpu) { return _head[cpu]; }
+
+    static void dump();
+
+private:
+    static Event _ring[CPUS][EVENTS];
+    static Per_CPU<unsigned int> _head; // each in a cache line of its own, for every record() writes it
+};
+
+__END_SYS
+
+#endif
@@ -39,6 +39,8 @@ public:
 
     Shadow * shadow() const { return _shadow; }
     Shadow * back() const { return shadow(); }
+    void shadow(Shadow * s) { _shadow = s; }
+    void back(Shadow * s) { shadow(s); }
 
     unsigned int size() const { return _size; }
     void size(unsigned int s) { _size = s; }
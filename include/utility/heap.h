@@ -9,11 +9,88 @@
 
 __BEGIN_UTIL
 
+// Allocation-site histogram (open addressing on the return address of the allocator's caller, as taken by malloc() and
+// the operators new, which are never inlined for that)
+template<unsigned int SITES>
+class Heap_Sites
+{
+public:
+    struct Site {
+        void * address;
+        unsigned int count;
+        unsigned int bytes;
+    };
+
+public:
+    Heap_Sites(): _dropped(0) {
+        for(unsigned int i = 0; i < SITES; i++) {
+            _sites[i].address = 0;
+            _sites[i].count = 0;
+            _sites[i].bytes = 0;
+        }
+    }
+
+    void record(void * address, unsigned int bytes) {
+        unsigned int i = (reinterpret_cast<unsigned long>(address) >> 2) % SITES;
+        for(unsigned int n = 0; n < SITES; n++, i = (i + 1) % SITES)
+            if(!_sites[i].address || (_sites[i].address == address)) {
+                _sites[i].address = address;
+                _sites[i].count++;
+                _sites[i].bytes += bytes;
+                return;
+            }
+        _dropped++;
+    }
+
+    unsigned int size() const { return SITES; }
+    const Site & operator[](unsigned int i) const { return _sites[i]; }
+    unsigned int dropped() const { return _dropped; } // allocations that found the histogram full
+
+private:
+    Site _sites[SITES];
+    unsigned int _dropped;
+};
+
+template<>
+class Heap_Sites<0>
+{
+public:
+    struct Site {
+        void * address;
+        unsigned int count;
+        unsigned int bytes;
+    };
+
+public:
+    void record(void * address, unsigned int bytes) {}
+
+    unsigned int size() const { return 0; }
+    const Site & operator[](unsigned int i) const { static const Site none = {0, 0, 0}; return none; }
+    unsigned int dropped() const { return 0; }
+};
+
+
 // Heap
 class Simple_Heap: private Grouping_List<char>
 {
 protected:
     static const bool typed = Traits<System>::multiheap;
+    static const bool instrumented = Traits<Heaps>::instrumented;
+
+public:
+    // Heap Statistics (only collected if Traits<Heaps>::instrumented; sizes include allocation headers)
+    struct Statistics {
+        Statistics(): in_use(0), peak(0), allocations(0), frees(0), failures(0), largest_free(0) {}
+
+        unsigned int in_use;
+        unsigned int peak;
+        unsigned int allocations;
+        unsigned int frees;
+        unsigned int failures;
+        unsigned int largest_free;
+    };
+
+    typedef Heap_Sites<instrumented ? Traits<Heaps>::ALLOCATION_SITES : 0> Sites;
 
 public:
     using Grouping_List<char>::empty;
@@ -29,7 +106,8 @@ public:
         free(addr, bytes);
     }
 
-    void * alloc(unsigned int bytes) {
+    // site is the address of the allocator's caller (0 if unknown)
+    void * alloc(unsigned int bytes, void * site = 0) {
         db<Heaps>(TRC) << "Heap::alloc(this=" << this << ",bytes=" << bytes;
 
         if(!bytes)
@@ -47,7 +125,9 @@ public:
 
         Element * e = search_decrementing(bytes);
         if(!e) {
-            out_of_memory();
+            if(instrumented)
+                _statistics.failures++;
+            out_of_memory(bytes);
             return 0;
         }
 
@@ -57,6 +137,17 @@ public:
             *addr++ = reinterpret_cast<int>(this);
         *addr++ = bytes;
 
+        if(instrumented) {
+            _statistics.allocations++;
+            _statistics.in_use += bytes;
+            if(_statistics.in_use > _statistics.peak)
+                _statistics.peak = _statistics.in_use;
+            if(e->size() + bytes >= _statistics.largest_free) // the largest block was consumed, look for the next one
+                update_largest_free();
+            if(site)
+                _sites.record(site, bytes);
+        }
+
         db<Heaps>(TRC) << ") => " << reinterpret_cast<void *>(addr) << endl;
 
         return addr;
@@ -68,7 +159,10 @@ public:
         if(ptr && (bytes >= sizeof(Element))) {
             Element * e = new (ptr) Element(reinterpret_cast<char *>(ptr), bytes);
             Element * m1, * m2;
-            insert_merging(e, &m1, &m2);
+            Element * block = insert_merging(e, &m1, &m2);
+
+            if(instrumented && (block->size() > _statistics.largest_free))
+                _statistics.largest_free = block->size();
         }
     }
 
@@ -76,17 +170,52 @@ public:
         int * addr = reinterpret_cast<int *>(ptr);
         unsigned int bytes = *--addr;
         Simple_Heap * heap = reinterpret_cast<Simple_Heap *>(*--addr);
+        heap->released(bytes);
         heap->free(addr, bytes);
     }
 
     static void untyped_free(Simple_Heap * heap, void * ptr) {
         int * addr = reinterpret_cast<int *>(ptr);
         unsigned int bytes = *--addr;
+        heap->released(bytes);
         heap->free(addr, bytes);
     }
 
+    const Statistics & statistics() const { return _statistics; }
+    const Sites & sites() const { return _sites; }
+
+    unsigned int free_bytes() const { return grouped_size(); }
+    unsigned int free_blocks() const { return size(); }
+    unsigned int largest_free_block() const { return _statistics.largest_free; }
+
+    // 0 when all free memory is contiguous, approaching 100 as it scatters into small blocks
+    unsigned int fragmentation() const {
+        unsigned int free = grouped_size();
+        return (instrumented && free) ? 100 - static_cast<unsigned int>((static_cast<unsigned long long>(_statistics.largest_free) * 100) / free) : 0;
+    }
+
+private:
+    void released(unsigned int bytes) {
+        if(instrumented) {
+            _statistics.frees++;
+            _statistics.in_use -= bytes;
+        }
+    }
+
+    // Only called when the largest free block is consumed, since frees can only make it grow
+    void update_largest_free() {
+        unsigned int largest = 0;
+        for(Element * e = head(); e; e = e->next())
+            if(e->size() > largest)
+                largest = e->size();
+        _statistics.largest_free = largest;
+    }
+
+    void out_of_memory(unsigned int bytes);
+
 private:
-    void out_of_memory();
+    Statistics _statistics;
+    Sites _sites;
 };
 
 
@@ -127,9 +256,9 @@ public:
         return tmp;
     }
 
-    void * alloc(unsigned int bytes) {
+    void * alloc(unsigned int bytes, void * site = 0) {
         enter();
-        void * tmp = T::alloc(bytes);
+        void * tmp = T::alloc(bytes, site);
         leave();
         return tmp;
     }
@@ -1344,7 +1344,8 @@ public:
         return e;
     }
 
-    void insert_merging(Element * e, Element ** m1, Element ** m2) {
+    // Returns the element that holds e's memory afterwards (e itself or its left neighbor)
+    Element * insert_merging(Element * e, Element ** m1, Element ** m2) {
         db<Lists>(TRC) << "Grouping_List::insert_merging(e=" << e << ")" << endl;
 
         _grouped_size += e->size();
@@ -1363,6 +1364,8 @@ public:
             l->size(l->size() + e->size());
             *m2 = e;
         }
+
+        return l ? l : e;
     }
 
     Element * search_decrementing(unsigned int s) {
@@ -0,0 +1,39 @@
+// EPOS Per-CPU Storage Utility Declarations
+
+#ifndef __per_cpu_h
+#define __per_cpu_h
+
+#include <system/config.h>
+
+__BEGIN_UTIL
+
+// One instance of T per CPU, each aligned to and padded up to a whole number of cache lines,
+// so that CPUs updating their own instances never write to a line shared with another CPU.
+// Indexing is the same as for the plain array it replaces (e.g. _monitors[CPU::id()]).
+// Alignment is only guaranteed for static storage, which is how the kernel uses it.
+template<typename T, unsigned int CPUS = Traits<Build>::CPUS, unsigned int LINE = Traits<CPU>::CACHE_LINE_SIZE>
+class Per_CPU
+{
+private:
+    struct Slot {
+        T object;
+    } __attribute__((aligned(LINE)));
+
+public:
+    static const unsigned int SLOT_SIZE = sizeof(Slot);
+
+public:
+    Per_CPU() {}
+
+    T & operator[](unsigned int cpu) { return _slots[cpu].object; }
+    const T & operator[](unsigned int cpu) const { return _slots[cpu].object; }
+
+    unsigned int size() const { return CPUS; }
+
+private:
+    Slot _slots[CPUS];
+};
+
+__END_UTIL
+
+#endif
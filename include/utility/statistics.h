@@ -0,0 +1,185 @@
+// EPOS Online Statistics Utility Declarations
+
+// All estimators run in O(1) time and memory per sample using only integer arithmetic,
+// so they can be updated from interrupt handlers and the dispatcher without touching the FPU
+
+#ifndef __statistics_h
+#define __statistics_h
+
+#include <utility/math.h>
+
+__BEGIN_UTIL
+
+// Count, min, max, mean and variance (Welford's algorithm, with the mean kept exact by a running sum)
+template<typename T = long long>
+class Running_Statistics
+{
+public:
+    Running_Statistics() { reset(); }
+
+    void reset() { _count = 0; _min = 0; _max = 0; _sum = 0; _m2 = 0; }
+
+    void update(const T & x) {
+        if(!_count || (x < _min))
+            _min = x;
+        if(!_count || (x > _max))
+            _max = x;
+        T before = x - mean();
+        _count++;
+        _sum += x;
+        T after = x - mean();
+
+        // Both deltas have the same sign (up to rounding), so their product is taken on magnitudes, checked before
+        // multiplying, and _m2 saturates instead of wrapping around
+        if((before < 0) != (after < 0))
+            return;
+        unsigned long long a = magnitude(before);
+        unsigned long long b = magnitude(after);
+        if(a && (b > -1ULL / a))
+            _m2 = -1ULL;
+        else {
+            unsigned long long m2 = _m2 + a * b;
+            _m2 = (m2 < _m2) ? -1ULL : m2;
+        }
+    }
+
+    unsigned long count() const { return _count; }
+    T min() const { return _min; }
+    T max() const { return _max; }
+    T mean() const { return _count ? _sum / static_cast<T>(_count) : 0; }
+    unsigned long long variance() const { return (_count > 1) ? _m2 / (_count - 1) : 0; }
+    T std_dev() const { return static_cast<T>(Math::sqrt(variance())); }
+
+private:
+    static unsigned long long magnitude(const T & d) { return (d < 0) ? -static_cast<unsigned long long>(d) : static_cast<unsigned long long>(d); }
+
+private:
+    unsigned long _count;
+    T _min;
+    T _max;
+    T _sum;
+    unsigned long long _m2;
+};
+
+
+// Exponentially weighted moving average with alpha = 1 / 2^SHIFT
+template<typename T = long long, unsigned int SHIFT = 3>
+class EWMA
+{
+public:
+    EWMA(): _value(0), _primed(false) {}
+
+    void reset() { _value = 0; _primed = false; }
+
+    void update(const T & x) {
+        if(_primed)
+            _value += (x - _value) / (static_cast<T>(1) << SHIFT);
+        else {
+            _value = x;
+            _primed = true;
+        }
+    }
+
+    T value() const { return _value; }
+    operator T() const { return _value; }
+
+private:
+    T _value;
+    bool _primed;
+};
+
+
+// Single quantile estimator with five markers (the P-square algorithm by Jain and Chlamtac, 1985)
+// PERMILLE selects the quantile (e.g. 500 for the median, 990 for the 99th percentile)
+template<typename T = long long, unsigned int PERMILLE = 500>
+class P2_Quantile
+{
+private:
+    static const unsigned int MARKERS = 5;
+    static const long long ONE = 1LL << 16; // desired positions are kept in Q16 fixed point
+    static const long long P = (ONE * PERMILLE) / 1000;
+
+public:
+    P2_Quantile() { reset(); }
+
+    void reset() {
+        _count = 0;
+        for(unsigned int i = 0; i < MARKERS; i++)
+            _n[i] = i + 1;
+        _desired[0] = ONE;
+        _desired[1] = ONE + 2 * P;
+        _desired[2] = ONE + 4 * P;
+        _desired[3] = 3 * ONE + 2 * P;
+        _desired[4] = 5 * ONE;
+    }
+
+    void update(const T & x) {
+        if(_count < MARKERS) { // insertion sort of the first observations
+            unsigned int i = _count++;
+            for(; i && (_q[i - 1] > x); i--)
+                _q[i] = _q[i - 1];
+            _q[i] = x;
+            return;
+        }
+        _count++;
+
+        unsigned int k;
+        if(x < _q[0]) {
+            _q[0] = x;
+            k = 0;
+        } else if(x >= _q[4]) {
+            _q[4] = x;
+            k = 3;
+        } else
+            for(k = 0; x >= _q[k + 1]; k++);
+
+        for(unsigned int i = k + 1; i < MARKERS; i++)
+            _n[i]++;
+        static const long long increment[MARKERS] = {0, P / 2, P, (ONE + P) / 2, ONE};
+        for(unsigned int i = 0; i < MARKERS; i++)
+            _desired[i] += increment[i];
+
+        for(unsigned int i = 1; i < MARKERS - 1; i++) {
+            long long d = _desired[i] - _n[i] * ONE;
+            if(((d >= ONE) && (_n[i + 1] - _n[i] > 1)) || ((d <= -ONE) && (_n[i - 1] - _n[i] < -1))) {
+                long long s = (d > 0) ? 1 : -1;
+                T q = parabolic(i, s);
+                if((_q[i - 1] < q) && (q < _q[i + 1]))
+                    _q[i] = q;
+                else
+                    _q[i] = linear(i, s);
+                _n[i] += s;
+            }
+        }
+    }
+
+    unsigned long count() const { return _count; }
+
+    T value() const {
+        if(_count >= MARKERS)
+            return _q[2];
+        return _count ? _q[((_count - 1) * PERMILLE) / 1000] : 0;
+    }
+    operator T() const { return value(); }
+
+private:
+    T parabolic(unsigned int i, long long s) const {
+        long long a = (_n[i] - _n[i - 1] + s) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]);
+        long long b = (_n[i + 1] - _n[i] - s) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]);
+        return _q[i] + static_cast<T>(s * (a + b) / (_n[i + 1] - _n[i - 1]));
+    }
+
+    T linear(unsigned int i, long long s) const {
+        return _q[i] + static_cast<T>(s * (_q[i + s] - _q[i]) / (_n[i + s] - _n[i]));
+    }
+
+private:
+    unsigned long _count;
+    T _q[MARKERS];              // marker heights
+    long long _n[MARKERS];      // marker positions
+    long long _desired[MARKERS];
+};
+
+__END_UTIL
+
+#endif
@@ -4,6 +4,7 @@
 #include <synchronizer.h>
 #include <time.h>
 #include <process.h>
+#include <tracer.h>
 
 __BEGIN_SYS
 
@@ -123,6 +124,10 @@ void Alarm::handler(IC::Interrupt_Id i)
         }
     }
 
+    // Recorded while the alarm is still known to exist (it may be deleted as soon as the lock is released)
+    if(alarm)
+        Tracer::record(Tracer::ALARM, alarm, _elapsed);
+
     unlock();
 
     if(alarm) {
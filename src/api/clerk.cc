@@ -1,19 +1,106 @@
 // EPOS Clerk Implementation
 
 #include <clerk.h>
+#include <machine/uart.h>
+#include <network/ipv4/udp.h>
 
 __BEGIN_SYS
 
 // Clerk
 #ifdef __PMU_H
 
-bool Clerk<PMU>::_in_use[Traits<Build>::CPUS][CHANNELS];
+Per_CPU<bool[Clerk<PMU>::CHANNELS]> Clerk<PMU>::_in_use;
+
+// Profiler
+Profiler::Sample Profiler::_ring[CPUS][SAMPLES];
+volatile unsigned int Profiler::_taken[CPUS];
+Profiler::Channel Profiler::_channel[CPUS];
+Profiler::Count Profiler::_period[CPUS];
+
+bool Profiler::start(const Event & event, const Count & period)
+{
+    db<Profiler>(TRC) << "Profiler::start(e=" << event << ",p=" << period << ")" << endl;
+
+    if(!enabled || !Traits<System>::multicore) { // PMIs are delivered by the local APIC, which is only used in multicore configurations
+        db<Profiler>(WRN) << "Profiler::start: PMU overflow interrupts are not available in this configuration!" << endl;
+        return false;
+    }
+
+    unsigned int cpu = CPU::id();
+
+    // Fixed events use their own channels, others use the last general purpose one
+    Channel channel = (event < PMU::FIXED) ? event : PMU::CHANNELS - 1;
+    if(Clerk<PMU>::_in_use[cpu][channel]) {
+        db<Profiler>(WRN) << "Profiler::start: PMU channel " << channel << " is busy!" << endl;
+        return false;
+    }
+    Clerk<PMU>::_in_use[cpu][channel] = true;
+
+    _channel[cpu] = channel;
+    _period[cpu] = period;
+    _taken[cpu] = 0;
+
+    IC::pmi_handler(&pmi);
+    APIC::config_pmu(IC::INT_PMU);
+    PMU::config(channel, event);
+    PMU::sample(channel, period);
+    APIC::enable_pmu();
+
+    return true;
+}
+
+void Profiler::stop()
+{
+    db<Profiler>(TRC) << "Profiler::stop()" << endl;
+
+    unsigned int cpu = CPU::id();
+    if(!enabled || !Clerk<PMU>::_in_use[cpu][_channel[cpu]])
+        return;
+
+    APIC::disable_pmu();
+    PMU::stop(_channel[cpu]);
+    PMU::reset(_channel[cpu]);
+    Clerk<PMU>::_in_use[cpu][_channel[cpu]] = false;
+}
+
+void Profiler::dump()
+{
+    if(!enabled)
+        return;
+
+    OStream os; // like Monitor::process_batch(), to keep lines parsable
+    os << "begin_profile" << endl;
+    for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+        os << "CPU" << cpu << ",taken=" << _taken[cpu] << ",kept=" << samples(cpu) << endl;
+        for(unsigned int i = 0; i < samples(cpu); i++)
+            os << "PROF," << cpu << "," << static_cast<void *>(sample(cpu, i).ip) << "," << reinterpret_cast<void *>(sample(cpu, i).thread) << endl;
+    }
+    os << "end_profile" << endl;
+}
+
+// Called from IC::pmi_entry() with interrupts disabled
+void Profiler::pmi(const Log_Addr & ip)
+{
+    unsigned int cpu = CPU::id();
+
+    Sample & s = _ring[cpu][_taken[cpu] % SAMPLES];
+    s.ip = ip;
+    s.thread = Thread::self();
+    _taken[cpu]++;
+
+    // Reload the counter and unmask LVT_PERF, which the APIC masks when delivering a PMI
+    PMU::sample(_channel[cpu], _period[cpu]);
+    APIC::enable_pmu();
+}
 
 #endif
 
 // System_Monitor
-Simple_List<Monitor> Monitor::_monitors[Traits<Build>::CPUS];
+Per_CPU<Simple_List<Monitor>> Monitor::_monitors;
 volatile bool Monitor::_enable;
+Monitor::Stream Monitor::_streams[Traits<Build>::CPUS];
+Microsecond Monitor::_last_export[Traits<Build>::CPUS];
+Thread * Monitor::_exporter;
 
 void Monitor::run()
 {
@@ -25,6 +112,109 @@ void Monitor::run()
     }
 }
 
+void Monitor::stream(unsigned int id, const Time_Stamp & ts, long long value)
+{
+    Stream & s = _streams[CPU::id()];
+
+    s.lock.acquire();
+    unsigned int half = s.active;
+    if(s.count[half] < STREAM_BUFFER) {
+        Record & r = s.records[half][s.count[half]];
+        r.id = id;
+        r.ts = ts;
+        r.value = value;
+        s.count[half]++;
+    } else
+        s.dropped++; // the exporter is lagging behind
+    s.lock.release();
+}
+
+// Each frame is: MAGIC, CPU, payload length (16 bits, little endian), then a payload made of
+// the number of records dropped since the last frame followed by the records themselves, each
+// as (monitor id, microseconds since the CPU's previous record, zigzag value), all varints
+void Monitor::flush()
+{
+    static unsigned char frame[STREAM_FRAME];
+    static const unsigned int HEADER = 4;
+    static const unsigned int RECORD = 3 * 10;
+
+    for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+        Stream & s = _streams[cpu];
+
+        // Swap halves, so the capturing CPU goes on with an empty one while we drain the other
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
+        s.lock.acquire();
+        unsigned int half = s.active;
+        s.active = !half;
+        unsigned int dropped = s.dropped;
+        s.dropped = 0;
+        s.lock.release();
+        if(!disabled)
+            CPU::int_enable();
+
+        unsigned int count = s.count[half];
+        if(!count && !dropped)
+            continue;
+
+        unsigned int i = 0;
+        do {
+            unsigned int n = HEADER;
+            n += varint(&frame[n], dropped);
+            dropped = 0;
+            for(; (i < count) && (n + RECORD <= STREAM_FRAME); i++) {
+                const Record & r = s.records[half][i];
+                Microsecond us = count2us(r.ts);
+                n += varint(&frame[n], r.id);
+                n += varint(&frame[n], us - _last_export[cpu]);
+                n += varint(&frame[n], zigzag(r.value));
+                _last_export[cpu] = us;
+            }
+            frame[0] = STREAM_MAGIC;
+            frame[1] = cpu;
+            frame[2] = (n - HEADER) & 0xff;
+            frame[3] = (n - HEADER) >> 8;
+            send(frame, n);
+        } while(i < count);
+
+        s.count[half] = 0;
+    }
+}
+
+void Monitor::send(const unsigned char * data, unsigned int size)
+{
+    db<Monitor>(TRC) << "Monitor::send(d=" << reinterpret_cast<const void *>(data) << ",s=" << size << ")" << endl;
+
+#ifdef __ipv4__
+    if(Traits<Network>::enabled && Traits<Monitor>::STREAM_UDP_ADDRESS) {
+        UDP::send(UDP::Address(IP::Address(IP::Address::NULL), Traits<Monitor>::STREAM_UDP_PORT),
+                  UDP::Address(IP::Address(Traits<Monitor>::STREAM_UDP_ADDRESS), Traits<Monitor>::STREAM_UDP_PORT), data, size);
+        return;
+    }
+#endif
+
+    static UART * uart;
+    if(!uart)
+        uart = new (SYSTEM) UART(Traits<Monitor>::STREAM_UART);
+    for(unsigned int i = 0; i < size; i++)
+        uart->put(data[i]);
+}
+
+int Monitor::exporter()
+{
+    db<Monitor>(TRC) << "Monitor::exporter()" << endl;
+
+    // Run while there is someone to monitor besides this thread and the idle ones
+    while(Thread::_thread_count > CPU::cores() + 1) {
+        Alarm::delay(Traits<Monitor>::STREAM_PERIOD);
+        flush();
+    }
+    flush();
+
+    return 0;
+}
+
 void Monitor::init()
 {
     db<Monitor>(TRC) << "Monitor::init()" << endl;
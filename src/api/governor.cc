@@ -0,0 +1,107 @@
+// EPOS Energy-aware Frequency Governor Implementation
+
+#include <governor.h>
+
+__BEGIN_SYS
+
+// Class attributes
+Simple_Spin Governor::_lock;
+Per_CPU<Governor::Partition> Governor::_partitions;
+Per_CPU<Governor::Core> Governor::_cores;
+
+// Methods
+void Governor::account(unsigned int partition, unsigned long & current, unsigned long updated)
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    _lock.acquire();
+
+    Partition & p = _partitions[partition];
+    if(!current && updated)
+        p.tasks++;
+    else if(current && !updated)
+        p.tasks--;
+    p.utilization = p.utilization - current + updated;
+    current = updated;
+    p.target = level(p.utilization, p.tasks);
+
+    _lock.release();
+    if(!disabled)
+        CPU::int_enable();
+
+    db<Governor>(TRC) << "Governor::account(p=" << partition << ",u=" << p.utilization << ",n=" << p.tasks << ") => " << p.target << "/" << STEPS << endl;
+}
+
+unsigned int Governor::level(unsigned long utilization, unsigned int tasks)
+{
+    // Liu and Layland's bound n(2^(1/n) - 1) for RM, in SCALE units
+    static const unsigned long bounds[] = { 1000000, 828427, 779763, 756828, 743492, 734772, 728627, 724062, 720538, 717735 };
+
+    unsigned long long demand = utilization;
+    if(!dynamic && tasks)
+        demand = demand * SCALE / ((tasks <= COUNTOF(bounds)) ? bounds[tasks - 1] : 693147);
+
+    unsigned long long step = (demand * STEPS + SCALE - 1) / SCALE;
+    if(step < MIN_STEP)
+        step = MIN_STEP;
+    if(step > STEPS)
+        step = STEPS;
+
+    return step;
+}
+
+void Governor::scale(unsigned int level)
+{
+    Core & core = _cores[CPU::id()];
+    if(core.level == level)
+        return;
+
+    Time_Stamp now = TSC::time_stamp();
+    if(core.level)
+        core.residency[core.level - 1] += now - core.since;
+    core.since = now;
+    core.level = level;
+    core.changes++;
+    core.frequency = Machine::clock(CPU::clock() / STEPS * level);
+}
+
+void Governor::lowest()
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+
+    scale(MIN_STEP ? MIN_STEP : 1);
+
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void Governor::dump()
+{
+    if(!enabled)
+        return;
+
+    OStream os; // like Tracer::dump(), to keep lines parsable
+    os << "begin_governor" << endl;
+    os << "# cpu,level,frequency,ticks" << endl;
+    for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+        const Core & core = _cores[cpu];
+        Time_Stamp total = 0;
+        unsigned long long weighted = 0; // dynamic power scales roughly with f^3 (f . V^2, V ~ f)
+        for(unsigned int i = 0; i < STEPS; i++) {
+            Time_Stamp ticks = core.residency[i];
+            if(cpu == CPU::id() && (i + 1 == core.level))
+                ticks += TSC::time_stamp() - core.since;
+            total += ticks;
+            weighted += ticks / (STEPS * STEPS * STEPS) * (i + 1) * (i + 1) * (i + 1);
+            if(ticks)
+                os << "GOVERNOR," << cpu << "," << i + 1 << "," << CPU::clock() / STEPS * (i + 1) << "," << ticks << endl;
+        }
+        os << "CPU" << cpu << ",changes=" << core.changes << ",relative_energy=" << (total ? weighted * 1000 / total : 1000) << "/1000" << endl;
+    }
+    os << "end_governor" << endl;
+}
+
+__END_SYS
@@ -0,0 +1,100 @@
+// EPOS Critical Section Latency Tracer Implementation
+
+#include <latency.h>
+
+__BEGIN_SYS
+
+// Class attributes
+TSC::Time_Stamp Latency::_start[SECTIONS][CPUS];
+unsigned long Latency::_open_site[SECTIONS][CPUS];
+TSC::Time_Stamp Latency::_max[SECTIONS][CPUS];
+unsigned long Latency::_max_site[SECTIONS][CPUS];
+unsigned long Latency::_overflows[SECTIONS][CPUS];
+Latency::Site Latency::_sites[SECTIONS][CPUS][SITES];
+
+// Methods
+// Both run with interrupts disabled on the CPU whose slots they touch, so no further locking is needed
+void Latency::open(const Section & s)
+{
+    unsigned int cpu = CPU::id();
+    if(_start[s][cpu]) // already open (e.g. lock() with interrupts already disabled)
+        return;
+
+    _open_site[s][cpu] = reinterpret_cast<unsigned long>(__builtin_return_address(0));
+    _start[s][cpu] = TSC::time_stamp();
+}
+
+void Latency::close(const Section & s)
+{
+    Time_Stamp now = TSC::time_stamp();
+    unsigned int cpu = CPU::id();
+    if(!_start[s][cpu])
+        return;
+
+    Time_Stamp elapsed = now - _start[s][cpu];
+    unsigned long address = _open_site[s][cpu];
+    _start[s][cpu] = 0;
+
+    if(elapsed > _max[s][cpu]) {
+        _max[s][cpu] = elapsed;
+        _max_site[s][cpu] = address;
+    }
+
+    Site * sites = _sites[s][cpu];
+    unsigned int i = 0;
+    for(; (i < SITES) && sites[i].count && (sites[i].address != address); i++);
+    if(i == SITES) {
+        _overflows[s][cpu]++;
+        return;
+    }
+
+    Site & site = sites[i];
+    site.address = address;
+    site.count++;
+    site.total += elapsed;
+    if(elapsed > site.max)
+        site.max = elapsed;
+}
+
+void Latency::reset()
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+
+    for(unsigned int s = 0; s < SECTIONS; s++)
+        for(unsigned int cpu = 0; cpu < CPUS; cpu++) {
+            _max[s][cpu] = 0;
+            _max_site[s][cpu] = 0;
+            _overflows[s][cpu] = 0;
+            for(unsigned int i = 0; i < SITES; i++)
+                _sites[s][cpu][i] = Site();
+        }
+
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void Latency::dump()
+{
+    if(!enabled)
+        return;
+
+    static const char * names[SECTIONS] = { "irqs_off", "preempt_off" };
+
+    OStream os; // like Tracer::dump(), to keep lines parsable
+    os << "begin_latency" << endl;
+    os << "TSC," << TSC::frequency() << endl;
+    os << "# section,cpu,site,count,max,avg" << endl;
+    for(unsigned int s = 0; s < SECTIONS; s++)
+        for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+            os << "MAX," << names[s] << "," << cpu << "," << reinterpret_cast<void *>(_max_site[s][cpu]) << "," << _max[s][cpu] << ",overflows=" << _overflows[s][cpu] << endl;
+            for(unsigned int i = 0; (i < SITES) && _sites[s][cpu][i].count; i++) {
+                const Site & site = _sites[s][cpu][i];
+                os << "LATENCY," << names[s] << "," << cpu << "," << reinterpret_cast<void *>(site.address) << "," << site.count << "," << site.max << "," << site.total / site.count << endl;
+            }
+        }
+    os << "end_latency" << endl;
+}
+
+__END_SYS
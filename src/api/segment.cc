@@ -37,6 +37,12 @@ Segment::Phy_Addr Segment::phy_address() const
 }
 
 
+Segment::Log_Addr Segment::log_address(unsigned int offset) const
+{
+    return Chunk::log_address(offset);
+}
+
+
 int Segment::resize(int amount)
 {
     db<Segment>(TRC) << "Segment::resize(amount=" << amount << ")" << endl;
@@ -44,4 +50,18 @@ int Segment::resize(int amount)
     return Chunk::resize(amount);
 }
 
+
+bool Segment::populate(unsigned int offset)
+{
+    db<Segment>(TRC) << "Segment::populate(this=" << this << ",offset=" << offset << ")" << endl;
+
+    return Chunk::populate(offset);
+}
+
+
+unsigned int Segment::resident() const
+{
+    return Chunk::resident();
+}
+
 __END_SYS
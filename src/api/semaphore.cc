@@ -328,7 +328,7 @@ void Semaphore_MSRP::v()
 }
 
 int Semaphore_MSRP::_nGR = 0;
-int Semaphore_MSRP::_systemCeiling[_cpu];
+Per_CPU<int, Semaphore_MSRP::_cpu> Semaphore_MSRP::_systemCeiling;
 Semaphore_MSRP * Semaphore_MSRP::_globalResources[MAX_RESOURCES];
 
 __END_SYS
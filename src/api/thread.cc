@@ -4,6 +4,8 @@
 #include <system.h>
 #include <process.h>
 #include <clerk.h>
+#include <tracer.h>
+#include <governor.h>
 
 // This_Thread class attributes
 __BEGIN_UTIL
@@ -17,29 +19,34 @@ volatile unsigned int Thread::_thread_count;
 Scheduler_Timer * Thread::_timer;
 Scheduler<Thread> Thread::_scheduler;
 Spin Thread::_lock;
+Clerk<PMU> * Thread::_pmu_clerks[Traits<Build>::CPUS][PMU_EVENTS];
+Per_CPU<unsigned long long[Thread::PMU_EVENTS]> Thread::_pmu_base;
 
 
 // Statistics
-unsigned int Thread::_Statistics::hyperperiod[Traits<Build>::CPUS];
-TSC::Time_Stamp Thread::_Statistics::last_hyperperiod[Traits<Build>::CPUS];
-unsigned int Thread::_Statistics::hyperperiod_count[Traits<Build>::CPUS];
-TSC::Time_Stamp Thread::_Statistics::hyperperiod_idle_time[Traits<Build>::CPUS];
-TSC::Time_Stamp Thread::_Statistics::idle_time[Traits<Build>::CPUS];
-TSC::Time_Stamp Thread::_Statistics::last_idle[Traits<Build>::CPUS];
+Per_CPU<TSC::Time_Stamp> Thread::_Statistics::idle_time;
+Per_CPU<TSC::Time_Stamp> Thread::_Statistics::last_idle;
 
 
 // Methods
-void Thread::constructor_prologue(const Color & color, unsigned int stack_size)
+void Thread::constructor_prologue(const Color & color, unsigned int stack_size, char * stack)
 {
     lock();
 
     _thread_count++;
     _scheduler.insert(this);
 
-    if(Traits<MMU>::colorful && color != WHITE)
+    if(stack)
+        _stack = stack;
+    else if(Traits<MMU>::colorful && color != WHITE)
         _stack = new (color) char[stack_size];
     else
         _stack = new (SYSTEM) char[stack_size];
+    _stack_size = stack_size;
+    _own_stack = !stack;
+
+    if(stack_watermark)
+        memset(_stack, STACK_PAINT, stack_size);
 }
 
 
@@ -115,9 +122,57 @@ Thread::~Thread()
     if(_joining)
         _joining->resume();
 
+    if(stack_watermark)
+        kout << "Thread(" << this << ") stack high-water marks: system=" << stack_high_water() << ",user=" << user_stack_high_water() << endl;
+
     unlock();
 
-    delete _stack;
+    if(_own_stack)
+        delete _stack;
+}
+
+
+unsigned int Thread::stack_high_water() const
+{
+    if(!stack_watermark)
+        return 0;
+
+    // The lowest word of the stack is overwritten with the exit status (see exit())
+    unsigned int untouched = sizeof(int);
+    while((untouched < _stack_size) && (static_cast<unsigned char>(_stack[untouched]) == STACK_PAINT))
+        untouched++;
+
+    return _stack_size - untouched;
+}
+
+
+unsigned int Thread::user_stack_high_water() const
+{
+    // Demand-paged stacks only grow, so the frames backing them account for their deepest use (rounded to pages)
+    return (demand_paged && _user_stack) ? _user_stack->resident() : 0;
+}
+
+
+unsigned long long Thread::pmu_events(const PMU_Event & event, bool job) const
+{
+    if(!pmu_virtualized)
+        return 0;
+
+    unsigned int i;
+    for(i = 0; (i < PMU_EVENTS) && (Traits<Thread>::PMU_EVENTS[i] != event); i++);
+    if(i == PMU_EVENTS)
+        return 0;
+
+    if(!job && (running() == this)) { // bring the running thread's counts up to date
+        bool disabled = CPU::int_disabled();
+        if(!disabled)
+            CPU::int_disable();
+        pmu_charge(const_cast<Thread *>(this));
+        if(!disabled)
+            CPU::int_enable();
+    }
+
+    return job ? _statistics.pmu_job_events[i] : _statistics.pmu_events[i];
 }
 
 
@@ -139,7 +194,7 @@ void Thread::priority(const Criterion & c)
 
     db<Thread>(TRC) << "Thread::priority(this=" << this << ",prio=" << c << ")" << endl;
 
-//    unsigned int old_cpu = _link.rank().queue();
+    unsigned int old_cpu = _link.rank().queue();
 
     if(_state != RUNNING) { // reorder the scheduling queue
         _scheduler.remove(this);
@@ -150,6 +205,10 @@ void Thread::priority(const Criterion & c)
 
     unsigned int new_cpu = _link.rank().queue();
 
+    Tracer::record(Tracer::PRIORITY, this, int(c));
+    if(new_cpu != old_cpu)
+        Tracer::record(Tracer::MIGRATION, this, new_cpu);
+
     if(preemptive) {
 //        if(old_cpu != CPU::id()) {
 //            reschedule(old_cpu);
@@ -221,6 +280,7 @@ void Thread::suspend(bool locked)
 
     _state = SUSPENDED;
     _scheduler.suspend(this);
+    Tracer::record(Tracer::SLEEP, this);
 
     Thread * next = running();
 
@@ -237,6 +297,7 @@ void Thread::resume()
     if(_state == SUSPENDED) {
         _state = READY;
         _scheduler.resume(this);
+        Tracer::record(Tracer::WAKEUP, this, _link.rank().queue());
 
         if(preemptive)
             reschedule(_link.rank().queue());
@@ -299,6 +360,7 @@ void Thread::sleep(Thread_Queue * q)
     prev->_state = WAITING;
     prev->_waiting = q;
     q->insert(&prev->_link);
+    Tracer::record(Tracer::SLEEP, prev, q);
 
     dispatch(prev, _scheduler.chosen());
 }
@@ -315,6 +377,7 @@ void Thread::sleep(FIFO_Queue * q)
     prev->_state = WAITING;
     prev->_waiting_fifo = q;
     q->insert(&prev->_link);
+    Tracer::record(Tracer::SLEEP, prev, q);
 
     dispatch(prev, _scheduler.chosen());
 }
@@ -331,6 +394,7 @@ void Thread::wakeup(Thread_Queue * q)
         t->_state = READY;
         t->_waiting = 0;
         _scheduler.resume(t);
+        Tracer::record(Tracer::WAKEUP, t, t->_link.rank().queue());
 
         if(preemptive)
             reschedule(t->_link.rank().queue());
@@ -352,6 +416,7 @@ void Thread::wakeup(FIFO_Queue * q)
         t->_state = READY;
         t->_waiting_fifo = 0;
         _scheduler.resume(t);
+        Tracer::record(Tracer::WAKEUP, t, t->_link.rank().queue());
 
         if(preemptive)
             reschedule(t->_link.rank().queue());
@@ -377,6 +442,7 @@ void Thread::wakeup_all(Thread_Queue * q)
             t->_state = READY;
             t->_waiting = 0;
             _scheduler.resume(t);
+            Tracer::record(Tracer::WAKEUP, t, t->_link.rank().queue());
             cpus |= 1 << t->_link.rank().queue();
         }
 
@@ -405,6 +471,7 @@ void Thread::wakeup_all(FIFO_Queue * q)
             t->_state = READY;
             t->_waiting_fifo = 0;
             _scheduler.resume(t);
+            Tracer::record(Tracer::WAKEUP, t, t->_link.rank().queue());
             cpus |= 1 << t->_link.rank().queue();
         }
 
@@ -440,6 +507,7 @@ void Thread::reschedule(unsigned int cpu)
         reschedule();
     else {
         db<Thread>(TRC) << "Thread::reschedule(cpu=" << cpu << ")" << endl;
+        Tracer::record(Tracer::IPI_SEND, cpu, IC::INT_RESCHEDULER);
         IC::ipi(cpu, IC::INT_RESCHEDULER);
         unlock();
     }
@@ -450,6 +518,8 @@ void Thread::rescheduler(IC::Interrupt_Id i)
 {
     lock();
 
+    Tracer::record(Tracer::IPI_RECEIVE, i);
+
     reschedule();
 }
 
@@ -484,27 +554,13 @@ void Thread::dispatch(Thread * prev, Thread * next, bool charge)
             if(INARRAY(Traits<Monitor>::SYSTEM_EVENTS, Traits<Monitor>::THREAD_EXECUTION_TIME)) {
                 if(prev->priority() != IDLE)
                     prev->_statistics.execution_time += ts - prev->_statistics.last_execution;
-                if((prev->priority() > Criterion::PERIODIC) && (prev->priority() < Criterion::APERIODIC)) { // a real-time thread
-                    if(prev->_statistics.hyperperiod_count_thread < prev->_statistics.hyperperiod_count[cpu]) { // only happen when usage is 100%
-                        // if this is not being called after a wait_next, deadline miss...
-                        prev->_statistics.hyperperiod_average_execution_time = prev->_statistics.average_execution_time/prev->_statistics.jobs;
-                        prev->_statistics.hyperperiod_jobs = prev->_statistics.jobs;
-                        prev->_statistics.average_execution_time = 0;
-                        prev->_statistics.jobs = 0;
-                    }
-                }
                 if(next->priority() != IDLE)
                     next->_statistics.last_execution = ts;
-                if((next->priority() > Criterion::PERIODIC) && (next->priority() < Criterion::APERIODIC)) { // a real-time thread
-                    if (next->_statistics.hyperperiod_count_thread < next->_statistics.hyperperiod_count[cpu]) {
-                        next->_statistics.hyperperiod_average_execution_time = next->_statistics.average_execution_time/next->_statistics.jobs;
-                        next->_statistics.hyperperiod_jobs = next->_statistics.jobs;
-                        next->_statistics.average_execution_time = 0;
-                        next->_statistics.jobs = 0;
-                    }
-                }
             }
         }
+        if(pmu_virtualized && (prev != next))
+            pmu_charge(prev); // next is implicitly rebased by _pmu_base
+
         Monitor::run();
     }
 
@@ -513,10 +569,14 @@ void Thread::dispatch(Thread * prev, Thread * next, bool charge)
             prev->_state = READY;
         next->_state = RUNNING;
 
+        Tracer::record(Tracer::DISPATCH, prev, next);
+        Governor::apply();
+
         db<Thread>(TRC) << "Thread::dispatch(prev=" << prev << ",next=" << next << ")" << endl;
         db<Thread>(INF) << "prev={" << prev << ",ctx=" << *prev->_context << "}" << endl;
         db<Thread>(INF) << "next={" << next << ",ctx=" << *next->_context << "}" << endl;
 
+        Latency::end(Latency::PREEMPTION);
         if(smp)
             _lock.release();
 
@@ -530,15 +590,69 @@ void Thread::dispatch(Thread * prev, Thread * next, bool charge)
         // passing the volatile to switch_constext forces it to push prev onto the stack,
         // disrupting the context (it doesn't make a difference for Intel, which already saves
         // parameters on the stack anyway).
+        // Threads that run for the first time do not return here, so the interrupts-off section ends now.
+        Latency::end(Latency::INTERRUPTS);
         CPU::switch_context(const_cast<Context **>(&prev->_context), next->_context);
-    } else
+    } else {
+        Latency::end(Latency::PREEMPTION);
         if(smp)
             _lock.release();
+    }
 
+    Latency::end(Latency::INTERRUPTS);
     CPU::int_enable();
 }
 
 
+void Thread::pmu_charge(Thread * t)
+{
+#ifdef __PMU_H
+    unsigned int cpu = CPU::id();
+    for(unsigned int i = 0; i < PMU_EVENTS; i++) {
+        if(!_pmu_clerks[cpu][i])
+            continue;
+        unsigned long long now = _pmu_clerks[cpu][i]->read();
+        t->_statistics.pmu_events[i] += now - _pmu_base[cpu][i];
+        _pmu_base[cpu][i] = now;
+    }
+#endif
+}
+
+
+void Thread::pmu_job_end(Thread * t)
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    pmu_charge(t);
+    for(unsigned int i = 0; i < PMU_EVENTS; i++) {
+        t->_statistics.pmu_job_events[i] = t->_statistics.pmu_events[i] - t->_statistics.pmu_job_start[i];
+        t->_statistics.pmu_job_start[i] = t->_statistics.pmu_events[i];
+    }
+    if(!disabled)
+        CPU::int_enable();
+}
+
+
+bool Thread::stack_fault(const Log_Addr & address)
+{
+    // Called by the page fault handler with interrupts disabled
+    if(!demand_paged)
+        return false;
+
+    Thread * t = running();
+    if(!t || !t->_user_stack || (address < t->_user_stack_address) || (address >= t->_user_stack_address + t->_user_stack->size()))
+        return false;
+
+    if(t->_user_stack->populate(address - t->_user_stack_address))
+        return true;
+
+    db<Thread>(WRN) << "Thread::stack_fault(this=" << t << ",addr=" << address << "): stack overflow!" << endl;
+
+    return false;
+}
+
+
 int Thread::idle()
 {
     db<Thread>(TRC) << "Thread::idle(cpu=" << CPU::id() << ",this=" << running() << ")" << endl;
@@ -548,8 +662,7 @@ int Thread::idle()
         if(Traits<Thread>::trace_idle)
             db<Thread>(TRC) << "Thread::idle(cpu=" << CPU::id() << ",this=" << running() << ")" << endl;
 
-        CPU::int_enable();
-        CPU::halt();
+        Governor::idle(); // enables interrupts and halts
 
         if(_scheduler.schedulables() > 0) // A thread might have been woken up by another CPU
             yield();
@@ -560,6 +673,13 @@ int Thread::idle()
         if(monitored)
             Monitor::process_batch();
 
+        Tracer::dump();
+#ifdef __PMU_H
+        Profiler::dump();
+#endif
+        Latency::dump();
+        Governor::dump();
+
         kout << "The last thread has exited!" << endl;
         if(reboot) {
             db<Thread>(WRN) << "Rebooting the machine ..." << endl;
@@ -10,6 +10,24 @@ __BEGIN_SYS
 
 extern "C" { void __epos_app_entry(); }
 
+// Indexed at run time by the per-thread PMU counters
+constexpr Traits_Tokens::PMU_Event Traits<Thread>::PMU_EVENTS[];
+
+void Thread::pmu_init()
+{
+    db<Init, Thread>(TRC) << "Thread::pmu_init()" << endl;
+
+#ifdef __PMU_H
+    unsigned int cpu = CPU::id();
+    for(unsigned int i = 0; i < PMU_EVENTS; i++) {
+        _pmu_clerks[cpu][i] = new (SYSTEM) Clerk<PMU>(Traits<Thread>::PMU_EVENTS[i]);
+        _pmu_base[cpu][i] = _pmu_clerks[cpu][i]->read();
+    }
+#else
+    db<Init, Thread>(WRN) << "Thread::pmu_init: no PMU in this architecture, per-thread counters will read 0!" << endl;
+#endif
+}
+
 void Thread::init()
 {
     typedef int (* Main)(int argc, char * argv[]);
@@ -21,6 +39,9 @@ void Thread::init()
     if(monitored)
         Monitor::init();
 
+    if(pmu_virtualized)
+        pmu_init();
+
     static volatile bool task_ready = false;
 
     if(CPU::id() == 0) {
@@ -0,0 +1,32 @@
+// EPOS Scheduler Tracer Implementation
+
+#include <tracer.h>
+
+__BEGIN_SYS
+
+// Class attributes
+Tracer::Event Tracer::_ring[CPUS][EVENTS];
+Per_CPU<unsigned int> Tracer::_head;
+
+// Methods
+void Tracer::dump()
+{
+    if(!enabled)
+        return;
+
+    OStream os; // like Monitor::process_batch(), to keep lines parsable
+    os << "begin_trace" << endl;
+    os << "TSC," << TSC::frequency() << endl;
+    for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+        unsigned int head = _head[cpu];
+        unsigned int first = (head > EVENTS) ? head - EVENTS : 0;
+        os << "CPU" << cpu << ",recorded=" << head << ",lost=" << first << endl;
+        for(unsigned int i = first; i < head; i++) {
+            const Event & e = _ring[cpu][i & (EVENTS - 1)];
+            os << "TRACE," << cpu << "," << e.ts << "," << e.type << "," << e.a << "," << e.b << endl;
+        }
+    }
+    os << "end_trace" << endl;
+}
+
+__END_SYS
@@ -0,0 +1,53 @@
+// EPOS Network Interface Mediator Common Package Implementation
+
+#include <machine/nic.h>
+#include <process.h>
+#include <synchronizer.h>
+#include <system.h>
+
+__BEGIN_SYS
+
+// Methods
+Deferred_Receiver::~Deferred_Receiver()
+{
+    if(_thread) {
+        delete _thread;
+        delete _semaphore;
+    }
+}
+
+void Deferred_Receiver::start(int priority, unsigned int budget)
+{
+    if(_thread)
+        return;
+
+    db<Thread>(TRC) << "Deferred_Receiver::start(this=" << this << ",p=" << priority << ",b=" << budget << ")" << endl;
+
+    _budget = budget;
+    _semaphore = new (SYSTEM) Semaphore(0);
+    _thread = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::Criterion(priority)), &receiver, this);
+}
+
+void Deferred_Receiver::wake()
+{
+    _semaphore->v();
+}
+
+int Deferred_Receiver::receiver(Deferred_Receiver * r)
+{
+    while(true) {
+        r->_semaphore->p();
+
+        for(unsigned int n = r->_budget; n == r->_budget; ) {
+            n = r->poll(r->_budget);
+            r->_rounds++;
+            r->_frames += n;
+            if(n == r->_budget) // budget exhausted, let other threads of the same priority run before the next round
+                Thread::yield();
+        }
+    }
+
+    return 0;
+}
+
+__END_SYS
@@ -114,6 +114,7 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
     // Tx_Desc Ring
     _tx_cur = 1;
     _tx_prev = 0;
+    _posts = 0;
     _tx_ring = log;
     _tx_ring_phy = phy;
 
@@ -390,11 +391,36 @@ void E100::free(Buffer * buf)
     }
 }
 
+int E100::send(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    drain();
+    unlock();
+
+    return size;
+}
+
+int E100::post(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    unlock();
+
+    return size;
+}
+
+void E100::flush()
+{
+    lock();
+    drain();
+    unlock();
+}
+
 /*! NOTE: this method is not thread-safe because _tx_buffer_prev is shared by
  * all threads that use this object. */
-int E100::send(Buffer * buf)
+int E100::enqueue(Buffer * buf)
 {
-    db<E100>(TRC) << "E100::send new api" << endl;
     /// assumes: buf->is_locked();
 
     unsigned int size = 0;
@@ -404,50 +430,62 @@ int E100::send(Buffer * buf)
         Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
         Ethernet::Frame * frame = buf->frame();
 
-        db<E100>(TRC) << "E100::send(buf=" << buf << ")" << endl;
+        db<E100>(TRC) << "E100::post(buf=" << buf << ")" << endl;
+
+        if(_posts == TX_BUFS)
+            drain();
 
         desc->tcb_byte_count = buf->size() + sizeof(Ethernet::Header);
 
-        db<E100>(TRC) << "E100::send-zc:\n" << "(dst=" << frame->dst() << ", prot=" << frame->prot() << ", data=" << (char *) frame->data<void>() << ", size=" << buf->size() << ")" << endl;
+        db<E100>(TRC) << "E100::post-zc:\n" << "(dst=" << frame->dst() << ", prot=" << frame->prot() << ", data=" << (char *) frame->data<void>() << ", size=" << buf->size() << ")" << endl;
 
         new (desc->frame()) Ethernet::Frame(_address, frame->dst(), frame->prot(), frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
 
         // Status must be set last, since it can trigger a send
         desc->status = Tx_CB_IN_USE;
 
-        // Trigger an immediate send poll
+        // Chain the frame after the previous one, the CU will only get to it after the next cuc_resume
         desc->command = cb_s; // suspend bit
         desc->command |= (cb_tx | cb_cid); // transmit command
         reinterpret_cast<Tx_Desc *>(_tx_buffer_prev->back())->command &= ~cb_s; // remove suspend bit of the previous frame
-
-        while(exec_command(cuc_resume, 0));
+        _tx_buffer_prev = buf;
+        _posted[_posts++] = buf;
 
         size += buf->size();
 
         _statistics.tx_packets++;
         _statistics.tx_bytes += buf->size();
 
-        db<E100>(INF) << "E100::send:desc=" << desc << " => " << *desc << endl;
+        db<E100>(INF) << "E100::post:desc=" << desc << " => " << *desc << endl;
+    }
+
+    db<E100>(TRC) << "E100::post size=" << size << endl;
+
+    return size;
+}
+
+void E100::drain()
+{
+    if(!_posts)
+        return;
+
+    db<E100>(TRC) << "E100::flush(frames=" << _posts << ")" << endl;
+
+    // A single resume sends all the posted frames, up to the last one, which still has the suspend bit set
+    while(exec_command(cuc_resume, 0));
 
-        // Wait for packet to be sent and unlock the respective buffer
+    // Wait for the frames to be sent and unlock the respective buffers
+    for(unsigned int i = 0; i < _posts; i++) {
+        Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(_posted[i]->back());
         while(! (desc->status & cb_complete)) {
             if (_tx_cuc_suspended) {
                 _tx_cuc_suspended = 0;
                 exec_command(cuc_resume, 0);
             }
         }
-
-        db<E100>(TRC) << "E100::send will unlock" << endl;
-
-        _tx_buffer_prev = buf;
-        buf->unlock();
-
-        db<E100>(TRC) << "E100::send unlocked" << endl;
+        _posted[i]->unlock();
     }
-
-    db<E100>(TRC) << "E100::send size=" << size << endl;
-
-    return size;
+    _posts = 0;
 }
 
 unsigned short E100::eeprom_read(unsigned short *addr_len, unsigned short addr) {
@@ -533,66 +571,14 @@ void E100::handle_int() {
             _rx_ruc_no_more_resources++;
         }
 
-        for(int count = RX_BUFS; count && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
-            db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
-
-            // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-            if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
-                Buffer * buf = _rx_buffer[_rx_cur];
-                Rx_Desc * desc = &_rx_ring[_rx_cur];
-                Frame * frame = buf->frame();
-
-                Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
-
-                // For the upper layers, size will represent the size of frame->data<T>()
-                unsigned int size = 0;
-                if (_rx_ring[_rx_cur].actual_count & (RFD_EOF_MASK | RFD_F_MASK)) {
-                    size = _rx_ring[_rx_cur].actual_count & RFD_ACTUAL_COUNT_MASK;
-                }
-                else if (_rx_ring[_rx_cur].actual_count & RFD_F_MASK) {
-                    db<E100>(WRN) << "HDS size" << endl;
-                }
-                else if (! (_rx_ring[_rx_cur].actual_count & RFD_F_MASK)) {
-                    db<E100>(WRN) << "Invalid RFD" << endl;
-                    // Workaround if QEMU patch not applied
-                    // http://patchwork.ozlabs.org/patch/662355/
-                    db<E100>(WRN) << "Assuming size to be 1500" << endl;
-                    size = 1500;
-                    // ----
-                }
-                buf->size(size);
-
-                if (! (_rx_ring[_rx_cur].status & RFD_OK_MASK))
-                    db<E100>(WRN) << "Error on frame reception" << endl;
-
-                db<E100>(INF) << "E100::int:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
-
-                db<E100>(INF) << "E100::int:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                db<E100>(INF) << "E100::handle_int:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
-
-                _rx_ring[_rx_cur].command = cb_el;
-                _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
-
-                // try to avoid ruc stop interrupts by "walking" the el bit
-                _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
-                _rx_last_el = _rx_cur;
-
-                _statistics.rx_packets++;
-                _statistics.rx_bytes += size;
-
-                db<E100>(TRC) << "Will notify!" << endl;
-                if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
-                    free(buf);
-                    db<E100>(TRC) << "Not notified!" << endl;
-                }
-                else {
-                    db<E100>(TRC) << "Notified!" << endl;
-                }
+        if(deferred && started()) {
+            if(stat_ack & (FR | RNR)) {
+                // Leave the frames to the receiver thread, which will unmask RX interrupts once it has drained the ring
+                i82559_disable_rx_irq();
+                wake();
             }
-        }
+        } else
+            handle_rx(RX_BUFS);
     }
 
     db<E100>(TRC) << "<" << endl;
@@ -601,6 +587,91 @@ void E100::handle_int() {
     // IC::enable(IC::irq2int(_irq));
 }
 
+unsigned int E100::handle_rx(unsigned int budget)
+{
+    unsigned int handled = 0;
+
+    for(int count = RX_BUFS; count && (handled < budget) && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
+        db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
+
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[_rx_cur];
+            Rx_Desc * desc = &_rx_ring[_rx_cur];
+            Frame * frame = buf->frame();
+
+            Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
+
+            // For the upper layers, size will represent the size of frame->data<T>()
+            unsigned int size = 0;
+            if (_rx_ring[_rx_cur].actual_count & (RFD_EOF_MASK | RFD_F_MASK)) {
+                size = _rx_ring[_rx_cur].actual_count & RFD_ACTUAL_COUNT_MASK;
+            }
+            else if (_rx_ring[_rx_cur].actual_count & RFD_F_MASK) {
+                db<E100>(WRN) << "HDS size" << endl;
+            }
+            else if (! (_rx_ring[_rx_cur].actual_count & RFD_F_MASK)) {
+                db<E100>(WRN) << "Invalid RFD" << endl;
+                // Workaround if QEMU patch not applied
+                // http://patchwork.ozlabs.org/patch/662355/
+                db<E100>(WRN) << "Assuming size to be 1500" << endl;
+                size = 1500;
+                // ----
+            }
+            buf->size(size);
+
+            if (! (_rx_ring[_rx_cur].status & RFD_OK_MASK))
+                db<E100>(WRN) << "Error on frame reception" << endl;
+
+            db<E100>(INF) << "E100::handle_rx:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
+
+            db<E100>(INF) << "E100::handle_rx:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            db<E100>(INF) << "E100::handle_rx:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
+
+            _rx_ring[_rx_cur].command = cb_el;
+            _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
+
+            // try to avoid ruc stop interrupts by "walking" the el bit
+            _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
+            _rx_last_el = _rx_cur;
+
+            _statistics.rx_packets++;
+            _statistics.rx_bytes += size;
+
+            db<E100>(TRC) << "Will notify!" << endl;
+            if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+                db<E100>(TRC) << "Not notified!" << endl;
+            }
+            else {
+                db<E100>(TRC) << "Notified!" << endl;
+            }
+
+            handled++;
+        }
+    }
+
+    return handled;
+}
+
+unsigned int E100::poll(unsigned int budget)
+{
+    unsigned int handled = handle_rx(budget);
+
+    // A frame arriving after the ring was found empty leaves FR pending, so it will interrupt once unmasked
+    // The ISR also writes the mask, so interrupts are kept out while it is rewritten
+    if(handled < budget) {
+        lock();
+        i82559_enable_irq();
+        unlock();
+    }
+
+    return handled;
+}
+
 void E100::i82559_configure(void)
 {
     configCB->command = cb_config;
@@ -8,6 +8,7 @@ __BEGIN_SYS
 // Class attributes
 APIC::Log_Addr APIC::_base;
 IC::Interrupt_Handler IC::_int_vector[IC::INTS];
+IC::PMI_Handler IC::_pmi_handler;
 
 
 // APIC class methods
@@ -1,6 +1,7 @@
 // EPOS PC Interrupt Dispatcher
 
 #include <machine/ic.h>
+#include <process.h>
 
 extern "C" { void _exit(int s); }
 extern "C" { void __exit(); }
@@ -828,6 +829,47 @@ void IC::exc_pf(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error)
     _exit(-1);
 }
 
+// Page faults on demand-paged stacks are serviced and return to the faulting instruction; all others fall through to exc_pf()
+void IC::exc_pf_entry()
+{
+    ASM("        pushal                 \n"
+        "        movl   %%cr2, %%eax    \n"
+        "        pushl  %%eax           \n"
+        "        call   %P0             \n"
+        "        addl   $4, %%esp       \n"
+        "        testb  %%al, %%al      \n"
+        "        jz     .PF_FATAL       \n"
+        "        popal                  \n"
+        "        addl   $4, %%esp       \n" // error code
+        "        iret                   \n"
+        ".PF_FATAL:                     \n"
+        "        popal                  \n"
+        "        jmp    %P1             \n" : : "i"(&exc_pf_demand), "i"(&exc_pf));
+}
+
+bool IC::exc_pf_demand(Reg32 address)
+{
+    return Thread::stack_fault(address);
+}
+
+// PMIs are delivered by the local APIC (LVT_PERF) and need no priority ceiling, so they skip dispatch()
+void IC::pmi_entry()
+{
+    ASM("        pushal                 \n"
+        "        pushl  32(%%esp)       \n" // interrupted eip
+        "        call   %P0             \n"
+        "        addl   $4, %%esp       \n"
+        "        popal                  \n"
+        "        iret                   \n" : : "i"(&pmi));
+}
+
+void IC::pmi(Reg32 eip)
+{
+    if(_pmi_handler)
+        _pmi_handler(eip);
+    APIC::eoi(INT_PMU);
+}
+
 void IC::exc_gpf(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error)
 {
     db<IC,Machine>(WRN) << "IC::exc_gpf(cs=" << hex << cs << ",ip=" << reinterpret_cast<void *>(eip) << ",fl=" << eflags << ")" << endl;
@@ -20,11 +20,18 @@ void IC::init()
             idt[i] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(entry) + CPU::EXC_LAST * 16, CPU::SEG_IDT_ENTRY);
 
     // Install some important exception handlers
-    idt[CPU::EXC_PF]     = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
+    if(Traits<System>::multitask && Traits<Thread>::demand_paged_stacks)
+        idt[CPU::EXC_PF] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf_entry), CPU::SEG_IDT_ENTRY);
+    else
+        idt[CPU::EXC_PF] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_DOUBLE] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_GPF]    = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_gpf), CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_NODEV]  = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_fpu), CPU::SEG_IDT_ENTRY);
 
+    // Install the PMU overflow handler used by the Profiler
+    if(Traits<Profiler>::enabled)
+        idt[INT_PMU] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&pmi_entry), CPU::SEG_IDT_ENTRY);
+
     // Install the syscall trap handler
     if(Traits<Build>::MODE == Traits<Build>::KERNEL)
         idt[INT_SYSCALL] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&CPU::syscalled), CPU::SEG_IDT_ENTRY);
@@ -20,41 +20,21 @@ PCNet32::~PCNet32()
 
 int PCNet32::send(const Address & dst, const Protocol & prot, const void * data, unsigned int size)
 {
-    // Wait for a buffer to become free and seize it
-    unsigned int i = _tx_cur;
-    for(bool locked = false; !locked; ) {
-        for(; _tx_ring[i].status & Tx_Desc::OWN; ++i %= TX_BUFS);
-        locked = _tx_buffer[i]->lock();
-    }
-    _tx_cur = (i + 1) % TX_BUFS; // _tx_cur and _rx_cur are simple accelerators to avoid scanning the ring buffer from the beginning.
-                                 // Losing a write in a race condition is assumed to be harmless. The FINC + CAS alternative seems too expensive.
-    Tx_Desc * desc = &_tx_ring[i];
-    Buffer * buf = _tx_buffer[i];
-
     db<PCNet32>(TRC) << "PCNet32::send(s=" << _address << ",d=" << dst << ",p=" << hex << prot << dec << ",d=" << data << ",s=" << size << ")" << endl;
 
-    // Assemble the Ethernet frame
-    new (buf->frame()) Frame(_address, dst, prot, data, size);
-
-    desc->size = -(size + sizeof(Header)); // 2's comp.
-
-    // Status must be set last, since it can trigger a send
-    desc->status = Tx_Desc::OWN | Tx_Desc::STP | Tx_Desc::ENP;
-
-    // Trigger an immediate send poll
-    csr(0, csr(0) | CSR0_TDMD);
-
-    _statistics.tx_packets++;
-    _statistics.tx_bytes += size;
-
-    // Wait for packet to be sent
-    // while(desc->status & Tx_Desc::OWN);
+    // A single frame through alloc() and send(Buffer *), so the ring and the RAP are only touched under lock()
+    if(size > MTU) {
+        db<PCNet32>(WRN) << "PCNet32::send: frame too long!" << endl;
+        return 0;
+    }
 
-    db<PCNet32>(INF) << "PCNet32::send:desc[" << i << "]=" << desc << " => " << *desc << endl;
+    Buffer * buf = size ? alloc(dst, prot, 0, 0, size) : 0;
+    if(!buf)
+        return 0;
 
-    buf->unlock();
+    memcpy(buf->frame()->data<void>(), data, size);
 
-    return size;
+    return send(buf);
 }
 
 
@@ -140,6 +120,33 @@ PCNet32::Buffer * PCNet32::alloc(const Address & dst, const Protocol & prot, uns
 
 
 int PCNet32::send(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    drain();
+    unlock();
+
+    return size;
+}
+
+int PCNet32::post(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    unlock();
+
+    return size;
+}
+
+void PCNet32::flush()
+{
+    lock();
+    drain();
+    unlock();
+}
+
+
+int PCNet32::enqueue(Buffer * buf)
 {
     unsigned int size = 0;
 
@@ -147,34 +154,51 @@ int PCNet32::send(Buffer * buf)
         buf = el->object();
         Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
 
-        db<PCNet32>(TRC) << "PCNet32::send(buf=" << buf << ")" << endl;
+        db<PCNet32>(TRC) << "PCNet32::post(buf=" << buf << ")" << endl;
+
+        db<PCNet32>(INF) << "PCNet32::post:buf=" << buf << " => " << *buf << endl;
 
-        db<PCNet32>(INF) << "PCNet32::send:buf=" << buf << " => " << *buf << endl;
+        if(_posts == TX_BUFS)
+            drain();
 
         desc->size = -(buf->size() + sizeof(Header)); // 2's comp.
 
-        // Status must be set last, since it can trigger a send
+        // Status must be set last, but since polling is disabled (CSR4_DPOLL), the frame will only be sent at the next TDMD
         desc->status = Tx_Desc::OWN | Tx_Desc::STP | Tx_Desc::ENP;
-
-        // Trigger an immediate send poll
-        csr(0, csr(0) | CSR0_TDMD);
+        _posted[_posts++] = buf;
 
         size += buf->size();
 
         _statistics.tx_packets++;
         _statistics.tx_bytes += buf->size();
 
-        db<PCNet32>(INF) << "PCNet32::send:desc=" << desc << " => " << *desc << endl;
-
-        // Wait for packet to be sent and unlock the respective buffer
-        while(desc->status & Tx_Desc::OWN);
-        buf->unlock();
+        db<PCNet32>(INF) << "PCNet32::post:desc=" << desc << " => " << *desc << endl;
     }
 
     return size;
 }
 
 
+void PCNet32::drain()
+{
+    if(!_posts)
+        return;
+
+    db<PCNet32>(TRC) << "PCNet32::flush(frames=" << _posts << ")" << endl;
+
+    // Trigger a single send poll for all posted frames
+    csr(0, csr(0) | CSR0_TDMD);
+
+    // Wait for the frames to be sent and unlock the respective buffers
+    for(unsigned int i = 0; i < _posts; i++) {
+        Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(_posted[i]->back());
+        while(desc->status & Tx_Desc::OWN);
+        _posted[i]->unlock();
+    }
+    _posts = 0;
+}
+
+
 void PCNet32::free(Buffer * buf)
 {
     db<PCNet32>(TRC) << "PCNet32::free(buf=" << buf << ")" << endl;
@@ -188,6 +212,19 @@ void PCNet32::free(Buffer * buf)
         _statistics.rx_packets++;
         _statistics.rx_bytes += buf->size();
 
+        if(!desc) { // swapped out of the ring by refill(), so back to the spare pool
+            buf->unlock();
+            bool disabled = CPU::int_disabled();
+            if(!disabled)
+                CPU::int_disable();
+            _spares.insert(buf->link2());
+            if(!disabled)
+                CPU::int_enable();
+
+            db<PCNet32>(INF) << "PCNet32::free:spares=" << _spares.size() << endl;
+            continue;
+        }
+
         // Release the buffer to the NIC
         desc->size = Reg16(-sizeof(Frame)); // 2's comp.
         desc->status = Rx_Desc::OWN; // Owned by NIC
@@ -288,16 +325,17 @@ void PCNet32::reset()
 
 void PCNet32::handle_int()
 {
-    if(csr(0) & CSR0_INTR) {
-        int csr0 = csr(0);
-        int csr4 = csr(4);
-        int csr5 = csr(5);
-
+    lock(); // the RAP is shared with threads, possibly on other CPUs
+    int csr0 = csr(0);
+    if(csr0 & CSR0_INTR) {
         // Clear interrupts (i.e. acknowledge them)
         csr(0, csr0);
-        csr(4, csr4);
-        csr(5, csr5);
+        csr(4, csr(4));
+        csr(5, csr(5));
+    }
+    unlock();
 
+    if(csr0 & CSR0_INTR) {
         if(csr0 & CSR0_IDON) { // Initialization done
             // This should never happen, since IDON is disabled in reset()
             // and all the initialization is controlled via polling, so if
@@ -307,34 +345,22 @@ void PCNet32::handle_int()
             reset();
         }
 
-        if(csr0 & CSR0_RINT) { // Frame received (possibly multiple, let's handle a whole round on the ring buffer)
-
-            // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
-            // Therefore, several instances of this code can compete to handle received buffers
-
-            for(unsigned int count = RX_BUFS, i = _rx_cur; count && !(_rx_ring[i].status & Rx_Desc::OWN); count--, ++i %= RX_BUFS, _rx_cur = i) {
-                // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-                if(_rx_buffer[i]->lock()) { // if it wasn't, let's handle it
-                    Buffer * buf = _rx_buffer[i];
-                    Rx_Desc * desc = &_rx_ring[i];
-                    Frame * frame = buf->frame();
-
-                    // For the upper layers, size will represent the size of frame->data<T>()
-                    buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
-
-                    db<PCNet32>(TRC) << "PCNet32::handle_int:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
-                                     << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                    db<PCNet32>(INF) << "PCNet32::handle_int:desc[" << i << "]=" << desc << " => " << *desc << endl;
-
-                    IC::disable(IC::irq2int(_irq));
-                    if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
-                        free(buf);
-                    // TODO: this serialization is much too restrictive. It was done this way for students to play with
-                    IC::enable(IC::irq2int(_irq));
-                }
+        if(csr0 & CSR0_RINT) { // Frame received (possibly multiple)
+            if(deferred && started()) {
+                // Leave the frames to the receiver thread, which will unmask RINT once it has drained the ring
+                lock();
+                csr(3, csr(3) | CSR3_RINTM);
+                unlock();
+                wake();
+            } else {
+                // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
+                // Therefore, several instances of this code can compete to handle received buffers
+                IC::disable(IC::irq2int(_irq));
+                handle_rx(RX_BUFS); // a whole round on the ring buffer
+                // TODO: this serialization is much too restrictive. It was done this way for students to play with
+                IC::enable(IC::irq2int(_irq));
             }
- 	}
+        }
 
         if(csr0 & CSR0_ERR) { // Error
             db<PCNet32>(WRN) << "PCNet32::handle_int:error =>";
@@ -364,6 +390,83 @@ void PCNet32::handle_int()
 }
 
 
+unsigned int PCNet32::handle_rx(unsigned int budget)
+{
+    unsigned int handled = 0;
+
+    for(unsigned int count = RX_BUFS, i = _rx_cur; count && (handled < budget) && !(_rx_ring[i].status & Rx_Desc::OWN); count--, ++i %= RX_BUFS, _rx_cur = i) {
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[i]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[i];
+            Rx_Desc * desc = &_rx_ring[i];
+            Frame * frame = buf->frame();
+
+            // For the upper layers, size will represent the size of frame->data<T>()
+            buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
+
+            db<PCNet32>(TRC) << "PCNet32::handle_rx:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
+                             << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            db<PCNet32>(INF) << "PCNet32::handle_rx:desc[" << i << "]=" << desc << " => " << *desc << endl;
+
+            // Upper layers may hold buf for long (e.g. IP fragments, zero-copy views), so the descriptor gets a spare
+            refill(i);
+
+            if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+
+            handled++;
+        }
+    }
+
+    return handled;
+}
+
+
+void PCNet32::refill(unsigned int i)
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    Buffer::Element * el = _spares.remove();
+    if(!disabled)
+        CPU::int_enable();
+
+    if(!el) // no spares, so the descriptor will only be given back to the NIC at free()
+        return;
+
+    Buffer * spare = el->object();
+    Rx_Desc * desc = &_rx_ring[i];
+
+    db<PCNet32>(TRC) << "PCNet32::refill(i=" << i << ",buf=" << _rx_buffer[i] << ",spare=" << spare << ")" << endl;
+
+    _rx_buffer[i]->back(0);
+    spare->back(desc);
+    _rx_buffer[i] = spare;
+
+    desc->phy_addr = phy(spare);
+    desc->misc = 0;
+    desc->size = Reg16(-sizeof(Frame)); // 2's comp.
+    desc->status = Rx_Desc::OWN; // Owned by NIC
+}
+
+
+unsigned int PCNet32::poll(unsigned int budget)
+{
+    unsigned int handled = handle_rx(budget);
+
+    // A frame arriving after the ring was found empty sets RINT again, so it will interrupt once unmasked
+    // The ISR also goes through the RAP, so interrupts are kept out of the read-modify-write
+    if(handled < budget) {
+        lock();
+        csr(3, csr(3) & ~CSR3_RINTM);
+        unlock();
+    }
+
+    return handled;
+}
+
+
 void PCNet32::int_handler(IC::Interrupt_Id interrupt)
 {
     PCNet32 * dev = get_by_interrupt(interrupt);
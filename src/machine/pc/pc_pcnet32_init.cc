@@ -35,6 +35,7 @@ PCNet32::PCNet32(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
 
     // Tx_Desc Ring
     _tx_cur = 0;
+    _posts = 0;
     _tx_ring = log;
     _tx_ring_phy = phy;
     log += TX_BUFS * align128(sizeof(Tx_Desc));
@@ -64,6 +65,15 @@ PCNet32::PCNet32(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
         phy += align128(sizeof(Buffer));
     }
 
+    // Spare Rx_Buffers (see refill())
+    for(unsigned int i = 0; i < SPARE_BUFS; i++) {
+        Buffer * buf = new (log) Buffer(this, 0);
+        _spares.insert(buf->link2());
+
+        log += align128(sizeof(Buffer));
+        phy += align128(sizeof(Buffer));
+    }
+
     // Reset device
     reset();
 }
@@ -138,6 +138,32 @@ RTL8139::Buffer * RTL8139::alloc(const Address & dst, const Protocol & prot, uns
 
 
 int RTL8139::send(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    drain();
+    unlock();
+
+    return size;
+}
+
+int RTL8139::post(Buffer * buf)
+{
+    lock();
+    int size = enqueue(buf);
+    unlock();
+
+    return size;
+}
+
+void RTL8139::flush()
+{
+    lock();
+    drain();
+    unlock();
+}
+
+int RTL8139::enqueue(Buffer * buf)
 {
     unsigned int size = 0;
 
@@ -148,28 +174,37 @@ int RTL8139::send(Buffer * buf)
         for (; i < TX_BUFS; i++)
             if (desc == _tx_base_phy[i]) break;
 
-        db<RTL8139>(TRC) << "RTL8139::send(buf=" << buf << ",desc=" << desc << ",tx=" << _tx_base_phy[i] << ",i=" << i << ")" << endl;
+        db<RTL8139>(TRC) << "RTL8139::post(buf=" << buf << ",desc=" << desc << ",tx=" << _tx_base_phy[i] << ",i=" << i << ")" << endl;
 
+        if (_posts == TX_BUFS)
+            drain();
+
+        // The RTL8139 has no doorbell, writing the status of a descriptor starts its transmission
         unsigned short status = sizeof(Frame) & 0xfff; // write 0 on OWN bit
 
         CPU::out32(_io_port + TRSTART  + i * TX_BUFS, (long unsigned int) _tx_base_phy[i]);
         CPU::out32(_io_port + TRSTATUS + i * TX_BUFS, status);
+        _posted[_posts++] = i;
 
         size += buf->size();
 
         _statistics.tx_packets++;
         _statistics.tx_bytes += buf->size();
 
-        db<RTL8139>(INF) << "RTL8139::send:desc=" << desc << " => " << *desc << endl;
-
-        // Wait for packet to be sent and unlock the respective buffer
-        while(!(CPU::in32(_io_port + TRSTATUS + i * TX_BUFS) & OWN));
-        //buf->unlock(); // unlocked by handle int of TOK
+        db<RTL8139>(INF) << "RTL8139::post:desc=" << desc << " => " << *desc << endl;
     }
 
     return size;
 }
 
+void RTL8139::drain()
+{
+    // Wait for packets to be sent (buffers are unlocked by handle int of TOK)
+    for (unsigned int p = 0; p < _posts; p++)
+        while(!(CPU::in32(_io_port + TRSTATUS + _posted[p] * TX_BUFS) & OWN));
+    _posts = 0;
+}
+
 
 void RTL8139::free(Buffer * buf) {
     delete buf;
@@ -250,47 +285,83 @@ void RTL8139::handle_int()
         // NIC received frame(s)
         db<RTL8139>(TRC) << "ROK" << endl;
 
-        while ((CPU::in16(_io_port + CBR) < _rx_read) || 
-            ((_rx_read + sizeof(Frame)) < CPU::in16(_io_port + CBR)) // while there is pending receive packets
-            ) {
-            db<RTL8139>(TRC) << "CBR=" << (CPU::in16(_io_port + CBR)) << ",rx=" << _rx_read << endl;
-            unsigned int * rx = (unsigned int *) (_rx_buffer + _rx_read);
-            db<RTL8139>(TRC) << "rx=" << rx << endl;
-            unsigned int header = *rx;
-            db<RTL8139>(TRC) << "header=" << hex << header << endl;
-            unsigned int packet_len = (header >> 16);
-            unsigned int status = header & 0xffff;
-            rx++;
-
-            db<RTL8139>(TRC) << "packet_len=" << packet_len << endl;
-            db<RTL8139>(TRC) << "status=" << status << endl;
-
-            Frame * frame = reinterpret_cast<Frame *>(rx);
-            db<RTL8139>(TRC) << "frame src " << frame->src() << endl;
-            Buffer * buf = new (SYSTEM) Buffer(this, rx);
-            memcpy(buf->frame(), frame, sizeof(Frame));
-            db<RTL8139>(TRC) << "buff src " << buf->frame()->src() << endl;
-
+        if(deferred && started()) {
+            // Leave the frames to the receiver thread, which will unmask ROK once it has drained the buffer
+            lock();
+            CPU::out16(_io_port + IMR, CPU::in16(_io_port + IMR) & ~ROK);
+            unlock();
+            wake();
+        } else {
             IC::disable(IC::irq2int(_irq));
-            if (!notify(buf->frame()->prot(), buf))
-                free(buf);
-
-            // update CAPR
-            _rx_read += packet_len + 4;
-            _rx_read =  (_rx_read + 3) & ~3;
+            handle_rx(-1U);
+            IC::enable(IC::irq2int(_irq));
+        }
+    }
+}
 
-            if (_rx_read > RX_NO_WRAP_SIZE) {
-                _rx_read -= RX_NO_WRAP_SIZE;
-                db<RTL8139>(TRC) << "\tWRAPPED " << _rx_read << endl;
-            }
 
-            _statistics.rx_packets++;
-            _statistics.rx_bytes += packet_len;
-            CPU::out16(_io_port + CAPR, _rx_read - 0x10);
-            IC::enable(IC::irq2int(_irq));
+unsigned int RTL8139::handle_rx(unsigned int budget)
+{
+    unsigned int handled = 0;
+
+    while ((handled < budget) &&
+        ((CPU::in16(_io_port + CBR) < _rx_read) ||
+         ((_rx_read + sizeof(Frame)) < CPU::in16(_io_port + CBR))) // while there is pending receive packets
+        ) {
+        db<RTL8139>(TRC) << "CBR=" << (CPU::in16(_io_port + CBR)) << ",rx=" << _rx_read << endl;
+        unsigned int * rx = (unsigned int *) (_rx_buffer + _rx_read);
+        db<RTL8139>(TRC) << "rx=" << rx << endl;
+        unsigned int header = *rx;
+        db<RTL8139>(TRC) << "header=" << hex << header << endl;
+        unsigned int packet_len = (header >> 16);
+        unsigned int status = header & 0xffff;
+        rx++;
+
+        db<RTL8139>(TRC) << "packet_len=" << packet_len << endl;
+        db<RTL8139>(TRC) << "status=" << status << endl;
+
+        Frame * frame = reinterpret_cast<Frame *>(rx);
+        db<RTL8139>(TRC) << "frame src " << frame->src() << endl;
+        Buffer * buf = new (SYSTEM) Buffer(this, rx);
+        memcpy(buf->frame(), frame, sizeof(Frame));
+        db<RTL8139>(TRC) << "buff src " << buf->frame()->src() << endl;
+
+        if (!notify(buf->frame()->prot(), buf))
+            free(buf);
+
+        // update CAPR
+        _rx_read += packet_len + 4;
+        _rx_read =  (_rx_read + 3) & ~3;
+
+        if (_rx_read > RX_NO_WRAP_SIZE) {
+            _rx_read -= RX_NO_WRAP_SIZE;
+            db<RTL8139>(TRC) << "\tWRAPPED " << _rx_read << endl;
         }
 
+        _statistics.rx_packets++;
+        _statistics.rx_bytes += packet_len;
+        CPU::out16(_io_port + CAPR, _rx_read - 0x10);
+
+        handled++;
+    }
+
+    return handled;
+}
+
+
+unsigned int RTL8139::poll(unsigned int budget)
+{
+    unsigned int handled = handle_rx(budget);
+
+    // A frame arriving after the buffer was found empty leaves ROK pending in ISR, so it will interrupt once unmasked
+    // The ISR also rewrites IMR, so interrupts are kept out of the read-modify-write
+    if(handled < budget) {
+        lock();
+        CPU::out16(_io_port + IMR, CPU::in16(_io_port + IMR) | ROK);
+        unlock();
     }
+
+    return handled;
 }
 
 
@@ -19,6 +19,7 @@ RTL8139::RTL8139(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
     _io_port = io_port;
     _irq = irq;
     _dma_buf = dma_buf;
+    _posts = 0;
 
     // Distribute the DMA_Buffer allocated by init()
     Log_Addr log = _dma_buf->log_address();
@@ -17,7 +17,10 @@ unsigned short IP::Header::_next_id = 0;
 IP * IP::_networks[];
 IP::Router IP::_router;
 IP::Reassembling IP::_reassembling;
+Function_Handler IP::_sweeper_handler(&IP::sweep);
+Alarm * IP::_sweeper;
 IP::Observed IP::_observed;
+volatile unsigned long IP::_unroutable;
 
 // Methods
 void IP::config_by_info()
@@ -53,20 +56,23 @@ IP::Buffer * IP::alloc(const Address & to, const Protocol & prot, unsigned int o
     db<IP>(TRC) << "IP::alloc(to=" << to << ",prot=" << prot << ",on=" << once<< ",pl=" << payload << ")" << endl;
 
     Route * through = _router.search(to);
+    if(!through) {
+        db<IP>(WRN) << "IP::alloc: no route to host (" << to << ")!" << endl;
+        return 0;
+    }
     IP * ip = through->ip();
     NIC<Ethernet> * nic = through->nic();
 
-    MAC_Address mac = through->arp()->resolve((through->gateway() == through->ip()->address()) ? to : through->gateway());
-    if(!mac) {
-         db<IP>(WRN) << "IP::alloc: destination host (" << to << ") unreachable!" << endl;
-         return 0;
-    }
+    MAC_Address mac = through->arp()->resolve(through->hop(to)); // never blocks, resolution goes on in background
 
-    Buffer * pool = nic->alloc(mac, NIC<Ethernet>::PROTO_IP, once, sizeof(IP::Header), payload);
-    if(!pool)
+    Buffer * pool = mac ? nic->alloc(mac, NIC<Ethernet>::PROTO_IP, once, sizeof(IP::Header), payload) : hold(nic, once, payload);
+    if(!pool) {
+        db<IP>(WRN) << "IP::alloc: destination host (" << to << ") unreachable!" << endl;
         return 0;
+    }
 
     Header header(ip->address(), to, prot, 0); // length will be defined latter for each fragment
+    header.sum(); // fragments only differ in length and flags/offset, so their checksums are updated incrementally
 
     unsigned int offset = 0;
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
@@ -77,7 +83,8 @@ IP::Buffer * IP::alloc(const Address & to, const Protocol & prot, unsigned int o
         packet->flags(el->next() ? Header::MF : 0);
         packet->length(el->object()->size());
         packet->offset(offset);
-        packet->header()->sum();
+        packet->header()->sum(Header::LENGTH, header.word(Header::LENGTH));
+        packet->header()->sum(Header::FRAGMENT, header.word(Header::FRAGMENT));
         db<IP>(INF) << "IP::alloc:pkt=" << packet << " => " << *packet << endl;
 
         offset += MFS;
@@ -90,7 +97,69 @@ int IP::send(Buffer * buf)
 {
     db<IP>(TRC) << "IP::send(buf=" << buf << ")" << endl;
 
-    return buf->nic()->send(buf); // implicitly releases the pool
+    if(!buf->frame()->dst())
+        return defer(buf);
+
+    return buf->nic()->send(buf); // all fragments are posted before the NIC is notified; implicitly releases the pool
+}
+
+int IP::post(Buffer * buf)
+{
+    db<IP>(TRC) << "IP::post(buf=" << buf << ")" << endl;
+
+    if(!buf->frame()->dst())
+        return defer(buf);
+
+    return buf->nic()->post(buf); // the pool is released at flush()
+}
+
+IP::Buffer * IP::hold(NIC<Ethernet> * nic, unsigned int once, unsigned int payload)
+{
+    db<IP>(TRC) << "IP::hold(nic=" << nic << ",on=" << once << ",pl=" << payload << ")" << endl;
+
+    // Frames are sized as NIC::alloc() does, so fragmentation is the same once they are copied into NIC buffers
+    int max_data = nic->mtu() - sizeof(Header);
+    if((once + payload + max_data - 1) / max_data > ARP<NIC<Ethernet>, IP>::FRAMES)
+        return 0;
+
+    Buffer::List pool;
+    for(int size = once + payload; size > 0; size -= max_data) {
+        Buffer * buf = new (SYSTEM) Buffer(nic, 0);
+        buf->fill((size > max_data) ? nic->mtu() : size + sizeof(Header), nic->address(), MAC_Address(MAC_Address::NULL), NIC<Ethernet>::PROTO_IP);
+        pool.insert(buf->link());
+    }
+
+    return pool.head()->object();
+}
+
+int IP::defer(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    Route * through = _router.search(packet->to());
+
+    db<IP>(TRC) << "IP::defer(buf=" << buf << ",to=" << packet->to() << ")" << endl;
+
+    // The route found by alloc() might have been removed meanwhile (e.g. by DHCP), so the held datagram is dropped
+    if(!through) {
+        db<IP>(INF) << "IP::defer: no route to host (" << packet->to() << ")!" << endl;
+        for(Buffer::Element * el = buf->link(), * next; el; el = next) {
+            next = el->next();
+            delete el->object(); // held frames come from the system heap, not from the NIC
+        }
+        CPU::finc(_unroutable);
+        return 0;
+    }
+
+    return through->arp()->hold(through->hop(packet->to()), buf);
+}
+
+void IP::flush()
+{
+    db<IP>(TRC) << "IP::flush()" << endl;
+
+    for(unsigned int i = 0; i < UNITS; i++)
+        if(_networks[i])
+            _networks[i]->_nic->flush();
 }
 
 void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & prot, Buffer * buf)
@@ -102,8 +171,10 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
 
     if((packet->to() != _address) && (packet->to() != _broadcast)) {
         db<IP>(INF) << "IP::update: datagram was not for me!" << endl;
-        if(packet->to() != Address(Address::BROADCAST))
-            db<IP>(WRN) << "IP::update: routing not implemented!" << endl;
+        if(Traits<IP>::forwarding && (packet->to() != Address(Address::BROADCAST))) {
+            forward(buf);
+            return;
+        }
         _nic->free(buf);
         return;
     }
@@ -116,28 +187,17 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
 
     buf->nic(_nic);
 
+    // Senders on the local network confirm their ARP mappings for free (and create them, if Traits<IP>::arp_learning)
+    if(((packet->from() & _netmask) == (_address & _netmask)) && (packet->from() != _broadcast))
+        _arp.confirm(packet->from(), buf->frame()->src());
+
     // The Ethernet Frame in Buffer might have been padded, so we need to adjust it to the datagram length
     buf->size(packet->length());
 
     if((packet->flags() & Header::MF) || (packet->offset() != 0)) { // Fragmented
-        Key key = ((packet->from() & ~_netmask) << 16) | packet->id();
-        Reassembling::Element * el = _reassembling.search_key(key);
-
-        Fragmented * frag;
-        if(el)
-            frag = el->object();
-        else {
-            frag = new (SYSTEM) Fragmented(key); // the Alarm created within Fragmented will re-enable interrupts
-            _reassembling.insert(frag->link());
-        }
-        frag->insert(buf);
-
-        if(frag->reassembled()) {
+        Buffer * pool = _reassembling.insert(buf);
+        if(pool) {
             db<IP>(INF) << "IP::update: notifying reassembled datagram" << endl;
-            frag->reorder();
-            Buffer * pool = frag->pool();
-            _reassembling.remove(frag->link());
-            delete frag;
             if(!notify(packet->protocol(), pool))
                 pool->nic()->free(pool);
         }
@@ -148,24 +208,271 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
     }
 }
 
-void IP::Fragmented::reorder() {
-    db<IP>(TRC) << "IP::Fragmented::reorder(this=" << this << ")" << endl;
+void IP::forward(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+
+    db<IP>(TRC) << "IP::forward(buf=" << buf << ",to=" << packet->to() << ")" << endl;
+
+    // The length is the peer's word, so it must fit what was actually received before it tells how much to copy
+    if((packet->length() < sizeof(Header)) || (packet->length() > buf->size())) {
+        db<IP>(WRN) << "IP::forward: bad datagram length!" << endl;
+        _nic->free(buf);
+        return;
+    }
 
-    if(_list.size() > 1) {
-        Buffer::List tmp;
-        unsigned int i = 0;
-        while(!_list.empty()) {
-            Buffer * buf = _list.remove()->object();
+    // Neither datagrams that came in link-layer broadcasts or multicasts (RFC 1812, 5.3.4) nor those from or to
+    // addresses that are never forwarded (RFC 1812, 5.3.7) go any further
+    if((buf->frame()->dst()[0] & 1) || martian(packet->from()) || martian(packet->to())) {
+        db<IP>(INF) << "IP::forward: datagram must not be forwarded!" << endl;
+        _nic->free(buf);
+        return;
+    }
 
-            if((buf->frame()->data<Packet>()->offset() / MFS) == i) {
-                tmp.insert(buf->link());
-                i++;
+    if(!packet->check()) {
+        db<IP>(WRN) << "IP::forward: wrong packet header checksum!" << endl;
+        _nic->free(buf);
+        return;
+    }
+
+    if(packet->ttl() <= 1) {
+        db<IP>(INF) << "IP::forward: time to live exceeded!" << endl;
+        _nic->free(buf);
+        return;
+    }
+
+    Route * through = _router.search(packet->to());
+    if(!through || (through->ip()->address() == packet->to())) { // datagrams to our other interfaces are not delivered across them
+        db<IP>(INF) << "IP::forward: no route to host (" << packet->to() << ")!" << endl;
+        _nic->free(buf);
+        CPU::finc(_unroutable);
+        return;
+    }
+
+    NIC<Ethernet> * nic = through->nic();
+    unsigned int size = packet->length();
+    if(size > nic->mtu()) {
+        db<IP>(INF) << "IP::forward: datagram larger than the outgoing MTU!" << endl;
+        _nic->free(buf);
+        return;
+    }
+
+    // Transit datagrams are not held while the next hop is resolved, the resolution started here serves the next ones
+    MAC_Address mac = through->arp()->resolve(through->hop(packet->to()));
+    if(!mac) {
+        db<IP>(INF) << "IP::forward: next hop (" << through->hop(packet->to()) << ") not resolved yet!" << endl;
+        _nic->free(buf);
+        return;
+    }
+
+    unsigned short old = packet->header()->word(Header::TTL_PROTOCOL);
+    packet->header()->ttl(packet->ttl() - 1);
+    packet->header()->sum(Header::TTL_PROTOCOL, old);
+
+    // Receive buffers belong to the ingress NIC's ring, so the datagram is copied once into a transmit buffer of the
+    // egress NIC, whole, since it already fits its MTU
+    Buffer * out = nic->alloc(mac, NIC<Ethernet>::PROTO_IP, 0, 0, size);
+    if(!out) {
+        db<IP>(WRN) << "IP::forward: no buffer to forward datagram!" << endl;
+        _nic->free(buf);
+        return;
+    }
+    memcpy(out->frame()->data<Packet>(), packet, size);
+    _nic->free(buf);
+
+    nic->send(out);
+}
+
+void IP::Router::insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t, unsigned int w)
+{
+    unsigned int length = common(bits(m), ~0U); // genmasks are contiguous
+    unsigned int prefix = bits(d) & mask(length);
+
+    lock();
+
+    Route * route = this->route(nic, ip, arp, d, g, m, t, w);
+
+    db<IP>(TRC) << "IP::Router::insert() => " << *route << endl;
+
+    Node ** link = &_root;
+    while(true) {
+        Node * n = *link;
+        if(!n) {
+            *link = node(prefix, length, route);
+            _routes++;
+            break;
+        }
+
+        unsigned int c = common(prefix, n->prefix);
+        if(c > length)
+            c = length;
+        if(c < n->length) { // the new prefix is shorter than or diverges from n's, so a node goes in between
+            Node * parent = node(prefix & mask(c), c, (c == length) ? route : 0);
+            parent->child[bit(n->prefix, c)] = n;
+            if(c < length)
+                parent->child[bit(prefix, c)] = node(prefix, length, route);
+            *link = parent;
+            _routes++;
+            break;
+        }
+
+        if(n->length == length) { // same prefix
+            if(n->route) {
+                db<IP>(INF) << "IP::Router::insert: replacing " << *n->route << endl;
+                retire(n->route);
             } else
-                _list.insert(buf->link());
-        };
+                _routes++;
+            n->route = route;
+            break;
+        }
+
+        link = &n->child[bit(prefix, n->length)];
+    }
+
+    unlock();
+}
+
+void IP::Router::remove(const Address & to)
+{
+    db<IP>(TRC) << "IP::Router::remove(to=" << to << ")" << endl;
+
+    lock();
+
+    unsigned int a = bits(to);
+    Node ** link = 0; // to the node of the longest matching prefix
+    for(Node ** l = &_root; *l && !((a ^ (*l)->prefix) & mask((*l)->length)); l = &(*l)->child[bit(a, (*l)->length)]) {
+        if((*l)->route)
+            link = l;
+        if((*l)->length == 32)
+            break;
+    }
+
+    if(link) {
+        Node * n = *link;
+        db<IP>(INF) << "IP::Router::remove: removing " << *n->route << endl;
+        retire(n->route);
+        n->route = 0;
+        if(!n->child[0] || !n->child[1]) { // no longer needed to branch
+            *link = n->child[0] ? n->child[0] : n->child[1];
+            retire(n);
+        }
+        _routes--;
+    }
+
+    unlock();
+}
 
-        while(!tmp.empty())
-            _list.insert(tmp.remove()->object()->link());
+IP::Router::Node * IP::Router::node(unsigned int prefix, unsigned int length, Route * route)
+{
+    Node * n = _spare_nodes;
+    if(n) {
+        _spare_nodes = n->child[0];
+        return new (n) Node(prefix, length, route);
+    }
+
+    return new (SYSTEM) Node(prefix, length, route);
+}
+
+IP::Route * IP::Router::route(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t, unsigned int w)
+{
+    Route * r = _spare_routes;
+    if(r) {
+        _spare_routes = r->_spare;
+        return new (r) Route(nic, ip, arp, d, g, m, t, w);
+    }
+
+    return new (SYSTEM) Route(nic, ip, arp, d, g, m, t, w);
+}
+
+bool IP::Fragmented::insert(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    unsigned int offset = packet->offset();
+
+    db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
+
+    if(!_bitmap.set(offset / MFS))
+        return false;
+
+    if(!(packet->flags() & Header::MF))
+        _frags = (offset + MFS) / MFS;
+
+    // Fragments usually arrive in order, so the tail is tried first
+    Buffer::Element * el = buf->link();
+    if(!_head) {
+        el->next(0);
+        _head = _tail = el;
+    } else if(offset > _tail->object()->frame()->data<Packet>()->offset()) {
+        el->next(0);
+        _tail->next(el);
+        _tail = el;
+    } else {
+        Buffer::Element * prev = 0;
+        Buffer::Element * next = _head;
+        for(; next && (next->object()->frame()->data<Packet>()->offset() < offset); prev = next, next = next->next());
+        el->next(next);
+        if(prev)
+            prev->next(el);
+        else
+            _head = el;
+    }
+
+    return true;
+}
+
+IP::Buffer * IP::Reassembling::insert(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+
+    lock();
+
+    Fragmented * frag = 0;
+    Fragmented * free = 0;
+    unsigned int sources = 0;
+    for(unsigned int i = 0; i < ENTRIES; i++) {
+        if(_table[i].free()) {
+            if(!free)
+                free = &_table[i];
+        } else if(_table[i].match(packet)) {
+            frag = &_table[i];
+            break;
+        } else if(_table[i]._from == packet->from())
+            sources++;
+    }
+
+    if(!frag && free && (sources < PER_SOURCE)) {
+        frag = free;
+        frag->acquire(packet, AGE);
+    }
+
+    bool inserted = frag && frag->insert(buf);
+    Buffer * pool = (inserted && frag->reassembled()) ? frag->release() : 0;
+
+    unlock();
+
+    if(!frag)
+        db<IP>(WRN) << "IP::Reassembling::insert: no room for a datagram from " << packet->from() << "!" << endl;
+
+    if(!inserted) // no room or a duplicate
+        buf->nic()->free(buf);
+
+    return pool;
+}
+
+void IP::Reassembling::sweep()
+{
+    Buffer * expired[ENTRIES];
+    unsigned int n = 0;
+
+    lock();
+    for(unsigned int i = 0; i < ENTRIES; i++)
+        if(!_table[i].free() && _table[i].age())
+            expired[n++] = _table[i].release();
+    unlock();
+
+    for(unsigned int i = 0; i < n; i++) {
+        db<IP>(INF) << "IP::Reassembling::sweep: dropping incomplete datagram " << expired[i] << endl;
+        expired[i]->nic()->free(expired[i]);
     }
 }
 
@@ -173,19 +480,190 @@ unsigned short IP::checksum(const void * data, unsigned int size)
 {
     db<IP>(TRC) << "IP::checksum(d=" << data << ",s=" << size << ")" << endl;
 
+    return ~sum(data, size);
+}
+
+// The one's complement sum is independent of byte order (RFC 1071), so words are loaded natively, 32 bits at a
+// time, into a 64-bit accumulator whose carries are folded back (end-around carry) only at the end. The result is
+// then swapped to network order. Loads go through memcpy, so data needs no alignment.
+unsigned long IP::sum(const void * data, unsigned int size)
+{
     const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-    unsigned long sum = 0;
+    unsigned long long sum = 0;
+
+    for(; size >= 16; size -= 16, ptr += 16) {
+        unsigned int w[4];
+        memcpy(w, ptr, 16);
+        sum += w[0];
+        sum += w[1];
+        sum += w[2];
+        sum += w[3];
+    }
+
+    for(; size >= 4; size -= 4, ptr += 4) {
+        unsigned int w;
+        memcpy(&w, ptr, 4);
+        sum += w;
+    }
 
-    for(unsigned int i = 0; i < size; i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+    if(size) { // up to 3 bytes left, the last one padded with zero
+        unsigned int w = 0;
+        memcpy(&w, ptr, size);
+        sum += w;
+    }
+
+    return fold(sum);
+}
 
-    if(size & 1)
-        sum += ptr[size - 1];
+unsigned long IP::copy_and_sum(void * t, const void * f, unsigned int size, bool odd)
+{
+    unsigned char * to = reinterpret_cast<unsigned char *>(t);
+    const unsigned char * from = reinterpret_cast<const unsigned char *>(f);
+    unsigned long first = 0;
+    unsigned long long sum = 0;
+
+    if(odd && size) { // the low byte of a word started in a previous call
+        first = *to++ = *from++;
+        size--;
+    }
+
+    for(; size >= 16; size -= 16, to += 16, from += 16) {
+        unsigned int w[4];
+        memcpy(w, from, 16);
+        memcpy(to, w, 16);
+        sum += w[0];
+        sum += w[1];
+        sum += w[2];
+        sum += w[3];
+    }
+
+    for(; size >= 4; size -= 4, to += 4, from += 4) {
+        unsigned int w;
+        memcpy(&w, from, 4);
+        memcpy(to, &w, 4);
+        sum += w;
+    }
+
+    if(size) {
+        unsigned int w = 0;
+        memcpy(&w, from, size);
+        memcpy(to, &w, size);
+        sum += w;
+    }
+
+    return fold(sum) + first;
+}
+
+unsigned long IP::fold(unsigned long long sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return ntohs(sum);
+}
+
+IP::Gather::Gather(const IO_Vector * iov, unsigned int count): _iov(iov), _count(count), _offset(0), _copied(0), _size(0), _sum(0)
+{
+    for(unsigned int i = 0; i < count; i++)
+        _size += iov[i].size;
+}
+
+unsigned int IP::Gather::copy(void * d, unsigned int s)
+{
+    unsigned char * data = reinterpret_cast<unsigned char *>(d);
+    unsigned int size = 0;
+
+    while(_count && (size < s)) {
+        unsigned int len = _iov->size - _offset;
+        if(len > s - size)
+            len = s - size;
+
+        _sum += copy_and_sum(data + size, reinterpret_cast<const unsigned char *>(_iov->data) + _offset, len, _copied & 1);
+        size += len;
+        _copied += len;
+        _offset += len;
+
+        if(_offset == _iov->size) {
+            _iov++;
+            _count--;
+            _offset = 0;
+        }
+    }
+
+    return size;
+}
+
+IP::View::View(Buffer * pool, unsigned int header): _pool(pool), _slices(0), _size(0)
+{
+    db<IP>(TRC) << "IP::View(buf=" << pool << ",h=" << header << ")" << endl;
+
+    // Fragments were chained in offset order by IP::Fragmented::insert(), so slices follow the datagram's offsets
+    for(Buffer::Element * el = pool->link(); el && (_slices < MAX_SLICES); el = el->next(), header = 0) {
+        Buffer * buf = el->object();
+        Slice & slice = _slice[_slices++];
+        slice.data = buf->frame()->data<Packet>()->data<unsigned char>() + header;
+        slice.size = buf->size() - sizeof(Header) - header;
+        _size += slice.size;
+    }
+}
+
+unsigned int IP::View::copy(void * d, unsigned int s) const
+{
+    unsigned char * data = reinterpret_cast<unsigned char *>(d);
+    unsigned int size = 0;
+
+    for(unsigned int i = 0; (i < _slices) && (size < s); i++) {
+        unsigned int len = (_slice[i].size > s - size) ? s - size : _slice[i].size;
+        memcpy(data + size, _slice[i].data, len);
+        size += len;
+    }
+
+    return size;
+}
+
+void IP::View::skip(unsigned int size)
+{
+    unsigned int i = 0;
+    for(; (i < _slices) && (size >= _slice[i].size); i++) {
+        size -= _slice[i].size;
+        _size -= _slice[i].size;
+    }
+
+    for(unsigned int j = i; j < _slices; j++)
+        _slice[j - i] = _slice[j];
+    _slices -= i;
+
+    if(_slices && size) {
+        _slice[0].data += size;
+        _slice[0].size -= size;
+        _size -= size;
+    }
+}
+
+IP::Buffer * IP::View::detach()
+{
+    Buffer * pool = _pool;
+    _pool = 0;
+    _slices = 0;
+    _size = 0;
+
+    return pool;
+}
+
+void IP::View::release()
+{
+    if(!_pool)
+        return;
 
-    while(sum >> 16)
-        sum = (sum & 0xffff) + (sum >> 16);
+    db<IP>(TRC) << "IP::View::release(buf=" << _pool << ")" << endl;
 
-    return ~sum;
+    _pool->nic()->free(_pool); // give the buffers back to the NIC's receive ring
+    _pool = 0;
+    _slices = 0;
+    _size = 0;
 }
 
 __END_SYS
@@ -30,7 +30,7 @@ IP::IP(NIC<Ethernet> * nic, unsigned int config, const Address & a, const Addres
     _router.insert(_nic, this, &_arp, _address & _netmask, _address, _netmask);
 
     if(_gateway) {
-        _router.insert(_nic, this, &_arp, Address::NULL, _gateway, Address::NULL); // Default route must be the last one in table
+        _router.insert(_nic, this, &_arp, Address::NULL, _gateway, Address::NULL); // default route, the shortest prefix
         _arp.resolve(_gateway);
     }
 }
@@ -40,6 +40,8 @@ void IP::init()
     db<Init, IP>(TRC) << "IP::init()" << endl;
     init_helper<0>();
 
+    _sweeper = new (SYSTEM) Alarm(Reassembling::SWEEP, &_sweeper_handler, INFINITE);
+
     if(Traits<_SYS::ICMP>::enabled)
         new (SYSTEM) _SYS::ICMP;
     if(Traits<_SYS::UDP>::enabled)
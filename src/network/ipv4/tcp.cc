@@ -7,7 +7,14 @@
 __BEGIN_SYS
 
 // Class attributes
-TCP::Observed TCP::_observed;
+TCP::Table TCP::_connections;
+Spin TCP::_lock;
+unsigned int TCP::_loss = 0;
+List<TCP::Timer> TCP::_wheel[];
+Spin TCP::_wheel_lock;
+volatile unsigned int TCP::_ticks = 0;
+Function_Handler TCP::_tick_handler(&tick);
+Alarm * TCP::_clock;
 
 TCP::Connection::State_Handler TCP::Connection::_handlers[] = {&TCP::Connection::listening,
                                                                &TCP::Connection::syn_sent,
@@ -30,14 +37,28 @@ void TCP::update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool)
     Packet * packet = pool->frame()->data<Packet>();
     Segment * segment = packet->data<Segment>();
 
-    unsigned int size = pool->size() - sizeof(IP::Header) - sizeof(TCP::Header);
+    if(_loss && (static_cast<unsigned int>(Random::random()) % 1000 < _loss)) {
+        db<TCP>(INF) << "TCP::update: segment dropped by fault injection!" << endl;
+        pool->nic()->free(pool);
+        return;
+    }
+
+    // The data offset comes from the peer, so it must fit the datagram before any length is derived from it
+    unsigned int length = pool->size() - sizeof(IP::Header);
+    if((pool->size() < sizeof(IP::Header)) || (segment->header()->size() < sizeof(Header)) || (segment->header()->size() > length)) {
+        db<TCP>(WRN) << "TCP::update: bad data offset!" << endl;
+        pool->nic()->free(pool);
+        return;
+    }
+
+    unsigned int size = length - segment->header()->size();
     if(size && !segment->check(size)) { // FIXME there should not be a check for "size", it should always check the sum. However, it doesn't seem to work when size == 0
         db<TCP>(WRN) << "TCP::update: wrong message checksum!" << endl;
         pool->nic()->free(pool);
         return;
     }
 
-    unsigned long long id;
+    Connection_Id id;
     if(segment->header()->flags() == Header::SYN) // try to notify any eventual listener
         id = Connection::id(segment->header()->to(), 0, IP::Address::NULL);
     else
@@ -45,47 +66,234 @@ void TCP::update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool)
 
     db<TCP>(INF) << "TCP::update::condition=" << hex << id << endl;
 
-    if(!_observed.notify(id, pool))
+    Connection * conn = search(id);
+    if(conn) {
+        conn->update(conn, id, pool);
+        release(conn);
+    } else
         pool->nic()->free(pool);
 }
 
-void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int size)
+void TCP::insert(Connection * c)
 {
-    _checksum = 0;
+    db<TCP>(TRC) << "TCP::insert(conn=" << c << ",id=" << hex << c->id() << ")" << endl;
+
+    c->_link.rank(key(c->id()));
+
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _lock.acquire();
+    _connections.insert(&c->_link);
+    if(Traits<System>::multicore)
+        _lock.release();
+    if(!disabled)
+        CPU::int_enable();
+}
 
-    IP::Pseudo_Header pseudo(from, to, IP::TCP, sizeof(Header) + size);
+void TCP::remove(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::remove(conn=" << c << ",id=" << hex << c->id() << ")" << endl;
+
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _lock.acquire();
+    _connections.remove(&c->_link);
+    if(Traits<System>::multicore)
+        _lock.release();
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void TCP::destroy(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::destroy(conn=" << c << ")" << endl;
+
+    remove(c);
+
+    // A receiver might have found c just before it left the table, so it is only deleted once that receiver is done
+    while(c->_users)
+        Thread::yield();
+
+    delete c;
+}
 
-    unsigned long sum = 0;
-    const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-    for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+TCP::Connection * TCP::search(const Connection_Id & id)
+{
+    // Keys of different 4-tuples may collide, so the bucket is walked comparing whole ids
+    Connection * conn = 0;
+
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _lock.acquire();
+    for(Connection::Element * e = _connections[key(id)]->head(); e; e = e->next())
+        if(e->object()->id() == id) {
+            conn = e->object();
+            CPU::finc(conn->_users); // before the table is unlocked, so destroy() waits for it
+            break;
+        }
+    if(Traits<System>::multicore)
+        _lock.release();
+    if(!disabled)
+        CPU::int_enable();
 
-    ptr = reinterpret_cast<const unsigned char *>(header());
-    for(unsigned int i = 0; i < sizeof(Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+    return conn;
+}
 
-    if(data) {
-        ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
+void TCP::arm(Timer * t, unsigned int ticks)
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _wheel_lock.acquire();
+
+    if(t->_armed)
+        _wheel[t->_expiry % SLOTS].remove(&t->_link);
+
+    t->_expiry = _ticks + ticks + 1; // the current tick is already partly gone, so timers never expire early
+    t->_armed = true;
+    _wheel[t->_expiry % SLOTS].insert(&t->_link);
+
+    if(Traits<System>::multicore)
+        _wheel_lock.release();
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void TCP::disarm(Timer * t)
+{
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _wheel_lock.acquire();
+
+    if(t->_armed) {
+        _wheel[t->_expiry % SLOTS].remove(&t->_link);
+        t->_armed = false;
     }
 
+    if(Traits<System>::multicore)
+        _wheel_lock.release();
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void TCP::tick()
+{
+    // Only the slot of the current tick is visited; timers due in later turns stay in it
+    List<Timer> expired;
+
+    bool disabled = CPU::int_disabled();
+    if(!disabled)
+        CPU::int_disable();
+    if(Traits<System>::multicore)
+        _wheel_lock.acquire();
+    unsigned int now = ++_ticks;
+    List<Timer> * slot = &_wheel[now % SLOTS];
+    for(Timer::Element * e = slot->head(), * next; e; e = next) {
+        next = e->next();
+        if(static_cast<int>(e->object()->_expiry - now) <= 0) {
+            slot->remove(e);
+            e->object()->_armed = false;
+            expired.insert(e);
+        }
+    }
+    if(Traits<System>::multicore)
+        _wheel_lock.release();
+    if(!disabled)
+        CPU::int_enable();
+
+    // Handlers run after the walk, for they may arm or disarm timers of this same slot
+    while(!expired.empty())
+        (*expired.remove()->object()->_handler)();
+}
+
+void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int size)
+{
+    this->sum(from, to, data ? IP::sum(data, size) : 0, size);
+}
+
+void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, unsigned long sum, unsigned int size)
+{
+    _checksum = 0;
+
+    IP::Pseudo_Header pseudo(from, to, IP::TCP, sizeof(Header) + size);
+    sum += IP::sum(&pseudo, sizeof(IP::Pseudo_Header));
+    sum += IP::sum(header(), sizeof(Header));
+
     while(sum >> 16)
         sum = (sum & 0xffff) + (sum >> 16);
 
     _checksum = htons(~sum);
 }
 
+const unsigned char * TCP::Segment::option(unsigned char kind)
+{
+    const unsigned char * opt = options();
+    const unsigned char * end = reinterpret_cast<unsigned char *>(this) + size();
+
+    while((opt < end) && (*opt != EOL)) {
+        if(*opt == NOP) {
+            opt++;
+            continue;
+        }
+        if((opt + 1 >= end) || (opt[1] < 2) || (opt + opt[1] > end)) // malformed
+            return 0;
+        if(*opt == kind)
+            return opt;
+        opt += opt[1];
+    }
+
+    return 0;
+}
+
 void TCP::Connection::fsend(const Flags & flags)
 {
     _flags = flags;
-    if(!_retransmiting) _sequence = htonl(_next);
+    _sequence = htonl(_next);
+    advertise();
+    _pending = 0;
 
     db<TCP>(TRC) << "TCP::Connection::send(flags=" << ((flags & ACK) ? 'A' : '-') << ((flags & RST) ? 'R' : '-') << ((flags & SYN) ? 'S' : '-') << ((flags & FIN) ? 'F' : '-') << "): SND.NXT=" << _next << ",SND.SEQ=" << sequence() << endl;
 
-    Buffer * buf = IP::alloc(peer(), IP::TCP, sizeof(Header), 0);
+    // SYNs offer SACK and window scaling (a SYN+ACK only those the peer's SYN did), ACKs carry the out-of-order ranges held in _queue
+    unsigned char options[MAX_OPTIONS];
+    unsigned int length = 0;
+    if(SCALE && (flags & SYN) && (!(flags & ACK) || _scale)) {
+        options[length++] = NOP;
+        options[length++] = WINDOW_SCALE;
+        options[length++] = 3;
+        options[length++] = SCALE;
+    }
+    if((flags & SYN) && (!(flags & ACK) || _sack)) {
+        options[length++] = NOP;
+        options[length++] = NOP;
+        options[length++] = SACK_PERMITTED;
+        options[length++] = 2;
+    } else if((flags & ACK) && !(flags & (SYN | RST)) && _sack) {
+        Block b[SACK_BLOCKS];
+        unsigned int n = blocks(b);
+        if(n) {
+            options[length++] = NOP;
+            options[length++] = NOP;
+            options[length++] = SACK;
+            options[length++] = 2 + n * sizeof(Block);
+            for(unsigned int i = 0; i < n; i++) {
+                unsigned int edges[2] = { htonl(b[i].left), htonl(b[i].right) };
+                memcpy(&options[length], edges, sizeof(Block));
+                length += sizeof(Block);
+            }
+        }
+    }
+
+    Buffer * buf = IP::alloc(peer(), IP::TCP, sizeof(Header) + length, 0);
     if(!buf) {
         db<TCP>(WRN) << "TCP::send: failed to alloc a NIC buffer to send a TCP control segment!" << endl;
         return;
@@ -95,13 +303,18 @@ void TCP::Connection::fsend(const Flags & flags)
     Packet * packet = buf->frame()->data<Packet>();
     Segment * segment = packet->data<Segment>();
     memcpy(segment, header(), sizeof(Header));
-    segment->sum(packet->from(), packet->to(), 0, 0);
+    memcpy(segment->options(), options, length);
+    segment->size(sizeof(Header) + length);
+    segment->sum(packet->from(), packet->to(), length ? IP::sum(options, length) : 0UL, length); // no data, options are summed as such
 
     db<TCP>(INF) << "TCP::Connection::send:conn=" << this << " => " << *this << endl;
 
-    if((_flags & FIN) || (_flags & SYN))
+    if((_flags & FIN) || (_flags & SYN)) {
         _next++; // We do not test if there's a retransmission going on, because there's no chance whatsoever in this current implementation
-    // a flag such as FIN or SYN to be sent whilst a stream (solo case in which there could be a retransmission) is going on
+        // a flag such as FIN or SYN to be sent whilst a stream (solo case in which there could be a retransmission) is going on
+        if(seq_lt(_max, _next))
+            _max = _next;
+    }
 
     // FIXME what if we increment the SND.NXT and soon after we receive a segment with data?
     // We'd ack it with incremented sequence number and only then send the segment that caused the SND.NXT variable to be incremented
@@ -115,57 +328,98 @@ int TCP::Connection::write(const void * d, unsigned int size)
 
     db<TCP>(TRC) << "TCP::Connection::write(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
 
-    unsigned int allowed = WINDOW;
-    unsigned int left = size; // bytes that have not been sent at all
-    unsigned int acknowledged = 0; // bytes that were sent AND acknowledged
-    unsigned int initial_seq = sequence(); // sequence number when stream is started
+    // Bytes are sent as sequence numbers from base on, as many in flight as allowed by both the congestion window and the
+    // peer's window. Losses are recovered by fast retransmit after DUPLICATES duplicate ACKs, during which NewReno
+    // retransmits a hole per partial ACK, or by going back to _unacknowledged when the retransmission timer expires.
+    // Ranges the peer reported with SACK are never sent again.
+    const unsigned int base = _next;
+    const unsigned int end = base + size;
+    const unsigned int granularity = TICK;
+
+    _unacknowledged = _next;
+    _sacks = 0;
+    _retransmit = false;
+    _recovering = false;
+    _duplicates = 0;
+    _last = TSC::time_stamp();
+    _streaming = true;
 
     unsigned int tries = 0;
-    for(; (tries < RETRIES) && (acknowledged != size) && (_state == ESTABLISHED || _state == CLOSE_WAIT);
-        acknowledged = _current->header()->acknowledgment() - initial_seq, allowed = _peer_window - (sequence() - _current->header()->acknowledgment())) {
-        _streaming = true;
-        allowed = (allowed > MSS) ? MSS: allowed;
+    while((tries < RETRIES) && seq_lt(_unacknowledged, end) && (_state == ESTABLISHED || _state == CLOSE_WAIT)) {
+        unsigned int progress = _progress;
+
+        if(_retransmit) {
+            db<TCP>(TRC) << "TCP::Connection::write: fast retransmission" << endl;
+
+            _retransmit = false;
+            unsigned int seq = _unacknowledged;
+            unsigned int len = limit(seq, end);
+            if(len && !dsend(seq, data + (seq - base), len, true, seq + len == end)) {
+                IP::flush();
+                _streaming = false;
+                return -1;
+            }
+        }
 
-        if(allowed && left) {
-            db<TCP>(TRC) << "TCP::Connection::write: send" << endl;
+        while(true) {
+            _next = sacked(_next);
+            unsigned int window = (_congestion < _peer_window) ? _congestion : _peer_window;
+            unsigned int flight = _next - _unacknowledged;
+            if(!seq_lt(_next, end) || (flight >= window))
+                break;
 
-            int payload = (allowed > left) ? left : allowed;
+            unsigned int len = limit(_next, end);
+            if(len > window - flight)
+                len = window - flight;
+
+            db<TCP>(TRC) << "TCP::Connection::write: send" << endl;
 
-            if(!dsend(data, payload)) // FIXME we should wait until there are available buffers
+            if(!dsend(_next, data + (_next - base), len, true, _next + len == end)) { // FIXME we should wait until there are available buffers
+                IP::flush();
+                _streaming = false;
                 return -1;
+            }
+        }
 
-            data += payload;
-            left -= payload;
-            if(sequence() == _next)
-                _retransmiting = false;
-        } else { // Either window's full or we've sent all there was to
-            db<TCP>(TRC) << "TCP::Connection::write: wait" << endl;
+        IP::flush(); // notify the NIC only once for all segments posted
 
-            unsigned int old_ack = _current->header()->acknowledgment();
+        if(_retransmit)
+            continue;
 
-            Condition_Handler h(&_stream);
-            Alarm a(TIMEOUT, &h);
+        db<TCP>(TRC) << "TCP::Connection::write: wait" << endl;
 
+        // Interrupts are disabled between the test and the wait, so an ACK cannot signal in between
+        unsigned int elapsed = since(_last);
+        CPU::int_disable();
+        if((elapsed + granularity < _rto) && (_progress == progress) && !_retransmit) {
+            TCP::arm(&_retransmission, ticks(_rto - elapsed));
             _stream.wait();
-
-            if(_current->header()->acknowledgment() == old_ack) {
-                // Retransmission
-                db<TCP>(TRC) << "TCP::Connection::write: retransmission" << endl;
-
-                _retransmiting = true;
-                _sequence = htonl(_current->header()->acknowledgment());
-                _unacknowledged = _current->header()->acknowledgment();
-                data = reinterpret_cast<const unsigned char*>(d) + acknowledged;
-                left = size - acknowledged;
-
-                tries++;
-            } else
-                tries = 0;
+            TCP::disarm(&_retransmission);
+        } else
+            CPU::int_enable();
+
+        if(_progress != progress)
+            tries = 0;
+        else if(!_retransmit && (since(_last) + granularity >= _rto)) {
+            db<TCP>(TRC) << "TCP::Connection::write: retransmission timeout (rto=" << _rto << ")" << endl;
+
+            unsigned int flight = _max - _unacknowledged;
+            _threshold = (flight / 2 > 2 * MSS) ? flight / 2 : 2 * MSS;
+            _congestion = MSS;
+            _recovering = false;
+            _duplicates = 0;
+            _timing = false;
+            _rto = (_rto * 2 < TIMEOUT) ? _rto * 2 : TIMEOUT;
+            _sacks = 0; // the peer might have discarded what it reported (RFC 2018)
+            _next = _unacknowledged;
+            _last = TSC::time_stamp();
+
+            tries++;
         }
     }
 
     _streaming = false;
-    _retransmiting = false;
+    _retransmit = false;
 
     if(tries == RETRIES) {
         db<TCP>(TRC) << "TCP::write: enough tries already!" << endl;
@@ -177,21 +431,28 @@ int TCP::Connection::write(const void * d, unsigned int size)
         return -1;
     }
 
-
     return size;
 }
 
-int TCP::Connection::dsend(const void * d, unsigned int size)
+int TCP::Connection::dsend(unsigned int sequence, const void * data, unsigned int size, bool batch, bool push)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
+    IP::IO_Vector iov = { data, size };
+    return dsend(sequence, &iov, 1, batch, push);
+}
 
-    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
+int TCP::Connection::dsend(unsigned int sequence, const IP::IO_Vector * iov, unsigned int count, bool batch, bool push)
+{
+    IP::Gather data(iov, count);
+    unsigned int size = data.size();
 
-    _flags = ACK;
-    if(!_retransmiting)
-        _sequence = htonl(_next);
+    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",seq=" << sequence << ",iov=" << iov << ",n=" << count << ",s=" << size << ")" << endl;
 
-    db<TCP>(TRC) << "TCP::Connection::dsend: SND.NXT=" << _next << ",SND.SEQ=" << sequence() << ",payload=" << size << endl;
+    _flags = push ? (ACK | PSH) : ACK;
+    _sequence = htonl(sequence);
+    advertise();
+    _pending = 0; // the ACK is piggybacked
+
+    db<TCP>(TRC) << "TCP::Connection::dsend: SND.NXT=" << _next << ",SND.MAX=" << _max << ",SND.SEQ=" << sequence << ",payload=" << size << endl;
 
     Buffer * pool;
 //    do {
@@ -202,6 +463,9 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
         }
 //    } while(!pool);
 
+    // Data is checksummed while it is gathered into the buffers, so it is read only once
+    Segment * segment = 0;
+    Packet * first = 0;
     unsigned int headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
         Buffer * buf = el->object();
@@ -210,65 +474,98 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
         db<TCP>(INF) << "TCP::send:buf=" << buf << " => " << *buf<< endl;
 
         if(el == pool->link()) {
-            Segment * segment = packet->data<Segment>();
+            first = packet;
+            segment = packet->data<Segment>();
             memcpy(segment, header(), sizeof(Header));
-            segment->sum(packet->from(), packet->to(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            memcpy(segment->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            data += buf->size() - sizeof(Header) - sizeof(IP::Header);
-
-            db<TCP>(INF) << "TCP::send:msg=" << segment << " => " << *segment << endl;
-        } else {
-            memcpy(packet->data<void>(), data, buf->size() - sizeof(IP::Header));
-            data += buf->size() - sizeof(IP::Header);
-        }
+            data.copy(segment->data<void>(), buf->size() - sizeof(Header) - sizeof(IP::Header));
+        } else
+            data.copy(packet->data<void>(), buf->size() - sizeof(IP::Header));
 
         headers += sizeof(IP::Header);
     }
 
-    if(!_retransmiting)
-        _next += size;
-    else
-        _sequence = htonl(header()->sequence() + size);
+    segment->sum(first->from(), first->to(), data.sum(), size);
+
+    db<TCP>(INF) << "TCP::send:msg=" << segment << " => " << *segment << endl;
 
-    return IP::send(pool) - headers; // implicitly releases the pool
+    // Only segments sent for the first time are timed (Karn's algorithm)
+    if(seq_lt(_max, sequence + size)) {
+        if(!_timing && seq_leq(_max, sequence)) {
+            _timing = true;
+            _timed = sequence + size;
+            _sent = TSC::time_stamp();
+        }
+        _max = sequence + size;
+    } else if(_timing && seq_lt(sequence, _timed))
+        _timing = false;
+
+    if(seq_lt(_next, sequence + size))
+        _next = sequence + size;
+
+    return (batch ? IP::post(pool) : IP::send(pool)) - headers; // implicitly releases the pool (at IP::flush() if batched)
 }
 
-int TCP::Connection::read(Buffer * pool, void * d, unsigned int s)
+int TCP::Connection::read(void * d, unsigned int size)
 {
     unsigned char * data = reinterpret_cast<unsigned char *>(d);
 
-    db<TCP>(TRC) << "TCP::read(buf=" << pool << ",d=" << d << ",s=" << s << ")" << endl;
+    db<TCP>(TRC) << "TCP::read(d=" << data << ",s=" << size << ")" << endl;
+
+    if(!readable())
+        return 0;
+
+    // Segments are read across their boundaries, the last one possibly in part
+    unsigned int copied = 0;
+    while(_used && (copied < size)) {
+        IP::View view(_ring[_head], segment(_ring[_head])->size());
+        view.skip(_offset);
+
+        unsigned int n = view.copy(data + copied, size - copied);
+        copied += n;
+
+        if(n < view.size()) {
+            view.detach(); // still in the ring
+            _offset += n;
+        } else { // view's destructor returns the buffers to the NIC
+            lock(); // the receiving thread appends to the ring
+            _ring[_head] = 0;
+            _head = (_head + 1) % RING;
+            _used--;
+            _offset = 0;
+            unlock();
+        }
+    }
 
-    Buffer::Element * head = pool->link();
-    Packet * packet = head->object()->frame()->data<Packet>();
-    Segment * segment = packet->data<Segment>();
-    unsigned int size = 0;
+    consumed(copied);
 
-    for(Buffer::Element * el = head; el && (size <= s); el = el->next()) {
-        Buffer * buf = el->object();
+    return copied;
+}
 
-        db<TCP>(INF) << "TCP::read:buf=" << buf << " => " << *buf << endl;
+int TCP::Connection::read(IP::View * view)
+{
+    db<TCP>(TRC) << "TCP::read(v=" << view << ")" << endl;
 
-        packet = buf->frame()->data<Packet>();
+    view->release();
 
-        unsigned int len = buf->size() - sizeof(IP::Header);
-        if(el == head) {
-            len -= sizeof(Header);
-            memcpy(data, segment->data<void>(), len);
+    if(!readable())
+        return 0;
 
-            db<TCP>(INF) << "TCP::read:msg=" << segment << " => " << *segment << endl;
-        } else
-            memcpy(data, packet->data<void>(), len);
+    lock(); // the receiving thread appends to the ring
+    Buffer * pool = _ring[_head];
+    _ring[_head] = 0;
+    _head = (_head + 1) % RING;
+    _used--;
+    unlock();
 
-        db<TCP>(INF) << "TCP::read:len=" << len << endl;
+    db<TCP>(INF) << "TCP::read:seg=" << segment(pool) << " => " << *segment(pool) << endl;
 
-        data += len;
-        size += len;
-    }
+    new (view) IP::View(pool, segment(pool)->size());
+    view->skip(_offset);
+    _offset = 0;
 
-    pool->nic()->free(pool);
+    consumed(view->size());
 
-    return size;
+    return view->size();
 }
 
 void TCP::Connection::update(TCP::Observed * obs, const TCP::Connection_Id & cid, Buffer * pool)
@@ -278,8 +575,8 @@ void TCP::Connection::update(TCP::Observed * obs, const TCP::Connection_Id & cid
     Packet * packet = pool->frame()->data<Packet>();
 
     _current = packet->data<Segment>(); // FIXME should free the previous buffer
-    _length = pool->size() - sizeof(IP::Header) - sizeof(TCP::Header);
-    _peer_window = _current->header()->window();
+    _length = length(pool);
+    _peer_window = (_current->header()->flags() & SYN) ? _current->header()->window() : _current->header()->window() << _peer_scale; // windows in SYNs are never scaled
 
     db<TCP>(INF) << "TCP::Connection::update:" <<
         "SEQ.SEQ=" << _current->header()->sequence() <<
@@ -287,47 +584,50 @@ void TCP::Connection::update(TCP::Observed * obs, const TCP::Connection_Id & cid
         ",SEG.ACK=" << _current->header()->acknowledgment() <<
         ",SND.NXT=" << _next << endl;
 
-    if(_state == LISTENING) {
-        TCP::_observed.detach(this, id());
+    if(_state == LISTENING) { // the listener becomes the connection, so it moves to the bucket of the 4-tuple
+        TCP::remove(this);
         _peer = packet->from();
         _to = htons(_current->header()->from());
-        TCP::_observed.attach(this, id());
+        TCP::insert(this);
+    }
+
+    if(_keepalive) {
+        _probes = 0;
+        TCP::arm(&_keeper, KEEPALIVE_IDLE * (1000000 / TICK));
     }
 
     db<TCP>(INF) << "TCP::Connection::update:conn=" << this << " => " << *this << endl;
 
-    if(!((_state == LISTENING) || (_state == SYN_SENT)) && _current->header()->sequence() > acknowledgment()) {
-        // SEG.SEQ musn't be > than RCV.NXT, this forces segments to be accepted in order, except when connecting or listening, then one may receive stuff out of the blue
+    if(!((_state == LISTENING) || (_state == SYN_SENT)) && seq_lt(acknowledgment(), _current->header()->sequence())) {
+        // SEG.SEQ > RCV.NXT: segments are handed up in order, except when connecting or listening, then one may receive stuff out of the blue
+        // The ACK it carries is still processed and its data is queued for reassembly, while a duplicate ACK (with SACK) tells the peer about the hole
         // If SEG.SEQ < RCV.NXT, i.e. delayed or repeated segment, the treatment happens later
-        pool->nic()->free(pool);
+        if(_streaming && seq_leq(_current->header()->acknowledgment(), _max))
+            process_ack();
+
+        if(((_state == ESTABLISHED) || (_state == FIN_WAIT1) || (_state == FIN_WAIT2)) && !(_current->header()->flags() & (SYN | RST)) && _length) {
+            if(!enqueue(pool))
+                pool->nic()->free(pool);
+            fsend(ACK);
+        } else
+            pool->nic()->free(pool);
+
         return;
     }
 
-    if(_current->header()->acknowledgment() > _next) {
-        // SEG.ACK must be <= to SND.NXT, for one cannot ack what one is yet to receive
+    if(seq_lt(_max, _current->header()->acknowledgment())) {
+        // SEG.ACK must be <= to SND.MAX, for one cannot ack what one is yet to receive
         fsend(RST);
         state(CLOSED);
         pool->nic()->free(pool);
         return;
     }
 
-    bool relevant = false; // The segment is relevant to the sliding window
-    if(_streaming) {
-        if(_current->header()->acknowledgment() <= sequence()) {
-            // Regular ack, i.e. SEG.ACK is <= than the last sequence I sent
-            if(_current->header()->acknowledgment() > _unacknowledged)
-                relevant = true; // A segment must ack something in order to be relevant
-
-            _unacknowledged = _current->header()->acknowledgment();
-        } else if(_current->header()->acknowledgment() > sequence()) {
-            // Forward ack, i.e. SEG.ACK > SEG.SEQ, but not > than the SND.NXT. This scenario is only possible in this code and in the FSM during retransmission
-            _sequence = htonl(_current->header()->acknowledgment());
-            _unacknowledged = _current->header()->acknowledgment();
-            relevant = true;
-        }
-    }
+    if(_streaming)
+        process_ack();
 
     State state_at_arrival = _state;
+    unsigned int received = acknowledgment();
 
     (this->*_handler)();
 
@@ -336,16 +636,16 @@ void TCP::Connection::update(TCP::Observed * obs, const TCP::Connection_Id & cid
         return;
     }
 
-    if((state_at_arrival == ESTABLISHED)
+    if(((state_at_arrival == ESTABLISHED)
         || (state_at_arrival == SYN_RECEIVED)
         || (state_at_arrival == FIN_WAIT1)
         || (state_at_arrival == FIN_WAIT2))
-        if(_length)
-            if(!notify(cid, pool))
-                pool->nic()->free(pool);
-
-    if(_streaming && relevant)
-        _stream.signal();
+        && _length && (acknowledgment() != received)) { // the handler accepted the data
+        if(!deliver(pool))
+            pool->nic()->free(pool);
+        dequeue(); // the segment might have filled a hole
+    } else
+        pool->nic()->free(pool);
 }
 
 void TCP::Connection::listen()
@@ -411,6 +711,8 @@ void TCP::Connection::listening()
     if(_current->header()->flags() & SYN) {
         _to = htons(_current->header()->from());
         _acknowledgment = htonl(_current->header()->sequence() + 1);
+        _sack = _current->option(SACK_PERMITTED);
+        scale();
         _transition.signal();
     }
 }
@@ -420,7 +722,7 @@ void TCP::Connection::syn_sent()
     db<TCP>(TRC) << "TCP::Connection::syn_sent()" << endl;
 
     if(_current->header()->flags() & ACK) {
-        if((_current->header()->acknowledgment() <= _initial) || (_current->header()->acknowledgment() > _next)) {
+        if(seq_leq(_current->header()->acknowledgment(), _initial) || seq_lt(_next, _current->header()->acknowledgment())) {
             db<TCP>(WRN) << "TCP::Connection::syn_sent: bad acknowledgment number!" << endl;
 
             _valid = false;
@@ -429,8 +731,8 @@ void TCP::Connection::syn_sent()
             return;
         }
 
-        if((_current->header()->acknowledgment() >= _unacknowledged)
-            && (_current->header()->acknowledgment() <= _next)) {
+        if(seq_leq(_unacknowledged, _current->header()->acknowledgment())
+            && seq_leq(_current->header()->acknowledgment(), _next)) {
             if(_current->header()->flags() & RST) {
                 _valid = false;
                 state(CLOSED);
@@ -442,8 +744,10 @@ void TCP::Connection::syn_sent()
                 _acknowledgment = htonl(_current->header()->sequence() + 1);
                 _unacknowledged = _current->header()->acknowledgment();
                 _peer_window = _current->header()->window();
+                _sack = _current->option(SACK_PERMITTED);
+                scale();
 
-                if(_unacknowledged > _initial) {
+                if(seq_lt(_initial, _unacknowledged)) {
                     db<TCP>(INF) << "TCP::Connection::syn_sent: connection established!" << endl;
 
                     fsend(ACK);
@@ -473,6 +777,8 @@ void TCP::Connection::syn_sent()
 
     if(!(_current->header()->flags() & RST) && (_current->header()->flags() & SYN)) { // Simultaneous SYN
         _acknowledgment = htonl(_current->header()->sequence() + 1);
+        _sack = _current->option(SACK_PERMITTED);
+        scale();
 
         fsend(SYN | ACK);
         state(SYN_RECEIVED);
@@ -514,8 +820,8 @@ void TCP::Connection::syn_received()
     }
 
     if(_current->header()->flags() & ACK) {
-        if((_unacknowledged <= _current->header()->acknowledgment())
-            && (_current->header()->acknowledgment() <= _next)) {
+        if(seq_leq(_unacknowledged, _current->header()->acknowledgment())
+            && seq_leq(_current->header()->acknowledgment(), _next)) {
             db<TCP>(INF) << "TCP::Connection::syn_received: connection established!" << endl;
 
             state(ESTABLISHED);
@@ -523,7 +829,7 @@ void TCP::Connection::syn_received()
 
             if(_length) {
                 _acknowledgment = htonl(acknowledgment() + _length);
-                fsend(ACK);
+                acknowledge();
             }
 
             _transition.signal();
@@ -573,14 +879,14 @@ void TCP::Connection::established()
     }
 
     if(_current->header()->flags() & ACK) {
-        if(_unacknowledged <= _current->header()->acknowledgment()
-            && _current->header()->acknowledgment() <= _next) { // implicit reject out-of-order segments
+        if(seq_leq(_unacknowledged, _current->header()->acknowledgment())
+            && seq_leq(_current->header()->acknowledgment(), _next)) { // implicit reject out-of-order segments
             db<TCP>(TRC) << "TCP::Connection::established: ACK received"
                 << endl;
 
             if(_length) {
                 _acknowledgment = htonl(acknowledgment() + _length);
-                fsend(ACK);
+                acknowledge();
             }
 
             if(_current->header()->flags() & FIN) {
@@ -626,10 +932,10 @@ void TCP::Connection::fin_wait1()
 
         if(_length) {
             _acknowledgment = htonl(acknowledgment() + _length);
-            fsend(ACK);
+            acknowledge();
         }
 
-        if(_current->header()->acknowledgment() >= _next) { // our FIN has been acknowledged
+        if(seq_leq(_next, _current->header()->acknowledgment())) { // our FIN has been acknowledged
             db<TCP>(TRC) << "TCP::Connection::fin_wait1: our FIN has been acknowledged" << endl;
 
             if(_current->header()->flags() & FIN) {
@@ -685,7 +991,7 @@ void TCP::Connection::fin_wait2()
     if(_current->header()->flags() & ACK) {
         if(_length) {
             _acknowledgment = htonl(acknowledgment() + _length);
-            fsend(ACK);
+            acknowledge();
         }
 
         if(_current->header()->flags() & FIN) {
@@ -728,8 +1034,8 @@ void TCP::Connection::close_wait()
     }
 
     if((_current->header()->flags() & ACK)
-        && (_unacknowledged < _current->header()->acknowledgment())
-        && (_current->header()->acknowledgment() <= _next)) {
+        && seq_lt(_unacknowledged, _current->header()->acknowledgment())
+        && seq_leq(_current->header()->acknowledgment(), _next)) {
         _unacknowledged = _current->header()->acknowledgment();
 
         if(_current->header()->flags() & FIN) {
@@ -767,9 +1073,9 @@ void TCP::Connection::closing()
     }
 
     if((_current->header()->flags() & ACK)
-        && (_unacknowledged < _current->header()->acknowledgment())
-        && (_current->header()->acknowledgment() <= _next)
-        && (_next <= _current->header()->acknowledgment())) { // check if our FIN has been acknowledged
+        && seq_lt(_unacknowledged, _current->header()->acknowledgment())
+        && seq_leq(_current->header()->acknowledgment(), _next)
+        && seq_leq(_next, _current->header()->acknowledgment())) { // check if our FIN has been acknowledged
         db<TCP>(TRC) << "TCP::Connection::closing: our FIN has been acknowledged" << endl;
         db<TCP>(TRC) << "TCP::Connection:closing-->time_wait" << endl;
 
@@ -805,9 +1111,9 @@ void TCP::Connection::last_ack()
     }
 
     if((_current->header()->flags() & ACK)
-        && (_unacknowledged < _current->header()->acknowledgment())
-        && (_current->header()->acknowledgment() <= _next)
-        && (_next <= _current->header()->acknowledgment())) { // check if our FIN has been acknowledged
+        && seq_lt(_unacknowledged, _current->header()->acknowledgment())
+        && seq_leq(_current->header()->acknowledgment(), _next)
+        && seq_leq(_next, _current->header()->acknowledgment())) { // check if our FIN has been acknowledged
         db<TCP>(TRC) << "TCP::Connection::last_ack: our FIN has been acknowledged" << endl;
 
         state(CLOSED);
@@ -843,8 +1149,8 @@ void TCP::Connection::time_wait()
     }
 
     if((_current->header()->flags() & ACK)
-        && (_unacknowledged < _current->header()->acknowledgment())
-        && (_current->header()->acknowledgment() <= _next)
+        && seq_lt(_unacknowledged, _current->header()->acknowledgment())
+        && seq_leq(_current->header()->acknowledgment(), _next)
         && (_current->header()->flags() & FIN)) {
         process_fin();
         set_timeout();
@@ -889,7 +1195,9 @@ bool TCP::Connection::check_sequence()
 //
 //    return _valid = false;
 
-    if(WINDOW == 0) {
+    unsigned int window = space(); // RCV.WND
+
+    if(window == 0) {
         if(_length) {
             db<TCP>(TRC) << "TCP::Connection::check_seq() == false: RCV.WND == 0 AND SEG.LEN > 0" << endl;
             return (_valid = false);
@@ -904,7 +1212,7 @@ bool TCP::Connection::check_sequence()
     }
 
     if(_length) {
-        if((acknowledgment() <= _current->header()->sequence()) && (_current->header()->sequence() < (acknowledgment() + WINDOW)))
+        if(seq_leq(acknowledgment(), _current->header()->sequence()) && seq_lt(_current->header()->sequence(), acknowledgment() + window))
             return (_valid = true);
 
         db<TCP>(TRC) << "TCP::Connection::check_seq() == false: SEG.LEN > 0 AND !(RCV.NXT <= SEG.SEQ < (RCV.NXT + RCV.WND))" << endl;
@@ -912,8 +1220,8 @@ bool TCP::Connection::check_sequence()
         return (_valid = false);
     }
 
-    if(((acknowledgment() <= _current->header()->sequence()) && (_current->header()->sequence() < (acknowledgment() + WINDOW)))
-        || (acknowledgment() <= (_current->header()->sequence() + _length - 1) && (_current->header()->sequence() + _length - 1) < (acknowledgment() + WINDOW)))
+    if((seq_leq(acknowledgment(), _current->header()->sequence()) && seq_lt(_current->header()->sequence(), acknowledgment() + window))
+        || (seq_leq(acknowledgment(), _current->header()->sequence() + _length - 1) && seq_lt(_current->header()->sequence() + _length - 1, acknowledgment() + window)))
         return (_valid = true);
 
     db<TCP>(TRC) << "TCP::Connection::check_seq() == false" << endl;
@@ -925,18 +1233,388 @@ void TCP::Connection::process_fin()
 {
     db<TCP>(TRC) << "TCP::Connection::process_fin(): FIN received" << endl;
 
-    _acknowledgment = htonl(_current->header()->sequence() + 1);
+    _acknowledgment = htonl(_current->header()->sequence() + _length + 1);
 
     fsend(ACK);
 }
 
+void TCP::Connection::process_ack()
+{
+    unsigned int ack = _current->header()->acknowledgment();
+
+    db<TCP>(TRC) << "TCP::Connection::process_ack(ack=" << ack << "): SND.UNA=" << _unacknowledged << ",cwnd=" << _congestion << ",dup=" << _duplicates << endl;
+
+    if(seq_lt(_unacknowledged, ack)) {
+        unsigned int acknowledged = ack - _unacknowledged;
+
+        if(_timing && seq_leq(_timed, ack)) {
+            _timing = false;
+            measure(since(_sent));
+        }
+
+        if(_recovering) {
+            if(seq_leq(_recover, ack)) { // full acknowledgment, deflate the window
+                _recovering = false;
+                _congestion = _threshold;
+            } else { // partial acknowledgment, the next hole is retransmitted as well
+                _congestion = (_congestion > acknowledged) ? _congestion - acknowledged + MSS : MSS;
+                _retransmit = true;
+            }
+        } else if(_congestion < _threshold) // slow start
+            _congestion += (acknowledged < MSS) ? acknowledged : MSS;
+        else // congestion avoidance
+            _congestion += (MSS * MSS / _congestion) ? MSS * MSS / _congestion : 1;
+
+        _duplicates = 0;
+        _unacknowledged = ack;
+        if(seq_lt(_next, ack))
+            _next = ack;
+        _progress++;
+        _last = TSC::time_stamp();
+    } else if((ack == _unacknowledged) && !_length && seq_lt(_unacknowledged, _max)) {
+        _duplicates++;
+        if((_duplicates == DUPLICATES) && !_recovering) { // fast retransmit
+            unsigned int flight = _max - _unacknowledged;
+            _threshold = (flight / 2 > 2 * MSS) ? flight / 2 : 2 * MSS;
+            _congestion = _threshold + DUPLICATES * MSS;
+            _recover = _max;
+            _recovering = true;
+            _retransmit = true;
+            _timing = false;
+        } else if(_recovering) // each duplicate means a segment has left the network
+            _congestion += MSS;
+    }
+
+    // Each ACK reports the peer's current out-of-order queue
+    if(_sack) {
+        _sacks = 0;
+        const unsigned char * opt = _current->option(SACK);
+        if(opt)
+            for(unsigned int i = 0; (i < (opt[1] - 2u) / sizeof(Block)) && (_sacks < SACK_BLOCKS); i++) {
+                unsigned int edges[2];
+                memcpy(edges, &opt[2 + i * sizeof(Block)], sizeof(Block));
+                Block b = { ntohl(edges[0]), ntohl(edges[1]) };
+                if(seq_lt(b.left, b.right) && seq_lt(_unacknowledged, b.right) && seq_leq(b.right, _max)) {
+                    if(seq_lt(b.left, _unacknowledged))
+                        b.left = _unacknowledged;
+                    _sacked[_sacks++] = b;
+                }
+            }
+    }
+
+    _stream.signal();
+}
+
+void TCP::Connection::measure(unsigned int rtt)
+{
+    // RFC 6298: the first measurement initializes SRTT and RTTVAR, the following ones are filtered with alpha = 1/8 and beta = 1/4
+    if(!_srtt) {
+        _srtt = rtt;
+        _rttvar = rtt / 2;
+    } else {
+        unsigned int delta = (_srtt > rtt) ? _srtt - rtt : rtt - _srtt;
+        _rttvar = (3 * _rttvar + delta) / 4;
+        _srtt = (7 * _srtt + rtt) / 8;
+    }
+
+    unsigned int granularity = TICK; // of the retransmission timer
+    _rto = _srtt + ((4 * _rttvar > granularity) ? 4 * _rttvar : granularity);
+    if(_rto < RTO_MIN)
+        _rto = RTO_MIN;
+    if(_rto > TIMEOUT)
+        _rto = TIMEOUT;
+
+    db<TCP>(TRC) << "TCP::Connection::measure(rtt=" << rtt << "): srtt=" << _srtt << ",rttvar=" << _rttvar << ",rto=" << _rto << endl;
+}
+
+unsigned int TCP::Connection::sacked(unsigned int sequence) const
+{
+    for(bool moved = true; moved; ) { // blocks are not sorted
+        moved = false;
+        for(unsigned int i = 0; i < _sacks; i++)
+            if(seq_leq(_sacked[i].left, sequence) && seq_lt(sequence, _sacked[i].right)) {
+                sequence = _sacked[i].right;
+                moved = true;
+            }
+    }
+
+    return sequence;
+}
+
+unsigned int TCP::Connection::limit(unsigned int sequence, unsigned int end) const
+{
+    if(seq_lt(sequence + MSS, end))
+        end = sequence + MSS;
+
+    for(unsigned int i = 0; i < _sacks; i++)
+        if(seq_lt(sequence, _sacked[i].left) && seq_lt(_sacked[i].left, end))
+            end = _sacked[i].left;
+
+    return seq_lt(sequence, end) ? end - sequence : 0;
+}
+
+bool TCP::Connection::enqueue(Buffer * pool)
+{
+    unsigned int begin = _current->header()->sequence();
+    unsigned int end = begin + _length;
+
+    db<TCP>(TRC) << "TCP::Connection::enqueue(buf=" << pool << ",seq=" << begin << ",len=" << _length << ")" << endl;
+
+    if(seq_lt(acknowledgment() + space(), end))
+        return false;
+
+    if(_used + _queued + 1 >= RING) // a slot is always left for the segment that fills the hole
+        return false;
+
+    // Overlapping segments (retransmissions included) are dropped, the peer sends them again as holes get filled
+    unsigned int slot = QUEUE;
+    for(unsigned int i = 0; i < QUEUE; i++) {
+        if(!_queue[i]) {
+            if(slot == QUEUE)
+                slot = i;
+            continue;
+        }
+
+        unsigned int b = segment(_queue[i])->sequence();
+        unsigned int e = b + length(_queue[i]);
+        if(seq_lt(begin, e) && seq_lt(b, end))
+            return false;
+    }
+
+    if(slot == QUEUE)
+        return false;
+
+    _queue[slot] = pool;
+    _queued++;
+
+    return true;
+}
+
+void TCP::Connection::dequeue()
+{
+    bool delivered = false;
+
+    for(bool found = true; found; ) {
+        found = false;
+        for(unsigned int i = 0; i < QUEUE; i++) {
+            if(!_queue[i])
+                continue;
+
+            Buffer * pool = _queue[i];
+            unsigned int begin = segment(pool)->sequence();
+            unsigned int end = begin + length(pool);
+
+            if(seq_lt(acknowledgment(), begin))
+                continue;
+
+            _queue[i] = 0;
+            _queued--;
+            if(begin == acknowledgment()) { // its ring slot was reserved by enqueue()
+                db<TCP>(TRC) << "TCP::Connection::dequeue: delivering seq=" << begin << endl;
+
+                _acknowledgment = htonl(end);
+                deliver(pool);
+                delivered = found = true;
+            } else // already delivered, at least in part
+                pool->nic()->free(pool);
+        }
+    }
+
+    if(delivered) // a hole was filled, so the peer learns it at once (RFC 5681)
+        fsend(ACK);
+}
+
+unsigned int TCP::Connection::blocks(Block * list) const
+{
+    unsigned int n = 0;
+
+    for(unsigned int i = 0; i < QUEUE; i++) {
+        if(!_queue[i])
+            continue;
+
+        Block b;
+        b.left = segment(_queue[i])->sequence();
+        b.right = b.left + length(_queue[i]);
+
+        unsigned int j;
+        for(j = 0; j < n; j++)
+            if((b.left == list[j].right) || (b.right == list[j].left)) { // contiguous
+                if(seq_lt(b.left, list[j].left))
+                    list[j].left = b.left;
+                if(seq_lt(list[j].right, b.right))
+                    list[j].right = b.right;
+                break;
+            }
+
+        if((j == n) && (n < SACK_BLOCKS))
+            list[n++] = b;
+    }
+
+    return n;
+}
+
+bool TCP::Connection::deliver(Buffer * pool)
+{
+    db<TCP>(TRC) << "TCP::Connection::deliver(buf=" << pool << ",len=" << length(pool) << ")" << endl;
+
+    lock();
+    if(_used == RING) {
+        unlock();
+        return false;
+    }
+
+    _ring[(_head + _used) % RING] = pool;
+    _buffered += length(pool);
+    _used++;
+    unlock();
+
+    wake();
+
+    return true;
+}
+
+bool TCP::Connection::readable()
+{
+    // The reader flags it is waiting before it leaves the lock and _readable counts, so a segment delivered in between
+    // (by the receiving thread on another CPU) is not missed. On a single CPU, interrupts stay disabled until p().
+    lock();
+    while(!_used && ((_state == ESTABLISHED) || (_state == SYN_RECEIVED) || (_state == FIN_WAIT1) || (_state == FIN_WAIT2))) {
+        _waiting = true;
+        if(Traits<System>::multicore)
+            _lock.release();
+        _readable.p();
+        lock();
+    }
+    bool used = _used;
+    unlock();
+
+    return used;
+}
+
+void TCP::Connection::wake()
+{
+    lock();
+    bool waiting = _waiting;
+    _waiting = false;
+    unlock();
+
+    if(waiting)
+        _readable.v();
+}
+
+void TCP::Connection::consumed(unsigned int size)
+{
+    lock();
+    _buffered -= size;
+    unlock();
+
+    // Receiver-side silly window avoidance (RFC 1122): the peer only learns about a window that grew by at least
+    // min(WINDOW / 2, MSS) bytes, and then at once, instead of waiting for its next segment
+    unsigned int threshold = (WINDOW / 2 < MSS) ? WINDOW / 2 : MSS;
+    if((_state == ESTABLISHED || _state == FIN_WAIT1 || _state == FIN_WAIT2) && seq_leq(_advertised + threshold, acknowledgment() + space()))
+        fsend(ACK);
+}
+
+unsigned int TCP::Connection::space() const
+{
+    if((_used + _queued >= RING) || (_buffered >= WINDOW))
+        return 0;
+
+    return WINDOW - _buffered;
+}
+
+void TCP::Connection::advertise()
+{
+    unsigned int window = space() >> _scale;
+    if(window > 0xffff)
+        window = 0xffff;
+
+    _window = htons(window);
+    _advertised = acknowledgment() + (window << _scale);
+}
+
+void TCP::Connection::acknowledge()
+{
+    // Delayed ACK (RFC 1122 and RFC 5681): every second segment is acknowledged at once, as are those the sender pushed,
+    // for it is waiting for their acknowledgment to return from write(). Others wait up to ACK_DELAY, for an ACK to be
+    // piggybacked on data or on a window update.
+    _pending++;
+    if((_pending >= 2) || (_current->header()->flags() & PSH)) {
+        fsend(ACK);
+        return;
+    }
+
+    if(!_delayed.armed())
+        TCP::arm(&_delayed, ticks(ACK_DELAY));
+}
+
+void TCP::Connection::delayed(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::Connection::delayed(connection=" << c << ",pending=" << c->_pending << ")" << endl;
+
+    if(c->_pending)
+        c->fsend(ACK);
+}
+
+void TCP::Connection::expired(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::Connection::expired(connection=" << c << ",rto=" << c->_rto << ")" << endl;
+
+    c->_stream.signal();
+}
+
+void TCP::Connection::keepalive(bool enable)
+{
+    db<TCP>(TRC) << "TCP::Connection::keepalive(enable=" << enable << ")" << endl;
+
+    _keepalive = enable;
+    _probes = 0;
+    if(enable)
+        TCP::arm(&_keeper, KEEPALIVE_IDLE * (1000000 / TICK));
+    else
+        TCP::disarm(&_keeper);
+}
+
+void TCP::Connection::idle(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::Connection::idle(connection=" << c << ",probes=" << c->_probes << ")" << endl;
+
+    if((c->_state != ESTABLISHED) && (c->_state != CLOSE_WAIT))
+        return;
+
+    if(c->_probes == KEEPALIVE_PROBES) {
+        db<TCP>(WRN) << "TCP::Connection::idle: peer is gone! Closing connection!" << endl;
+
+        c->state(CLOSED);
+        c->_stream.signal();
+        return;
+    }
+
+    // A probe carries SND.NXT - 1, so the peer answers it with an ACK even if it has nothing to send (RFC 1122)
+    c->_probes++;
+    c->_next--;
+    c->fsend(ACK);
+    c->_next++;
+    TCP::arm(&c->_keeper, KEEPALIVE_INTERVAL * (1000000 / TICK));
+}
+
+void TCP::Connection::scale()
+{
+    const unsigned char * opt = _current->option(WINDOW_SCALE);
+
+    if(SCALE && opt && (opt[1] == 3)) { // both sides must offer it (RFC 7323)
+        _scale = SCALE;
+        _peer_scale = (opt[2] > 14) ? 14 : opt[2];
+    } else {
+        _scale = 0;
+        _peer_scale = 0;
+    }
+}
+
 void TCP::Connection::timeout(Connection* c)
 {
     db<TCP>(TRC) << "TCP::Connection::timeout(connection=" << c << ",state=" << c->_state << ")" << endl;
 
-    delete c->_alarm;
-    c->_alarm = 0;
-
     if(c->_state == TIME_WAIT) {
         // TIME-WAIT timeout
         c->state(CLOSED);
@@ -974,12 +1652,7 @@ void TCP::Connection::set_timeout(const Microsecond & time)
 {
     db<TCP>(TRC) << "TCP::Connection::set_timeout" << endl;
 
-    if(_alarm) {
-        delete _alarm;
-        _alarm = 0;
-    }
-
-    _alarm = new (SYSTEM) Alarm(time, &_timeout_handler);
+    TCP::arm(&_timer, ticks(time));
 }
 
 __END_SYS
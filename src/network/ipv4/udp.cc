@@ -10,17 +10,25 @@ __BEGIN_SYS
 UDP::Observed UDP::_observed;
 
 // Methods
-int UDP::send(const Address & from, const Address & to, const void * d, unsigned int s)
+int UDP::send(const Address & from, const Address & to, const void * data, unsigned int size)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
-    unsigned int size = (s > sizeof(Data)) ? sizeof(Data) : s;
+    IP::IO_Vector iov = { data, size };
+    return send(from, to, &iov, 1);
+}
+
+
+int UDP::send(const Address & from, const Address & to, const IP::IO_Vector * iov, unsigned int count)
+{
+    IP::Gather data(iov, count);
+    unsigned int size = (data.size() > sizeof(Data)) ? sizeof(Data) : data.size();
 
-    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",d=" << data << ",s=" << size << ")" << endl;
+    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",iov=" << iov << ",n=" << count << ",s=" << size << ")" << endl;
 
     Buffer * pool = IP::alloc(to.ip(), IP::UDP, sizeof(Header), size);
     if(!pool)
         return 0;
 
+    // Data is checksummed while it is gathered into the buffers, so it is read only once
     Message * message = 0;
     unsigned int headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
@@ -33,67 +41,51 @@ int UDP::send(const Address & from, const Address & to, const void * d, unsigned
             message = packet->data<Message>();
             new(packet->data<void>()) Header(from.port(), to.port(), size);
             message->sum_header(packet->from(), packet->to());
-            memcpy(message->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            data += buf->size() - sizeof(Header) - sizeof(IP::Header);
+            data.copy(message->data<void>(), buf->size() - sizeof(Header) - sizeof(IP::Header));
 
             db<UDP>(INF) << "UDP::send:msg=" << message << " => " << *message << endl;
-        } else {
-            memcpy(packet->data<void>(), data, buf->size() - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(IP::Header));
-            data += buf->size() - sizeof(IP::Header);
-        }
+        } else
+            data.copy(packet->data<void>(), buf->size() - sizeof(IP::Header));
 
         headers += sizeof(IP::Header);
     }
 
+    message->sum_data(data.sum());
     message->sum_trailer();
 
     return IP::send(pool) - headers; // implicitly releases the pool
 }
 
 
-int UDP::receive(Buffer * pool, void * d, unsigned int s)
+int UDP::receive(Buffer * pool, void * data, unsigned int size)
 {
-    unsigned char * data = reinterpret_cast<unsigned char *>(d);
-
-    db<UDP>(TRC) << "UDP::receive(buf=" << pool << ",d=" << d << ",s=" << s << ")" << endl;
+    db<UDP>(TRC) << "UDP::receive(buf=" << pool << ",d=" << data << ",s=" << size << ")" << endl;
 
-    Buffer::Element * head = pool->link();
-    Packet * packet = head->object()->frame()->data<Packet>();
-    Message * message = packet->data<Message>();
-    unsigned int size = 0;
-
-    for(Buffer::Element * el = head; el && (size <= s); el = el->next()) {
-        Buffer * buf = el->object();
-
-        db<UDP>(INF) << "UDP::receive:buf=" << buf << " => " << *buf << endl;
+    IP::View view;
+    if(!receive(pool, &view))
+        return 0;
 
-        packet = buf->frame()->data<Packet>();
+    return view.copy(data, size); // view's destructor returns the buffers to the NIC
+}
 
-        unsigned int len = buf->size() - sizeof(IP::Header);
-        if(el == head) {
-            len -= sizeof(Header);
-            memcpy(data, message->data<void>(), len);
 
-            db<UDP>(INF) << "UDP::receive:msg=" << message << " => " << *message << endl;
-        } else
-            memcpy(data, packet->data<void>(), len);
+int UDP::receive(Buffer * pool, IP::View * view)
+{
+    db<UDP>(TRC) << "UDP::receive(buf=" << pool << ",v=" << view << ")" << endl;
 
-        db<UDP>(INF) << "UDP::receive:len=" << len << endl;
+    Message * message = pool->frame()->data<Packet>()->data<Message>();
 
-        data += len;
-        size += len;
-    }
+    db<UDP>(INF) << "UDP::receive:msg=" << message << " => " << *message << endl;
 
-    pool->nic()->free(pool);
+    view->release();
+    new (view) IP::View(pool, sizeof(Header));
 
     if(!message->check()) {
-        db<UDP>(WRN) << "UDP::update: wrong message checksum!" << endl;
-        size = 0;
+        db<UDP>(WRN) << "UDP::receive: wrong message checksum!" << endl;
+        view->release();
     }
 
-    return size;
+    return view->size();
 }
 
 
@@ -116,30 +108,28 @@ void UDP::Message::sum_header(const IP::Address & from, const IP::Address & to)
     _checksum = 0;
     if(Traits<UDP>::checksum) {
         IP::Pseudo_Header pseudo(from, to, IP::UDP, length());
-        unsigned long sum = 0;
+        unsigned long sum = IP::sum(&pseudo, sizeof(IP::Pseudo_Header)) + IP::sum(header(), sizeof(Header));
 
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-        for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-
-        ptr = reinterpret_cast<const unsigned char *>(header());
-        for(unsigned int i = 0; i < sizeof(Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
+        while(sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
 
         _checksum = sum;
     }
 }
 
 void UDP::Message::sum_data(const void * data, unsigned int size)
+{
+    if(Traits<UDP>::checksum)
+        sum_data(IP::sum(data, size));
+}
+
+void UDP::Message::sum_data(unsigned long sum)
 {
     if(Traits<UDP>::checksum) {
-        unsigned long sum = _checksum;
+        sum += _checksum;
 
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
+        while(sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
 
         _checksum = sum;
     }
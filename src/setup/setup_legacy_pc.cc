@@ -598,6 +598,9 @@ void PC_Setup::enable_paging()
     // Set stack pointer to its logical address
     ASM("orl %0, %%esp" : : "i" (PHY_MEM));
 
+    // Keep the TLB entries of the system's 4M logical address space (GSYS pages) across address space switches
+    CPU::cr4(CPU::cr4() | CPU::CR4_PGE);
+
     // Flush TLB to ensure we've got the right memory organization
     MMU::flush_tlb();
 }
@@ -681,44 +684,45 @@ void PC_Setup::setup_sys_pt()
                    << ")" << endl;
 
     // Get the physical address for the System Page Table
+    // Its pages are global because the table is shared by all address spaces at SYS (see setup_sys_pd())
     PT_Entry * sys_pt = reinterpret_cast<PT_Entry *>((void *)si->pmm.sys_pt);
 
     // Clear the System Page Table
     memset(sys_pt, 0, sizeof(Page));
 
     // IDT
-    sys_pt[MMU::page(IDT)] = si->pmm.idt | Flags::SYS;
+    sys_pt[MMU::page(IDT)] = si->pmm.idt | Flags::GSYS;
 
     // GDT
-    sys_pt[MMU::page(GDT)] = si->pmm.gdt | Flags::SYS;
+    sys_pt[MMU::page(GDT)] = si->pmm.gdt | Flags::GSYS;
 
     // TSSs
     for(unsigned int i = 0; i < Traits<Machine>::CPUS; i++)
-        sys_pt[MMU::page(TSS0) + i] = (si->pmm.tss + i * sizeof(Page)) | Flags::SYS;
+        sys_pt[MMU::page(TSS0) + i] = (si->pmm.tss + i * sizeof(Page)) | Flags::GSYS;
 
     // Set an entry to this page table, so the system can access it later
-    sys_pt[MMU::page(SYS_PT)] = si->pmm.sys_pt | Flags::SYS;
+    sys_pt[MMU::page(SYS_PT)] = si->pmm.sys_pt | Flags::GSYS;
 
     // System Page Directory
-    sys_pt[MMU::page(SYS_PD)] = si->pmm.sys_pd | Flags::SYS;
+    sys_pt[MMU::page(SYS_PD)] = si->pmm.sys_pd | Flags::GSYS;
 
     // System Info
-    sys_pt[MMU::page(SYS_INFO)] = si->pmm.sys_info | Flags::SYS;
+    sys_pt[MMU::page(SYS_INFO)] = si->pmm.sys_info | Flags::GSYS;
 
     unsigned int i;
     PT_Entry aux;
 
     // SYSTEM code
     for(i = 0, aux = si->pmm.sys_code; i < MMU::pages(si->lm.sys_code_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_CODE) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_CODE) + i] = aux | Flags::GSYS;
 
     // SYSTEM data
     for(i = 0, aux = si->pmm.sys_data; i < MMU::pages(si->lm.sys_data_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_DATA) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_DATA) + i] = aux | Flags::GSYS;
 
     // SYSTEM stack (used only during init and for the ukernel model)
     for(i = 0, aux = si->pmm.sys_stack; i < MMU::pages(si->lm.sys_stack_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_STACK) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_STACK) + i] = aux | Flags::GSYS;
 
     db<Setup>(INF) << "SPT=" << *reinterpret_cast<Page_Table *>(sys_pt) << endl;
 }
@@ -7,9 +7,27 @@ extern "C" { void _panic(); }
 __BEGIN_UTIL
 
 // Methods
-void Simple_Heap::out_of_memory()
+void Simple_Heap::out_of_memory(unsigned int bytes)
 {
-    db<Heaps>(ERR) << "Heap::alloc(this=" << this << "): out of memory!" << endl;
+    db<Heaps>(ERR) << "Heap::alloc(this=" << this << ",bytes=" << bytes << "): out of memory!" << endl;
+
+    if(instrumented) {
+        db<Heaps>(ERR) << "Heap::statistics={in_use=" << _statistics.in_use
+                       << ",peak=" << _statistics.peak
+                       << ",allocs=" << _statistics.allocations
+                       << ",frees=" << _statistics.frees
+                       << ",failures=" << _statistics.failures
+                       << ",free=" << free_bytes()
+                       << ",blocks=" << free_blocks()
+                       << ",largest=" << largest_free_block()
+                       << ",frag=" << fragmentation() << "%}" << endl;
+
+        for(unsigned int i = 0; i < _sites.size(); i++)
+            if(_sites[i].address)
+                db<Heaps>(ERR) << "Heap::site[" << _sites[i].address << "]={count=" << _sites[i].count << ",bytes=" << _sites[i].bytes << "}" << endl;
+        if(_sites.dropped())
+            db<Heaps>(ERR) << "Heap::sites: " << _sites.dropped() << " allocations not recorded (histogram full)" << endl;
+    }
 
     _panic();
 }
@@ -0,0 +1,85 @@
+// EPOS DVFS Governor Test Program
+//
+// Three periodic threads declare their worst-case capacities but their jobs only use part of them, as real
+// jobs usually do. The governor should keep the CPU below its nominal frequency without causing deadline
+// misses. Utilizations, frequency levels and misses are printed, followed by the governor's residency dump.
+
+#include <time.h>
+#include <real-time.h>
+#include <governor.h>
+
+using namespace EPOS;
+
+const unsigned int TASKS = 3;
+const unsigned int iterations = 100;
+const long periods[TASKS] = {10000, 20000, 40000};      // us
+const long capacities[TASKS] = {2000, 4000, 8000};      // us, worst case (U = 0.6)
+const unsigned int usage[TASKS] = {25, 50, 75};         // % of the capacity each job actually uses
+
+OStream cout;
+
+// Jobs do a fixed amount of work, so they take longer at lower frequencies, instead of spinning until a deadline
+volatile unsigned long work;
+unsigned long long loops_per_ms; // calibrated at full speed, before the governor scales anything
+
+void spin(unsigned long long loops)
+{
+    for(unsigned long long i = 0; i < loops; i++)
+        work++;
+}
+
+void calibrate()
+{
+    const unsigned long long LOOPS = 1000000;
+    TSC::Time_Stamp t0 = TSC::time_stamp();
+    spin(LOOPS);
+    TSC::Time_Stamp t1 = TSC::time_stamp();
+    loops_per_ms = LOOPS * (TSC::frequency() / 1000) / (t1 - t0);
+}
+
+void busy(unsigned long us)
+{
+    spin(loops_per_ms * us / 1000); // us at full speed
+}
+
+int job(unsigned int task)
+{
+    for(unsigned int i = 0; i < iterations; i++) {
+        busy(capacities[task] * usage[task] / 100);
+        Periodic_Thread::wait_next();
+    }
+
+    return 0;
+}
+
+int main()
+{
+    cout << "DVFS Governor Test" << endl;
+
+    calibrate();
+    cout << "Calibrated " << loops_per_ms << " loops/ms at full speed" << endl;
+
+    Periodic_Thread * threads[TASKS];
+    for(unsigned int i = 0; i < TASKS; i++)
+        threads[i] = new Periodic_Thread(RTConf(periods[i], periods[i], capacities[i], 0, iterations), &job, i);
+
+    Delay(periods[TASKS - 1] * 2); // let every task complete a few jobs
+    cout << "Partition utilization = " << Governor::utilization(0) << "/" << Governor::SCALE << ", level = " << Governor::level(0) << endl;
+
+    unsigned int misses = 0;
+    for(unsigned int i = 0; i < TASKS; i++) {
+        threads[i]->join();
+        cout << "Task " << i << ": misses = " << threads[i]->misses() << endl;
+        misses += threads[i]->misses();
+    }
+
+    for(unsigned int i = 0; i < TASKS; i++)
+        delete threads[i];
+
+    cout << "Utilization after deleting every task = " << Governor::utilization(0) << endl;
+    Governor::dump();
+
+    cout << "I'm done with " << misses << " deadline misses, bye!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+// EPOS Per-CPU Storage Test Program
+//
+// Two threads, one per CPU, keep incrementing their own counters, first in a plain array (the layout used by
+// the kernel's per-CPU statistics before Per_CPU) and then in a Per_CPU. The PMU counts the loads that hit a
+// line modified by the other core (XSNP_HITM), which is what false sharing costs.
+
+#include <architecture.h>
+#include <time.h>
+#include <process.h>
+#include <clerk.h>
+#include <utility/per_cpu.h>
+
+using namespace EPOS;
+
+constexpr PMU::Event Intel_Sandy_Bridge_PMU::_events[PMU::EVENTS];
+
+const unsigned int CPUS = Traits<Build>::CPUS;
+const unsigned int ITERATIONS = 1000000;
+
+enum Layout { PACKED, PADDED, LAYOUTS };
+const char * names[LAYOUTS] = { "packed", "per_cpu" };
+
+volatile unsigned long packed[CPUS];
+Per_CPU<volatile unsigned long> padded;
+
+struct Result {
+    PMU::Count hitm;
+    TSC::Time_Stamp cycles;
+} results[LAYOUTS][CPUS];
+
+volatile unsigned int ready;
+
+OStream cout;
+
+int writer(unsigned int cpu, int layout)
+{
+    volatile unsigned long & counter = (layout == PACKED) ? packed[cpu] : padded[cpu];
+    Clerk<PMU> hitm(Traits_Tokens::XSNP_HITM_SB);
+
+    // Start both writers together, so they actually compete for the line
+    CPU::finc(ready);
+    while(ready < CPUS);
+
+    hitm.reset();
+    hitm.start();
+    TSC::Time_Stamp t0 = TSC::time_stamp();
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        counter++;
+    results[layout][cpu].cycles = TSC::time_stamp() - t0;
+    hitm.stop();
+    results[layout][cpu].hitm = hitm.read();
+
+    return 0;
+}
+
+int main()
+{
+    cout << "Per-CPU Storage Test" << endl;
+    cout << "Per_CPU slot size = " << Per_CPU<volatile unsigned long>::SLOT_SIZE << " bytes" << endl;
+
+    Thread * threads[CPUS];
+    for(int layout = PACKED; layout < LAYOUTS; layout++) {
+        ready = 0;
+        for(unsigned int cpu = 0; cpu < CPUS; cpu++)
+            threads[cpu] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, cpu)), &writer, cpu, layout);
+        for(unsigned int cpu = 0; cpu < CPUS; cpu++) {
+            threads[cpu]->join();
+            delete threads[cpu];
+        }
+    }
+
+    cout << "# layout,cpu,iterations,xsnp_hitm,tsc_cycles" << endl;
+    for(int layout = PACKED; layout < LAYOUTS; layout++)
+        for(unsigned int cpu = 0; cpu < CPUS; cpu++)
+            cout << "PER_CPU," << names[layout] << "," << cpu << "," << ITERATIONS << "," << results[layout][cpu].hitm << "," << results[layout][cpu].cycles << endl;
+
+    int errors = 0;
+    for(unsigned int cpu = 0; cpu < CPUS; cpu++)
+        if((packed[cpu] != ITERATIONS) || (padded[cpu] != ITERATIONS))
+            errors++;
+    if(reinterpret_cast<unsigned long>(&padded[1]) - reinterpret_cast<unsigned long>(&padded[0]) < Traits<CPU>::CACHE_LINE_SIZE)
+        errors++;
+
+    cout << "I'm done with " << errors << " errors, bye!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+// EPOS Sampling Profiler Test Program
+//
+// The main thread samples its own CPU every PERIOD core cycles while it spins in hot(), a tight loop that should
+// take most of the samples. The samples are checked against the entry of hot() and the running thread, and the whole
+// profile is printed by Thread::idle() at shutdown, so it can be symbolized with:
+//
+//     eposprof LOG img/profiler_test img/setup_pc (or whichever images hold the sampled code)
+
+#include <architecture.h>
+#include <process.h>
+#include <clerk.h>
+
+using namespace EPOS;
+
+constexpr PMU::Event Intel_Sandy_Bridge_PMU::_events[PMU::EVENTS];
+
+const unsigned long PERIOD = 100000; // core cycles between samples
+const unsigned long ITERATIONS = 200000000;
+const unsigned long HOT_SIZE = 256; // bytes from the entry of hot() that a sample of its loop can hit, generously
+
+OStream cout;
+
+volatile unsigned long work;
+
+void hot(unsigned long iterations) __attribute__((noinline));
+void hot(unsigned long iterations)
+{
+    for(unsigned long i = 0; i < iterations; i++)
+        work++;
+}
+
+int main()
+{
+    cout << "Profiler Test" << endl;
+
+    if(!Profiler::start(Traits_Tokens::CPU_CYCLES, PERIOD)) {
+        cout << "FAIL: the profiler could not be started!" << endl;
+        return -1;
+    }
+    hot(ITERATIONS);
+    Profiler::stop();
+
+    unsigned int cpu = CPU::id();
+    unsigned long begin = reinterpret_cast<unsigned long>(&hot);
+    unsigned int kept = Profiler::samples(cpu);
+    unsigned int in_hot = 0;
+    unsigned int in_self = 0;
+    for(unsigned int i = 0; i < kept; i++) {
+        const Profiler::Sample & s = Profiler::sample(cpu, i);
+        unsigned long ip = reinterpret_cast<unsigned long>(static_cast<void *>(s.ip));
+        if((ip >= begin) && (ip < begin + HOT_SIZE))
+            in_hot++;
+        if(s.thread == Thread::self())
+            in_self++;
+    }
+
+    cout << "Samples: taken=" << Profiler::taken(cpu) << ", kept=" << kept << ", in hot()=" << in_hot << ", in this thread=" << in_self << endl;
+
+    // Timer interrupts and the like take some samples too, but hot() must dominate
+    if(!kept || (in_hot * 2 < kept) || (in_self * 2 < kept)) {
+        cout << "FAIL: hot() does not dominate the profile!" << endl;
+        return -1;
+    }
+
+    cout << "PASS" << endl;
+
+    return 0;
+}
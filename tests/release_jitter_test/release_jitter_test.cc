@@ -0,0 +1,102 @@
+// EPOS Release Jitter Test Program
+//
+// A high-priority periodic thread measures the delay between the release of each of its jobs (by the alarm
+// handler) and the moment the job actually starts running, while a low-priority thread keeps the kernel
+// busy with critical sections. The delays are printed as a histogram, followed by the longest
+// interrupts-off and preemption-off sections recorded by the Latency tracer.
+
+#include <time.h>
+#include <synchronizer.h>
+#include <real-time.h>
+#include <latency.h>
+
+using namespace EPOS;
+
+const int iterations = 1000;
+const long period = 1000; // us
+
+const unsigned int BUCKETS = 10;
+const unsigned long bounds[BUCKETS] = {1, 2, 5, 10, 20, 50, 100, 200, 500, -1UL}; // upper bounds in us
+
+unsigned long histogram[BUCKETS];
+unsigned long long worst;
+
+volatile bool done;
+
+OStream cout;
+
+int measurer()
+{
+    Periodic_Thread * self = static_cast<Periodic_Thread *>(Thread::self());
+
+    for(int i = 0; i < iterations; i++) {
+        Periodic_Thread::wait_next();
+
+        // job(0) is the job that has just completed, whose release and start are both known
+        const Periodic_Thread::Job & job = self->job();
+        unsigned long long jitter = (job.start - job.release) * 1000000ULL / TSC::frequency();
+        if(jitter > worst)
+            worst = jitter;
+
+        unsigned int b = 0;
+        for(; jitter >= bounds[b]; b++);
+        histogram[b]++;
+    }
+
+    done = true;
+
+    return 0;
+}
+
+int load()
+{
+    Semaphore semaphore;
+
+    while(!done) {
+        semaphore.p();
+        semaphore.v();
+        Thread::yield();
+    }
+
+    return 0;
+}
+
+int main()
+{
+    cout << "Release Jitter Test" << endl;
+    cout << "Measuring " << iterations << " releases of a periodic thread with period " << period << " us" << endl;
+
+    Latency::reset();
+
+    Thread * background = new Thread(&load);
+    Periodic_Thread * periodic = new Periodic_Thread(RTConf(period, 0, 0, 0, iterations), &measurer);
+
+    periodic->join();
+    background->join();
+
+    cout << "Release jitter histogram (us):" << endl;
+    unsigned long lower = 0;
+    for(unsigned int b = 0; b < BUCKETS; b++) {
+        cout << "[" << lower << ", ";
+        if(b < BUCKETS - 1)
+            cout << bounds[b] << ")";
+        else
+            cout << "inf)";
+        cout << ": " << histogram[b] << endl;
+        lower = bounds[b];
+    }
+    cout << "Worst release jitter: " << worst << " us" << endl;
+    cout << "Deadline misses: " << periodic->misses() << endl;
+
+    cout << "Longest interrupts-off section: " << Latency::max(Latency::INTERRUPTS, 0) * 1000000ULL / TSC::frequency()
+         << " us at " << reinterpret_cast<void *>(Latency::max_site(Latency::INTERRUPTS, 0)) << endl;
+    cout << "Longest preemption-off section: " << Latency::max(Latency::PREEMPTION, 0) * 1000000ULL / TSC::frequency()
+         << " us at " << reinterpret_cast<void *>(Latency::max_site(Latency::PREEMPTION, 0)) << endl;
+
+    delete periodic;
+    delete background;
+
+    cout << "I'm done, bye!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+// EPOS Thread Pool Test Program (spawn/join benchmark)
+
+#include <time.h>
+#include <process.h>
+
+using namespace EPOS;
+
+const int iterations = 1000;
+const int pool_size = 4;
+
+OStream cout;
+
+Thread_Pool<Thread, pool_size> pool;
+
+int job(int i)
+{
+    return i;
+}
+
+void report(const char * name, const Microsecond & elapsed)
+{
+    cout << name << ": " << iterations << " spawn/join cycles in " << elapsed << " us";
+    if(elapsed)
+        cout << " => " << (iterations * 1000000U) / elapsed << " cycles/s";
+    cout << endl;
+}
+
+int main()
+{
+    cout << "Thread Pool test" << endl;
+
+    Chronometer chrono;
+    int errors = 0;
+
+    chrono.start();
+    for(int i = 0; i < iterations; i++) {
+        Thread * t = new Thread(&job, i);
+        if(t->join() != i)
+            errors++;
+        delete t;
+    }
+    chrono.stop();
+    report("Heap", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(int i = 0; i < iterations; i++) {
+        Thread * t = pool.create(&job, i);
+        if(t->join() != i)
+            errors++;
+        pool.destroy(t);
+    }
+    chrono.stop();
+    report("Pool", chrono.read());
+
+    Thread * threads[pool_size + 1];
+    for(int i = 0; i < pool_size; i++)
+        threads[i] = pool.create(Thread::Configuration(Thread::SUSPENDED), &job, i);
+    threads[pool_size] = pool.create(&job, pool_size);
+    if(threads[pool_size])
+        errors++;
+    for(int i = 0; i < pool_size; i++) {
+        threads[i]->resume();
+        threads[i]->join();
+        pool.destroy(threads[i]);
+    }
+
+    cout << "I'm done with " << errors << " errors, bye!" << endl;
+
+    return 0;
+}
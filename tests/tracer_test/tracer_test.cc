@@ -0,0 +1,58 @@
+// EPOS Scheduler Tracer Test Program
+//
+// One thread per CPU sleeps and yields for a few rounds, so every CPU records dispatches, sleeps, wakeups and alarms.
+// The rings are checked here and printed by Thread::idle() at shutdown, so the trace can be converted with:
+//
+//     epostrace LOG > trace.json (then open it in chrome://tracing or Perfetto)
+
+#include <architecture.h>
+#include <time.h>
+#include <process.h>
+#include <tracer.h>
+
+using namespace EPOS;
+
+const unsigned int CPUS = Traits<Build>::CPUS;
+const unsigned int ROUNDS = 10;
+const Microsecond PERIOD = 5000;
+
+OStream cout;
+
+int worker(unsigned int cpu)
+{
+    for(unsigned int i = 0; i < ROUNDS; i++) {
+        Delay nap(PERIOD);
+        Thread::yield();
+    }
+
+    return cpu;
+}
+
+int main()
+{
+    cout << "Scheduler Tracer Test" << endl;
+
+    Thread * threads[CPUS];
+    for(unsigned int cpu = 0; cpu < CPUS; cpu++)
+        threads[cpu] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, cpu)), &worker, cpu);
+    for(unsigned int cpu = 0; cpu < CPUS; cpu++) {
+        threads[cpu]->join();
+        delete threads[cpu];
+    }
+
+    int errors = 0;
+    for(unsigned int cpu = 0; cpu < CPU::cores(); cpu++) {
+        cout << "CPU" << cpu << ": recorded=" << Tracer::recorded(cpu) << endl;
+        if(Tracer::recorded(cpu) < ROUNDS) // at least one sleep per round
+            errors++;
+    }
+
+    if(errors) {
+        cout << "FAIL: " << errors << " CPU(s) recorded too few events!" << endl;
+        return -1;
+    }
+
+    cout << "PASS" << endl;
+
+    return 0;
+}